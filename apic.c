@@ -10,9 +10,12 @@
 #include "memory.h"
 #include "vmm.h"
 #include "pmm.h"
+#include "pit.h"
 
 #define APIC_BASE_MSR	0x1B
 
+#define APIC_REG_ID 0x20
+#define APIC_REG_EOI 0xB0
 #define APIC_REG_SPIV 0xF0
 #define APIC_REG_ICR_LOW 0x300
 #define APIC_REG_ICR_HIGH 0x310
@@ -23,6 +26,13 @@
 #define APIC_REG_LVT_LINT0 0x350
 #define APIC_REG_LVT_LINT1 0x360
 #define APIC_REG_LVT_ERROR 0x370
+#define APIC_REG_TIMER_INIT 0x380
+#define APIC_REG_TIMER_CURRENT 0x390
+
+#define APIC_ICR_PENDING		(1 << 12)
+#define APIC_LVT_MASKED			(1 << 16)
+#define APIC_TIMER_DIVIDE_16	0x3
+#define APIC_TIMER_CALIBRATION	10		//Dauer der Kalibrierung in ms
 
 typedef struct{
 	paddr_t physBase;
@@ -30,6 +40,7 @@ typedef struct{
 }apic_info_t;
 
 static apic_info_t apic_info;
+static uint32_t timer_ticksPerMs;
 
 bool apic_available()
 {
@@ -44,10 +55,92 @@ void apic_Init()
 	//Speicherbereich mappen
 	apic_info.virtBase = vmm_Map(&kernel_context, NULL, apic_info.physBase, 1, VMM_FLAGS_GLOBAL | VMM_FLAGS_NX | VMM_FLAGS_WRITE | VMM_FLAGS_NO_CACHE);
 
-	//APIC aktivieren
+	apic_InitCpu();
+}
+
+/*
+ * Aktiviert den Local APIC der aktuellen CPU
+ */
+void apic_InitCpu()
+{
 	apic_Write(APIC_REG_SPIV, 1 << 8);
 }
 
+/*
+ * Gibt die ID des Local APICs der aktuellen CPU zurück
+ */
+uint8_t apic_getId()
+{
+	return apic_Read(APIC_REG_ID) >> 24;
+}
+
+/*
+ * Signalisiert das Ende eines Interrupts an den Local APIC
+ */
+void apic_eoi()
+{
+	apic_Write(APIC_REG_EOI, 0);
+}
+
+/*
+ * Sendet einen Interprozessorinterrupt
+ *
+ * Parameter:	dest = APIC-ID des Ziels (wird bei einem Shorthand ignoriert)
+ * 				command = Unterer Teil des Interrupt Command Registers
+ */
+void apic_sendIPI(uint8_t dest, uint32_t command)
+{
+	//Die beiden Register müssen auf derselben CPU geschrieben werden
+	bool enabled = cpu_disableInterrupts();
+	while(apic_Read(APIC_REG_ICR_LOW) & APIC_ICR_PENDING) CPU_PAUSE();
+	apic_Write(APIC_REG_ICR_HIGH, (uint32_t)dest << 24);
+	apic_Write(APIC_REG_ICR_LOW, command);
+	cpu_restoreInterrupts(enabled);
+}
+
+/*
+ * Misst die Frequenz des APIC-Timers mit dem PIT. Die Interrupts müssen aktiviert sein.
+ */
+void apic_calibrateTimer()
+{
+	apic_Write(APIC_REG_DIV_CONFIG, APIC_TIMER_DIVIDE_16);
+	apic_Write(APIC_REG_LVT_TIMER, APIC_LVT_MASKED);
+
+	//Auf den Anfang einer Millisekunde warten
+	uint64_t start = pit_getUptime();
+	while(pit_getUptime() == start) CPU_HALT();
+
+	apic_Write(APIC_REG_TIMER_INIT, UINT32_MAX);
+	start = pit_getUptime();
+	while(pit_getUptime() < start + APIC_TIMER_CALIBRATION) CPU_HALT();
+	uint32_t ticks = UINT32_MAX - apic_Read(APIC_REG_TIMER_CURRENT);
+	apic_Write(APIC_REG_TIMER_INIT, 0);
+
+	timer_ticksPerMs = ticks / APIC_TIMER_CALIBRATION;
+}
+
+/*
+ * Stellt den Timer des Local APICs der aktuellen CPU auf One-Shot-Betrieb mit dem Interrupt APIC_TIMER_VECTOR ein.
+ * Der Timer wird erst durch apic_armTimer gestartet.
+ */
+void apic_initTimer()
+{
+	apic_Write(APIC_REG_TIMER_INIT, 0);
+	apic_Write(APIC_REG_DIV_CONFIG, APIC_TIMER_DIVIDE_16);
+	apic_Write(APIC_REG_LVT_TIMER, APIC_TIMER_VECTOR);
+}
+
+/*
+ * Startet den Timer des Local APICs der aktuellen CPU neu. Ein bereits laufender Timer wird dabei ersetzt.
+ *
+ * Parameter:	msec = Zeit bis zum Interrupt in Millisekunden oder 0, um den Timer anzuhalten
+ */
+void apic_armTimer(uint64_t msec)
+{
+	uint64_t ticks = timer_ticksPerMs * msec;
+	apic_Write(APIC_REG_TIMER_INIT, (ticks > UINT32_MAX) ? UINT32_MAX : ticks);
+}
+
 /*
  * Ein APIC-Register auslesen
  *
@@ -11,9 +11,20 @@
 #include "stdbool.h"
 #include "stdint.h"
 
+#define APIC_TIMER_VECTOR		64		//Interrupt des Timers des Local APICs
+#define APIC_RESCHEDULE_VECTOR	65		//Interprozessorinterrupt, welcher eine CPU zum Schedulen auffordert
+#define APIC_TLB_VECTOR			66		//Interprozessorinterrupt, welcher TLB-Einträge ungültig macht
+
 void apic_Init();
+void apic_InitCpu();
 bool apic_available();
 uint32_t apic_Read(uintptr_t offset);
 void apic_Write(uintptr_t offset, uint32_t value);
+uint8_t apic_getId();
+void apic_eoi();
+void apic_sendIPI(uint8_t dest, uint32_t command);
+void apic_calibrateTimer();
+void apic_initTimer();
+void apic_armTimer(uint64_t msec);
 
 #endif /* APIC_H_ */
@@ -55,9 +55,9 @@ struct cdi_mem_area* cdi_mem_alloc(size_t size, cdi_mem_flags_t flags)
 	//Speicher reservieren
 	paddr_t maxAddress = -1;
 	if(flags & CDI_MEM_DMA_16M)
-		maxAddress = 16777216;
+		maxAddress = PMM_ZONE_DMA16_END;
 	else if(flags & CDI_MEM_DMA_4G)
-		maxAddress = 4294967296;
+		maxAddress = PMM_ZONE_DMA32_END;
 	vaddr = vmm_AllocDMA(maxAddress, size / MM_BLOCK_SIZE, &paddr);
 	if(vaddr == NULL)
 		return NULL;
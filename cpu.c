@@ -13,6 +13,14 @@
 
 #define NULL (void*)0
 
+cpu_local_t cpuLocal[CPU_MAX_COUNT];
+
+//interrupts.S greift direkt auf diese Felder zu
+_Static_assert(offsetof(cpu_local_t, self) == 0x00, "cpu_local_t.self has to be at offset 0x00");
+_Static_assert(offsetof(cpu_local_t, kernelStack) == 0x08, "cpu_local_t.kernelStack has to be at offset 0x08");
+_Static_assert(offsetof(cpu_local_t, releaseFlag) == 0x10, "cpu_local_t.releaseFlag has to be at offset 0x10");
+_Static_assert(offsetof(cpu_local_t, userStack) == 0x18, "cpu_local_t.userStack has to be at offset 0x18");
+
 /*
  * Gets information of a cpu
  */
@@ -80,6 +88,7 @@ static void cpu_initInfo()
 	cpuInfo.aes = BIT_EXTRACT(cpuid_1.ecx, 25);
 	cpuInfo.rdrand = BIT_EXTRACT(cpuid_1.ecx, 30);
 	cpuInfo.xsave = BIT_EXTRACT(cpuid_1.ecx, 26);
+	cpuInfo.pcid = BIT_EXTRACT(cpuid_1.ecx, 17);
 
 	//Featureflags Teil 2
 	//RDMSR and WRMSR are supported because else we wouldn't be in long mode
@@ -92,6 +101,11 @@ static void cpu_initInfo()
 	cpuInfo.GlobalPage = BIT_EXTRACT(cpuid_1.edx, 13);
 	cpuInfo.HyperThreading = BIT_EXTRACT(cpuid_1.edx, 28);
 
+	//Kernelpages müssen global sein, damit sie in allen PCIDs gültig sind
+	cpuInfo.pcid = cpuInfo.pcid && cpuInfo.GlobalPage;
+	if(cpuInfo.maxstdCPUID >= 7)
+		cpuInfo.invpcid = cpuInfo.pcid && BIT_EXTRACT(cpu_cpuidSubleaf(7, 0).ebx, 10);
+
 	//Erweiterte Funktionen
 	cpuInfo.maxextCPUID = cpu_cpuid(0x80000000).eax;
 
@@ -99,6 +113,8 @@ static void cpu_initInfo()
 	cpuInfo.nx = cpuid_80000001.edx & (1 << 20);
 	cpuInfo.syscall = cpuid_80000001.edx & (1 << 11);
 	cpuInfo.page_size_1gb = cpuid_80000001.edx & (1 << 26);
+	if(cpuInfo.maxextCPUID >= 0x80000007)
+		cpuInfo.invariantTSC = cpu_cpuid(0x80000007).edx & (1 << 8);
 
 	//Namen des Prozessors
 	if(cpuInfo.maxextCPUID >= 0x80000003 && cpuInfo.Vendor == INTEL)
@@ -163,7 +179,11 @@ static void cpu_initInfo()
 void cpu_init(bool isBSP)
 {
 	if(isBSP)
+	{
 		cpu_initInfo();
+		cpuLocal[0].self = &cpuLocal[0];
+		cpuLocal[0].index = 0;
+	}
 
 	uint64_t cr0 = cpu_readControlRegister(CPU_CR0);
 	uint64_t cr4 = cpu_readControlRegister(CPU_CR4);
@@ -175,6 +195,9 @@ void cpu_init(bool isBSP)
 	cr0 = BIT_SET(cr0, 1);		//set CR0.MP
 	cr0 = BIT_CLEAR(cr0, 2);	//delete CR0.EM
 
+	//Write protection also applies to the kernel so that writes to copy-on-write pages fault
+	cr0 = BIT_SET(cr0, 16);		//set CR0.WP
+
 	cr4 = BIT_SET(cr4, 9);		//set CR4.OSFXSR
 	//TODO: support OSXMMEXCPT
 	//cr4 = BIT_SET(cr4, 10);	//set CR4.OSXMMEXCPT
@@ -187,6 +210,13 @@ void cpu_init(bool isBSP)
 	if(cpuInfo.GlobalPage)
 		cr4 = BIT_SET(cr4, 7);
 
+	//Activate process context identifiers. For this CR3[11:0] has to be 0.
+	if(cpuInfo.pcid)
+	{
+		cpu_writeControlRegister(CPU_CR3, cpu_readControlRegister(CPU_CR3) & ~0xFFFul);
+		cr4 = BIT_SET(cr4, 17);
+	}
+
 	cpu_writeControlRegister(CPU_CR0, cr0);
 	cpu_writeControlRegister(CPU_CR4, cr4);
 
@@ -10,6 +10,7 @@
 
 #include "stdint.h"
 #include "stdbool.h"
+#include "stddef.h"
 
 #define CPU_DISABLE_INTERRUPTS()	asm volatile("cli")
 #define CPU_ENABLE_INTERRUPTS()		asm volatile("sti")
@@ -17,6 +18,8 @@
 #define CPU_STOP()					asm volatile("cli;hlt"); __builtin_unreachable()
 #define CPU_PAUSE()					asm volatile("pause")
 
+#define CPU_MAX_COUNT	32		//Maximum number of cpus supported
+
 #define INTEL	200
 #define AMD		201
 #define UNKN	202
@@ -53,6 +56,9 @@ struct{
 		bool nx;
 		bool syscall;
 		bool xsave;				//XGETBV, XRSTOR, XSAVE, XSETBV
+		bool pcid;				//Process context identifiers (werden nur mit globalen Pages verwendet)
+		bool invpcid;			//INVPCID
+		bool invariantTSC;		//Der TSC läuft unabhängig vom Energiezustand mit konstanter Frequenz
 		uint32_t xsave_area_size;
 }cpuInfo;
 
@@ -60,8 +66,133 @@ typedef enum{
 	CPU_CR0, CPU_CR2, CPU_CR3, CPU_CR4, CPU_CR8, CPU_XCR0
 }cpu_control_register_t;
 
+/**
+ * \brief Data which every cpu has for its own.
+ *
+ * In the kernel the GS segment of every cpu points to its structure. The offsets of the first four fields are also
+ * used in interrupts.S and must not be changed.
+ */
+typedef struct cpu_local{
+	/**
+	 * Pointer to this structure
+	 */
+	struct cpu_local *self;
+
+	/**
+	 * Kernel stack of the current thread (rsp0 of the TSS), used by the syscall entry
+	 */
+	void *kernelStack;
+
+	/**
+	 * Cleared by the interrupt exit as soon as the stack of the previous thread is not used anymore
+	 */
+	volatile bool *releaseFlag;
+
+	/**
+	 * Userspace stack pointer, saved by the syscall entry until the kernel stack is set up
+	 */
+	void *userStack;
+
+	/**
+	 * Index of the cpu. The bootstrap processor has index 0.
+	 */
+	uint32_t index;
+
+	/**
+	 * ID of the local APIC of the cpu
+	 */
+	uint32_t apicId;
+
+	/**
+	 * Thread and process which are running on this cpu (see currentThread and currentProcess)
+	 */
+	struct thread *thread;
+	struct process_t *process;
+
+	/**
+	 * Thread which runs when there is nothing else to do for this cpu
+	 */
+	struct thread *idleThread;
+
+	/**
+	 * Thread whose FPU state is loaded in the registers of this cpu
+	 */
+	struct thread *fpuThread;
+
+	/**
+	 * Set once the cpu runs the scheduler
+	 */
+	volatile bool online;
+
+	/**
+	 * Address space which is loaded in CR3 of this cpu
+	 */
+	struct vmm_context *context;
+
+	/**
+	 * Set by another cpu which requests a TLB invalidation (see smp_invalidateTLB)
+	 */
+	volatile bool tlbFlush;
+
+	/**
+	 * Uptime at which the scheduler wants the next tick or 0 if the cpu runs its idle thread
+	 */
+	uint64_t nextTick;
+
+	/**
+	 * Uptime for which the one-shot timer of the local APIC is armed or 0 if it is stopped
+	 */
+	uint64_t timerDeadline;
+}cpu_local_t;
+
+extern cpu_local_t cpuLocal[CPU_MAX_COUNT];
+
+/**
+ * \brief Reads a field of the cpu_local_t structure of the current cpu.
+ *
+ * The field is read with a single instruction so the value belongs to the cpu the caller is running on even if the
+ * caller is migrated right afterwards.
+ */
+#define CPU_LOCAL_GET(field) ({																\
+	typeof(((cpu_local_t*)0)->field) ___value;												\
+	asm volatile("mov %%gs:%c1, %0": "=r"(___value): "i"(offsetof(cpu_local_t, field)));	\
+	___value;																				\
+})
+
+/**
+ * \brief Writes a field of the cpu_local_t structure of the current cpu.
+ */
+#define CPU_LOCAL_SET(field, value)																		\
+	asm volatile("mov %0, %%gs:%c1":: "r"((typeof(((cpu_local_t*)0)->field))(value)),						\
+			"i"(offsetof(cpu_local_t, field)): "memory")
+
 void cpu_init(bool isBSP);
 
+/**
+ * \brief Returns the cpu_local_t structure of the cpu the caller is running on
+ *
+ * The caller has to make sure that it is not migrated to another cpu while using the structure
+ * (e.g. by disabling interrupts).
+ *
+ * @return Data of the current cpu
+ */
+inline cpu_local_t *cpu_getLocal(void) {
+	return CPU_LOCAL_GET(self);
+}
+
+/**
+ * \brief Returns the index of the cpu the caller is running on
+ *
+ * The index is smaller than CPU_MAX_COUNT and can be used to access per cpu data.
+ * The caller has to make sure that it is not migrated to another cpu while using the index
+ * (e.g. by disabling interrupts).
+ *
+ * @return Index of the current cpu
+ */
+inline uint32_t cpu_getIndex(void) {
+	return CPU_LOCAL_GET(index);
+}
+
 inline cpu_cpuid_result_t cpu_cpuidSubleaf(uint32_t function, uint32_t subleaf) {
 	cpu_cpuid_result_t result;
 	asm volatile("cpuid": "=a"(result.eax), "=b"(result.ebx), "=c"(result.ecx), "=d"(result.edx): "a"(function), "c"(subleaf));
@@ -157,6 +288,40 @@ inline void cpu_MSRwrite(uint32_t msr, uint64_t val) {
 	asm volatile("wrmsr" : : "a" ((uint32_t)val), "c" (msr), "d" ((uint32_t)(val >> 32)));
 }
 
+/**
+ * \brief Reads the time stamp counter of the current cpu
+ *
+ * @return Value of the time stamp counter
+ */
+inline uint64_t cpu_readTSC(void) {
+	uint32_t lo, hi;
+	asm volatile("rdtsc": "=a"(lo), "=d"(hi));
+	return lo | ((uint64_t)hi << 32);
+}
+
+/**
+ * \brief Disables interrupts on the current cpu
+ *
+ * @return true if interrupts were enabled before the call
+ */
+inline bool cpu_disableInterrupts(void) {
+	uint64_t flags;
+	asm volatile("pushfq;"
+				"pop %0;"
+				"cli": "=r"(flags):: "memory");
+	return flags & (1 << 9);
+}
+
+/**
+ * \brief Restores the interrupt state saved by cpu_disableInterrupts
+ *
+ * @param enabled The value returned by cpu_disableInterrupts
+ */
+inline void cpu_restoreInterrupts(bool enabled) {
+	if(enabled)
+		asm volatile("sti":::"memory");
+}
+
 inline void cpu_saveXState(void *ptr)
 {
 	if(cpuInfo.xsave)
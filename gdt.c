@@ -7,55 +7,74 @@
 
 #include "gdt.h"
 #include "display.h"
+#include "assert.h"
 
-static uint64_t gdt[GDT_ENTRIES];
+//Jede CPU hat eine eigene GDT, da sich die TSS und das Segment für die Daten der CPU unterscheiden
+static uint64_t gdt[CPU_MAX_COUNT][GDT_ENTRIES];
 
-void GDT_Init()
+static void setEntry(uint64_t *table, int i, uint32_t base, uint32_t limit, uint8_t access, uint8_t flags)
 {
+	table[i] = limit & 0xFFFF;
+	table[i] |= (base & 0xFFFFFFLL) << 16;
+	table[i] |= (access & 0xFFLL) << 40;
+	table[i] |= ((limit >> 16) & 0xFLL) << 48;
+	table[i] |= (flags & 0xFLL) << 52;
+	table[i] |= ((base >> 24) & 0xFFLL) << 56;
+}
+
+/*
+ * Erstellt und lädt die GDT der CPU
+ * Parameter:	local = Daten der CPU, auf welche das Segment GDT_CPU_LOCAL_SELECTOR zeigt
+ */
+void GDT_Init(cpu_local_t *local)
+{
+	uint64_t *table = gdt[local->index];
 	gdtr_t gdtr;
-	GDT_SetEntry(0, 0, 0, 0, 0);				//NULL-Deskriptor
+	setEntry(table, 0, 0, 0, 0, 0);				//NULL-Deskriptor
 	//Ring 0
-	GDT_SetEntry(1, 0, 0xFFFFF, 0x9A, 0xA);	//Codesegment, ausführ- und lesbar, 64-bit, Ring 0
-	GDT_SetEntry(2, 0, 0xFFFFF, 0x92, 0xC);	//Datensegment, les- und schreibbar
+	setEntry(table, 1, 0, 0xFFFFF, 0x9A, 0xA);	//Codesegment, ausführ- und lesbar, 64-bit, Ring 0
+	setEntry(table, 2, 0, 0xFFFFF, 0x92, 0xC);	//Datensegment, les- und schreibbar
 	//Ring 3 (muss so sein sonst funktioniert sysret nicht)
-	GDT_SetEntry(3, 0, 0xFFFFF, 0xF2, 0xC);	//Datensegment, les- und schreibbar, Ring 3
-	GDT_SetEntry(4, 0, 0xFFFFF, 0xFA, 0xA);	//Codesegment, ausführ- und lesbar, 64-bit, Ring 3
+	setEntry(table, 3, 0, 0xFFFFF, 0xF2, 0xC);	//Datensegment, les- und schreibbar, Ring 3
+	setEntry(table, 4, 0, 0xFFFFF, 0xFA, 0xA);	//Codesegment, ausführ- und lesbar, 64-bit, Ring 3
+	//Die Basis ist nur 32-bit gross, die Daten der CPUs liegen aber im Kernel und damit unter 4GiB
+	assert((uintptr_t)local <= UINT32_MAX);
+	setEntry(table, GDT_CPU_LOCAL_SELECTOR >> 3, (uintptr_t)local, sizeof(cpu_local_t) - 1, 0x92, 0x4);
 
 	gdtr.limit = GDT_ENTRIES *8 - 1;
-	gdtr.pointer = gdt;
+	gdtr.pointer = table;
 	asm volatile("lgdt %0": :"m"(gdtr));
 	asm volatile(
-			"mov $0x10,%ax;"//Index für das Datensegment des Kernels
-			"mov %ax,%ds;"
-			"mov %ax,%es;"
-			"mov %ax,%ss;"
-			"mov %ax,%fs;"
-			"mov %ax,%gs;"
+			"mov $0x10,%%ax;"//Index für das Datensegment des Kernels
+			"mov %%ax,%%ds;"
+			"mov %%ax,%%es;"
+			"mov %%ax,%%ss;"
+			"mov %%ax,%%fs;"
+			"mov %0,%%ax;"
+			"mov %%ax,%%gs;"
 			"push $0x8;"	//Compiler akzeptiert keinen farjump also machen wir es auf diese
-			"push $(.1);"	//Art. So holt sich die CPU den Codesegmentindex vom Stack
+			"push $(1f);"	//Art. So holt sich die CPU den Codesegmentindex vom Stack
 			"lretq;"
-			".1:"
+			"1:"
+			: : "i"(GDT_CPU_LOCAL_SELECTOR) : "rax"
 	);
-	SysLog("GDT", "Initialisierung abgeschlossen");
+	if(local->index == 0)
+		SysLog("GDT", "Initialisierung abgeschlossen");
 }
 
 void GDT_SetEntry(int i, uint32_t base, uint32_t limit, uint8_t access, uint8_t flags)
 {
-	gdt[i] = limit & 0xFFFF;
-	gdt[i] |= (base & 0xFFFFFFLL) << 16;
-	gdt[i] |= (access & 0xFFLL) << 40;
-	gdt[i] |= ((limit >> 16) & 0xFLL) << 48;
-	gdt[i] |= (flags & 0xFLL) << 52;
-	gdt[i] |= ((base >> 24) & 0xFFLL) << 56;
+	setEntry(gdt[cpu_getIndex()], i, base, limit, access, flags);
 }
 
 void GDT_SetSystemDescriptor(int i, uint64_t base, uint32_t limit, uint8_t access, uint8_t flags)
 {
-	gdt[i] = limit & 0xFFFF;
-	gdt[i] |= (base & 0xFFFFFFLL) << 16;
-	gdt[i] |= (access & 0xFFLL) << 40;
-	gdt[i] |= ((limit >> 16) & 0xFLL) << 48;
-	gdt[i] |= (flags & 0xFLL) << 52;
-	gdt[i + 1] = base >> 24;
-	gdt[i + 1] |= 0ul << 32;
+	uint64_t *table = gdt[cpu_getIndex()];
+	table[i] = limit & 0xFFFF;
+	table[i] |= (base & 0xFFFFFFLL) << 16;
+	table[i] |= (access & 0xFFLL) << 40;
+	table[i] |= ((limit >> 16) & 0xFLL) << 48;
+	table[i] |= (flags & 0xFLL) << 52;
+	table[i + 1] = base >> 24;
+	table[i + 1] |= 0ul << 32;
 }
@@ -8,9 +8,12 @@
 #ifndef GDT_H_
 #define GDT_H_
 
-#define GDT_ENTRIES	7
+#define GDT_ENTRIES	8
+
+#define GDT_CPU_LOCAL_SELECTOR	0x38	//Datensegment, dessen Basis auf die Daten der CPU zeigt (cpu_local_t)
 
 #include "stdint.h"
+#include "cpu.h"
 
 typedef struct{
 		uint16_t	limit;
@@ -36,7 +39,7 @@ typedef struct{
 
 
 //Funktionen
-void GDT_Init(void);
+void GDT_Init(cpu_local_t *local);
 void GDT_SetEntry(int i, uint32_t base, uint32_t limit, uint8_t access, uint8_t flags);
 void GDT_SetSystemDescriptor(int i, uint64_t base, uint32_t limit, uint8_t access, uint8_t flags);
 
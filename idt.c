@@ -8,9 +8,12 @@
 #include "idt.h"
 #include "tss.h"
 #include "display.h"
+#include "cpu.h"
 
 static uint128_t idt[IDT_ENTRIES];	//Jeder Eintrag ist 16-Byte (128-Bit) gross
-static uint8_t page_fault_stack[4096] __attribute__((aligned(4096)));
+//Die IDT wird von allen CPUs geteilt, die Stacks für die Interrupts mit eigenem Stack braucht jede CPU für sich
+static uint8_t double_fault_stack[CPU_MAX_COUNT][4096] __attribute__((aligned(4096)));
+static uint8_t nmi_stack[CPU_MAX_COUNT][4096] __attribute__((aligned(4096)));
 
 //Exception Handler
 extern int0;
@@ -49,28 +52,32 @@ extern int44;
 extern int45;
 extern int46;
 extern int47;
+extern int64;
+extern int65;
+extern int66;
 //Syscalls
 extern int255;
 void IDT_Init(void)
 {
-	idtr_t idtr;
-
 	//Exceptions
 	IDT_SetEntry(0, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_KERNEL | IDT_PRESENT, (uintptr_t)&int0);
 	IDT_SetEntry(1, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_KERNEL | IDT_PRESENT, (uintptr_t)&int1);
-	IDT_SetEntry(2, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_KERNEL | IDT_PRESENT, (uintptr_t)&int2);
+	//Ein NMI kann auch direkt nach einem syscall kommen, wenn noch der Userspace-Stack aktiv ist
+	IDT_SetEntry(2, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_KERNEL | IDT_PRESENT | IDT_IST_2, (uintptr_t)&int2);
 	IDT_SetEntry(3, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_KERNEL | IDT_PRESENT, (uintptr_t)&int3);
 	IDT_SetEntry(4, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_KERNEL | IDT_PRESENT, (uintptr_t)&int4);
 	IDT_SetEntry(5, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_KERNEL | IDT_PRESENT, (uintptr_t)&int5);
 	IDT_SetEntry(6, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_KERNEL | IDT_PRESENT, (uintptr_t)&int6);
 	IDT_SetEntry(7, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_KERNEL | IDT_PRESENT, (uintptr_t)&int7);
-	IDT_SetEntry(8, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_KERNEL | IDT_PRESENT, (uintptr_t)&int8);
+	//Bei einem Überlauf des Kernelstacks kann der Page Fault nicht auf den Stack geschrieben werden
+	IDT_SetEntry(8, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_KERNEL | IDT_PRESENT | IDT_IST_1, (uintptr_t)&int8);
 	IDT_SetEntry(9, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_KERNEL | IDT_PRESENT, (uintptr_t)&int9);
 	IDT_SetEntry(10, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_KERNEL | IDT_PRESENT, (uintptr_t)&int10);
 	IDT_SetEntry(11, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_KERNEL | IDT_PRESENT, (uintptr_t)&int11);
 	IDT_SetEntry(12, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_KERNEL | IDT_PRESENT, (uintptr_t)&int12);
 	IDT_SetEntry(13, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_KERNEL | IDT_PRESENT, (uintptr_t)&int13);
-	IDT_SetEntry(14, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_KERNEL | IDT_PRESENT | IDT_IST_1, (uintptr_t)&int14);
+	//Der Page Fault Handler kann beim Laden aus einer Datei unterbrochen werden und braucht deshalb den Stack des Threads
+	IDT_SetEntry(14, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_KERNEL | IDT_PRESENT, (uintptr_t)&int14);
 	IDT_SetEntry(16, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_KERNEL | IDT_PRESENT, (uintptr_t)&int16);
 	IDT_SetEntry(17, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_KERNEL | IDT_PRESENT, (uintptr_t)&int17);
 	IDT_SetEntry(18, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_KERNEL | IDT_PRESENT, (uintptr_t)&int18);
@@ -94,15 +101,32 @@ void IDT_Init(void)
 	IDT_SetEntry(46, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_KERNEL | IDT_PRESENT, (uintptr_t)&int46);
 	IDT_SetEntry(47, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_KERNEL | IDT_PRESENT, (uintptr_t)&int47);
 
+	//Timer des Local APICs und Interprozessorinterrupts
+	IDT_SetEntry(64, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_KERNEL | IDT_PRESENT, (uintptr_t)&int64);
+	IDT_SetEntry(65, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_KERNEL | IDT_PRESENT, (uintptr_t)&int65);
+	IDT_SetEntry(66, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_KERNEL | IDT_PRESENT, (uintptr_t)&int66);
+
 	//Syscall
 	IDT_SetEntry(255, 0x8, IDT_TYPE_INTERRUPT | IDT_DPL_USER | IDT_PRESENT, (uintptr_t)&int255);
 
-	TSS_setIST(1, page_fault_stack + 4096);
+	IDT_Load();
+	SysLog("IDT", "Initialisierung abgeschlossen");
+}
+
+/*
+ * Lädt die IDT auf der aktuellen CPU und setzt deren Stacks für Interrupts mit eigenem Stack
+ */
+void IDT_Load(void)
+{
+	idtr_t idtr;
+	uint32_t cpu = cpu_getIndex();
+
+	TSS_setIST(1, double_fault_stack[cpu] + 4096);
+	TSS_setIST(2, nmi_stack[cpu] + 4096);
 
 	idtr.limit = sizeof(idt) - 1;
 	idtr.pointer = idt;
 	asm volatile("lidt %0" : :"m"(idtr));
-	SysLog("IDT", "Initialisierung abgeschlossen");
 }
 
 /*
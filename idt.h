@@ -22,6 +22,7 @@
 #define IDT_PRESENT			0x8000
 
 #define IDT_IST_1		1
+#define IDT_IST_2		2
 
 typedef struct{
 		uint16_t	limit;
@@ -30,6 +31,7 @@ typedef struct{
 
 //Funktionen
 void IDT_Init(void);
+void IDT_Load(void);
 void IDT_SetEntry(uint8_t i, uint16_t Selector, uint16_t Flags, uintptr_t Offset);
 
 #endif /* IDT_H_ */
@@ -45,6 +45,9 @@ typedef struct{
 	uint64_t	physSpeicher;
 	uint64_t	physFree;
 	uint64_t	Uptime;
+	uint64_t	sharedImageMemory;	//Speicher, der durch geteilte Segmente von Programmen gespart wird
+	uint64_t	pageTableMemory;	//Speicher für die Page Tables des aufrufenden Prozesses
+	uint64_t	totalPageTableMemory;	//Speicher für alle Page Tables
 }SIS;
 
 #endif /* BITS_SYS_TYPES_H_ */
@@ -12,12 +12,20 @@ enum{
 SYSCALL_ALLOC_PAGES		= 0,
 SYSCALL_FREE_PAGES		= 1,
 SYSCALL_UNUSE_PAGES		= 2,
+SYSCALL_MMAP			= 3,
+SYSCALL_MUNMAP			= 4,
+SYSCALL_MPROTECT		= 5,
+SYSCALL_MSYNC			= 6,
 
 SYSCALL_EXEC			= 10,
 SYSCALL_EXIT			= 11,
 SYSCALL_WAIT			= 12,
 SYSCALL_THREAD_CREATE	= 13,
 SYSCALL_THREAD_EXIT		= 14,
+SYSCALL_FORK			= 15,
+SYSCALL_NICE			= 16,
+SYSCALL_GET_PRIORITY	= 17,
+SYSCALL_SET_PRIORITY	= 18,
 
 SYSCALL_GET_TIMESTAMP	= 30,
 SYSCALL_SLEEP			= 31,
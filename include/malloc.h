@@ -0,0 +1,62 @@
+/*
+ * malloc.h
+ *
+ *  Created on: 17.10.2026
+ *      Author: pascal
+ */
+
+#ifndef MALLOC_H_
+#define MALLOC_H_
+
+#include "stddef.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//Parameter für mallopt
+#define M_TRIM_THRESHOLD	-1		//Ungenutzte Bytes im Heap, ab welchen freie Pages zurückgegeben werden
+
+/**
+ * \brief Usage statistics of the heap
+ */
+struct mallinfo{
+	size_t arena;		//Bytes obtained from the system
+	size_t ordblks;		//Number of free blocks
+	size_t uordblks;	//Bytes in allocated blocks including the block headers
+	size_t fordblks;	//Bytes in free blocks
+	size_t keepcost;	//Bytes in unused pages which were not returned to the system yet
+};
+
+/**
+ * \brief Returns unused pages of the heap to the system.
+ *
+ * @param pad Number of bytes in unused pages which are kept
+ * @return 1 if pages were released, 0 otherwise
+ */
+extern int malloc_trim(size_t pad);
+
+/**
+ * \brief Changes a parameter of the heap.
+ *
+ * @param param Parameter to change (M_TRIM_THRESHOLD)
+ * @param value New value of the parameter
+ * @return 1 on success, 0 if the parameter or value is invalid
+ */
+extern int mallopt(int param, int value);
+
+/**
+ * \brief Returns the usage statistics of the heap.
+ *
+ * The counters are read without locking the heap so the values can be slightly inconsistent while other threads
+ * allocate memory.
+ *
+ * @return The statistics
+ */
+extern struct mallinfo mallinfo(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MALLOC_H_ */
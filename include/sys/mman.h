@@ -0,0 +1,87 @@
+/*
+ * mman.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: pascal
+ */
+
+#ifndef SYS_MMAN_H_
+#define SYS_MMAN_H_
+
+#include <sys/types.h>
+
+//Zugriffsrechte
+#define PROT_NONE		0x0		//Page cannot be accessed.
+#define PROT_READ		0x1		//Page can be read.
+#define PROT_WRITE		0x2		//Page can be written.
+#define PROT_EXEC		0x4		//Page can be executed.
+
+//Flags für mmap
+#define MAP_PRIVATE		0x1		//Changes are private.
+#define MAP_FIXED		0x2		//Interpret addr exactly.
+#define MAP_ANONYMOUS	0x4		//Map memory which is not backed by a file.
+#define MAP_ANON		MAP_ANONYMOUS
+#define MAP_POPULATE	0x8		//Allocate the physical memory immediately.
+#define MAP_SHARED		0x10	//Changes are written back to the file.
+
+//Flags für msync
+#define MS_ASYNC		0x1		//Perform asynchronous writes.
+#define MS_SYNC			0x2		//Perform synchronous writes.
+#define MS_INVALIDATE	0x4		//Invalidate mappings.
+
+#define MAP_FAILED		((void*)-1)
+
+#ifndef BUILD_KERNEL
+/**
+ * \brief Maps a memory area into the address space.
+ *
+ * Anonymous mappings (MAP_ANONYMOUS) are zeroed. The physical memory is allocated on the first access of each page
+ * unless MAP_POPULATE is given. An area mapped with PROT_NONE only reserves the address range, its pages can be
+ * committed later with mprotect.
+ * Files are mapped through the page cache of the file and loaded on the first access. Changes of a MAP_SHARED mapping
+ * are visible to all mappings and reads of the file and are written back by msync and munmap, changes of a
+ * MAP_PRIVATE mapping are copied on the first write.
+ *
+ * @param addr Address of the mapping (only a hint without MAP_FIXED) or NULL
+ * @param len Size of the mapping in bytes
+ * @param prot Access rights (PROT_*)
+ * @param flags MAP_* flags
+ * @param fildes Stream of the file (ignored with MAP_ANONYMOUS)
+ * @param off Page aligned offset in the file
+ * @return Address of the mapping or MAP_FAILED
+ */
+void *mmap(void *addr, size_t len, int prot, int flags, int fildes, off_t off);
+
+/**
+ * \brief Removes the mappings of a memory area.
+ *
+ * @param addr Page aligned address of the area
+ * @param len Size of the area in bytes
+ * @return 0 on success, -1 otherwise
+ */
+int munmap(void *addr, size_t len);
+
+/**
+ * \brief Writes the changes of shared file mappings in a memory area back to the files.
+ *
+ * The changes are always written synchronously.
+ *
+ * @param addr Page aligned address of the area
+ * @param len Size of the area in bytes
+ * @param flags MS_* flags
+ * @return 0 on success, -1 otherwise
+ */
+int msync(void *addr, size_t len, int flags);
+
+/**
+ * \brief Changes the access rights of a mapped memory area.
+ *
+ * @param addr Page aligned address of the area
+ * @param len Size of the area in bytes
+ * @param prot New access rights (PROT_*)
+ * @return 0 on success, -1 if the area is not mapped completely
+ */
+int mprotect(void *addr, size_t len, int prot);
+#endif
+
+#endif /* SYS_MMAN_H_ */
@@ -0,0 +1,44 @@
+/*
+ * resource.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: pascal
+ */
+
+#ifndef SYS_RESOURCE_H_
+#define SYS_RESOURCE_H_
+
+#include <sys/types.h>
+
+//Werte für which von getpriority und setpriority
+#define PRIO_PROCESS	0		//Identifies the who argument as a process ID.
+#define PRIO_PGRP		1		//Identifies the who argument as a process group ID.
+#define PRIO_USER		2		//Identifies the who argument as a user ID.
+
+#ifndef BUILD_KERNEL
+/**
+ * \brief Returns the nice value of a process.
+ *
+ * Only PRIO_PROCESS is supported.
+ *
+ * @param which PRIO_PROCESS
+ * @param who Process ID or 0 for the calling process
+ * @return Nice value of the process (-20 to 19) or -1 with errno set
+ */
+int getpriority(int which, id_t who);
+
+/**
+ * \brief Sets the nice value of a process.
+ *
+ * The value is clamped to the range from -20 to 19. Lower values give the threads of the process a higher priority
+ * and longer time slices. Only PRIO_PROCESS is supported.
+ *
+ * @param which PRIO_PROCESS
+ * @param who Process ID or 0 for the calling process
+ * @param value New nice value
+ * @return 0 on success, -1 otherwise
+ */
+int setpriority(int which, id_t who, int value);
+#endif
+
+#endif /* SYS_RESOURCE_H_ */
@@ -18,10 +18,18 @@
 void *syscall_allocPages(size_t Pages);
 void syscall_freePages(void *Address, size_t Pages);
 void syscall_unusePages(void *Address, size_t Pages);
+void *syscall_mmap(void *address, size_t length, int prot, int flags, uint64_t stream, uint64_t offset);
+int syscall_munmap(void *address, size_t length);
+int syscall_msync(void *address, size_t length);
+int syscall_mprotect(void *address, size_t length, int prot);
 
 pid_t syscall_createProcess(const char *path, const char *cmd, const char **env, const char *stdin, const char *stdout, const char *stderr);
 void syscall_exit(int status);
 pid_t syscall_wait(pid_t pid, int *status);
+pid_t syscall_fork(void);
+int syscall_nice(int incr);
+int syscall_getPriority(int which, pid_t who, int *value);
+int syscall_setPriority(int which, pid_t who, int value);
 tid_t syscall_createThread(void *entry, void *arg);
 void syscall_exitThread(int status);
 
@@ -35,5 +35,9 @@
 #define STDOUT_FILENO	1	//File number of stdout.
 
 unsigned sleep(unsigned seconds);
+#ifndef BUILD_KERNEL
+pid_t fork(void);
+int nice(int incr);
+#endif
 
 #endif /* UNISTD_H_ */
@@ -20,6 +20,8 @@
 #include "cpu.h"
 #include "system.h"
 #include "scheduler.h"
+#include "apic.h"
+#include "smp.h"
 #include <dispatcher.h>
 
 typedef struct{
@@ -34,9 +36,11 @@ typedef struct{
 
 extern void keyboard_Handler(ihs_t *ihs);
 extern void cdi_irq_handler(uint8_t irq);
-extern void pit_Handler(void);
 
 static ihs_t *irq_handler(ihs_t *ihs);
+static ihs_t *apic_timer_handler(ihs_t *ihs);
+static ihs_t *reschedule_handler(ihs_t *ihs);
+static ihs_t *tlb_handler(ihs_t *ihs);
 static ihs_t *exception_DivideByZero(ihs_t *ihs);
 static ihs_t *exception_Debug(ihs_t *ihs);
 static ihs_t *exception_NonMaskableInterrupt(ihs_t *ihs);
@@ -60,9 +64,6 @@ static ihs_t *nop(ihs_t *ihs);
 
 static irqHandlers *Handlers[NUM_IRQ];
 
-thread_t *fpuThread = NULL;
-extern thread_t *currentThread;
-
 static interrupt_handler interrupt_handlers[NUM_INTERRUPTS] = {
 /* 0*/			exception_DivideByZero,
 /* 1*/			exception_Debug,
@@ -84,6 +85,9 @@ static interrupt_handler interrupt_handlers[NUM_INTERRUPTS] = {
 [18]			exception_MachineCheck,
 [19]			exception_XF,
 [32 ... 47]		irq_handler,
+[64]			apic_timer_handler,
+[65]			reschedule_handler,
+[66]			tlb_handler,
 [255]			scheduler_schedule
 };
 
@@ -127,7 +131,11 @@ interrupt_handler isr_setHandler(uint8_t num, interrupt_handler handler)
 ihs_t *isr_Handler(ihs_t *ihs)
 {
 	Counter++;
-	return dispatcher_dispatch(interrupt_handlers[ihs->interrupt](ihs));
+	ihs_t *new_ihs = interrupt_handlers[ihs->interrupt](ihs);
+	//Ein NMI kann den Kernel an jeder Stelle unterbrechen, deshalb darf dabei keine andere Arbeit erledigt werden
+	if(ihs->interrupt == 2)
+		return new_ihs;
+	return dispatcher_dispatch(new_ihs);
 }
 
 static ihs_t *irq_handler(ihs_t *ihs)
@@ -139,13 +147,9 @@ static ihs_t *irq_handler(ihs_t *ihs)
 	{
 		case 32:
 		{
-			static uint64_t nextSchedule = 50;
 			pit_Handler();
-			if(Uptime == nextSchedule)
-			{
-				new_ihs = scheduler_schedule(ihs);
-				nextSchedule += 50;				//Alle 50ms wird der Task gewechselt
-			}
+			if(pit_getUptime() % SCHEDULER_TICK == 0)
+				new_ihs = scheduler_tick(ihs);
 		}
 		break;
 		case 33:
@@ -159,6 +163,38 @@ static ihs_t *irq_handler(ihs_t *ihs)
 	return new_ihs;
 }
 
+/*
+ * One-Shot-Timer des Local APICs. Wird auf den Application Processors und ohne periodischen PIT auch auf dem BSP für das
+ * Scheduling und die Timer benutzt.
+ */
+static ihs_t *apic_timer_handler(ihs_t *ihs)
+{
+	apic_eoi();
+	return pit_apicTimerHandler(ihs);
+}
+
+/*
+ * Eine andere CPU hat Arbeit für diese CPU oder den ersten Timer geändert
+ */
+static ihs_t *reschedule_handler(ihs_t *ihs)
+{
+	apic_eoi();
+	if(currentThread == CPU_LOCAL_GET(idleThread))
+		ihs = scheduler_schedule(ihs);
+	pit_armLocalTimer();
+	return ihs;
+}
+
+/*
+ * Eine andere CPU hat Page Tables verändert, welche diese CPU benutzt
+ */
+static ihs_t *tlb_handler(ihs_t *ihs)
+{
+	smp_handleTLBRequest();
+	apic_eoi();
+	return ihs;
+}
+
 //Divide by Zero
 static ihs_t *exception_DivideByZero(ihs_t *ihs)
 {
@@ -174,6 +210,7 @@ static ihs_t *exception_Debug(ihs_t *ihs)
 //non maskable interrupt
 static ihs_t *exception_NonMaskableInterrupt(ihs_t *ihs)
 {
+	smp_handleNMI();
 	return ihs;
 }
 
@@ -213,10 +250,12 @@ static ihs_t *exception_DeviceNotAvailable(ihs_t *ihs)
 	//Reset TS-Flag
 	asm volatile("clts");
 
+	thread_t *fpuThread = CPU_LOCAL_GET(fpuThread);
 	if(fpuThread != NULL)
 		cpu_saveXState(fpuThread->fpuState);
 
 	fpuThread = currentThread;
+	CPU_LOCAL_SET(fpuThread, fpuThread);
 
 	cpu_restoreXState(fpuThread->fpuState);
 
@@ -285,8 +324,8 @@ static ihs_t *exception_PageFault(ihs_t *ihs)
 {
 	void *address = (void*)cpu_readControlRegister(CPU_CR2);
 
-	//Try to handle page fault else panic
-	int status = vmm_handlePageFault((currentProcess ?: &kernel_process)->Context, address, ihs->error);
+	//Try to handle page fault else panic. Pages of files are loaded with interrupts enabled if the interrupted code had them enabled.
+	int status = vmm_handlePageFault((currentProcess ?: &kernel_process)->Context, address, ihs->error, ihs->rflags & (1 << 9));
 	if (status != 0) {
 #ifndef DEBUGMODE
 		bool present = ihs->error & 1;
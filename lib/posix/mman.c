@@ -0,0 +1,79 @@
+/*
+ * mman.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: pascal
+ */
+
+#ifndef BUILD_KERNEL
+
+#include <sys/mman.h>
+#include "syscall.h"
+#include "errno.h"
+
+#define PAGE_SIZE	4096
+
+void *mmap(void *addr, size_t len, int prot, int flags, int fildes, off_t off)
+{
+	if(len == 0 || ((size_t)addr & (PAGE_SIZE - 1)) || (!(flags & MAP_ANONYMOUS) && (fildes < 0 || (off & (PAGE_SIZE - 1))))
+			|| ((flags & MAP_SHARED) && (flags & MAP_PRIVATE)))
+	{
+		errno = EINVAL;
+		return MAP_FAILED;
+	}
+
+	void *address = syscall_mmap(addr, len, prot, flags, (flags & MAP_ANONYMOUS) ? 0 : fildes, (flags & MAP_ANONYMOUS) ? 0 : off);
+	if(address == NULL)
+	{
+		errno = ENOMEM;
+		return MAP_FAILED;
+	}
+	return address;
+}
+
+int munmap(void *addr, size_t len)
+{
+	if(len == 0 || ((size_t)addr & (PAGE_SIZE - 1)))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if(syscall_munmap(addr, len) != 0)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	return 0;
+}
+
+int msync(void *addr, size_t len, int flags)
+{
+	if(((size_t)addr & (PAGE_SIZE - 1)) || ((flags & MS_ASYNC) && (flags & MS_SYNC)))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if(syscall_msync(addr, len) != 0)
+	{
+		errno = ENOMEM;
+		return -1;
+	}
+	return 0;
+}
+
+int mprotect(void *addr, size_t len, int prot)
+{
+	if(((size_t)addr & (PAGE_SIZE - 1)))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if(syscall_mprotect(addr, len, prot) != 0)
+	{
+		errno = ENOMEM;
+		return -1;
+	}
+	return 0;
+}
+
+#endif
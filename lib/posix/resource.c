@@ -0,0 +1,45 @@
+/*
+ * resource.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: pascal
+ */
+
+#ifndef BUILD_KERNEL
+
+#include <sys/resource.h>
+#include "syscall.h"
+#include "errno.h"
+
+int getpriority(int which, id_t who)
+{
+	if(which != PRIO_PROCESS)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	int value;
+	if(syscall_getPriority(which, who, &value) != 0)
+	{
+		errno = ESRCH;
+		return -1;
+	}
+	return value;
+}
+
+int setpriority(int which, id_t who, int value)
+{
+	if(which != PRIO_PROCESS)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if(syscall_setPriority(which, who, value) != 0)
+	{
+		errno = ESRCH;
+		return -1;
+	}
+	return 0;
+}
+
+#endif
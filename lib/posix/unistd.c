@@ -21,3 +21,15 @@ unsigned sleep(unsigned seconds)
 #endif
 	return 0;
 }
+
+#ifndef BUILD_KERNEL
+pid_t fork(void)
+{
+	return syscall_fork();
+}
+
+int nice(int incr)
+{
+	return syscall_nice(incr);
+}
+#endif
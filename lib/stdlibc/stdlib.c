@@ -13,6 +13,8 @@
 #include "math.h"
 #include "assert.h"
 #include "userlib.h"
+#include "lock.h"
+#include "malloc.h"
 #ifdef BUILD_KERNEL
 #include "mm.h"
 #include "cpu.h"
@@ -22,10 +24,31 @@
 #endif
 
 #define HEAP_RESERVED	0x01
+#define HEAP_CACHED		0x04		//Reservierter Block liegt in einem CPU-Cache
+#define HEAP_TRIMMING	0x10		//Die Pages des freien Blocks werden gerade zurückgegeben
 #define HEAP_FLAGS		0xAA
 #define HEAP_ALIGNMENT	16
 
+#ifdef BUILD_KERNEL
+//Caches per cpu for small blocks so that the common path does not need the heap lock
+#define HEAP_CACHE_MAX_SIZE		256
+#define HEAP_CACHE_DEPTH		16
+#define HEAP_CACHE_CLASSES		(HEAP_CACHE_MAX_SIZE / HEAP_ALIGNMENT)
+#define HEAP_CACHE_CLASS(size)	((size) / HEAP_ALIGNMENT - 1)
+#endif
+
+//Freie Blöcke bis zu dieser Grösse werden nach Grösse getrennt in Listen verwaltet statt im Baum
+#define HEAP_SMALL_MAX_SIZE		512
+#define HEAP_SMALL_CLASSES		(HEAP_SMALL_MAX_SIZE / HEAP_ALIGNMENT)
+#define HEAP_SMALL_CLASS(size)	((size) / HEAP_ALIGNMENT - 1)
+
+//Freie Pages werden erst zurückgegeben, wenn mehr als so viele Bytes ungenutzt im Heap liegen
+#define HEAP_TRIM_THRESHOLD		(1024 * 1024)
+//So viele Blöcke werden auf einmal aus dem Heap genommen, um ihre Pages zurückzugeben
+#define HEAP_TRIM_BATCH			16
+
 #define MAX(a, b) ((a > b) ? a : b)
+#define MIN(a, b) ((a < b) ? a : b)
 
 typedef struct{
 		void *Prev;
@@ -35,6 +58,7 @@ typedef struct{
 							//(Flags): Alle ungeraden Bits 1 und alle geraden 0
 		int8_t balance;		//Höhe rechts - Höhe links
 		bool is_list_mbr;		//Gibt an, dass der Knoten eindeutig ist
+		uint32_t residentPages;	//Freie Blöcke im Baum: zurückgebbare Pages, welche noch nicht zurückgegeben wurden
 }heap_t;
 
 typedef struct{
@@ -58,10 +82,31 @@ typedef struct{
 	void *next;
 }atexit_list_t;
 
+#ifdef BUILD_KERNEL
+typedef struct{
+	heap_t *blocks[HEAP_CACHE_CLASSES][HEAP_CACHE_DEPTH];
+	uint8_t count[HEAP_CACHE_CLASSES];
+}heap_cache_t;
+#endif
+
 atexit_list_t *Atexit_List_Base = NULL;
 
+//Der Heap wird durch heap_lock geschützt
 static heap_t *lastHeap = NULL;
 static heap_empty_t *base_emptyHeap = NULL;
+static heap_empty_t *smallHeaps[HEAP_SMALL_CLASSES];
+static uint32_t smallHeapsMap;		//Bit gesetzt, wenn die Liste der Klasse nicht leer ist
+static size_t residentFreePages;	//Pages in freien Blöcken, welche noch nicht zurückgegeben wurden
+static size_t arenaSize;			//Bytes, die vom System bezogen wurden
+static size_t freeBlocks, freeBytes;	//Anzahl und Grösse der freien Blöcke
+static size_t trimThreshold = HEAP_TRIM_THRESHOLD;
+static lock_t heap_lock = LOCK_INIT;
+#ifdef BUILD_KERNEL
+static heap_cache_t heap_caches[CPU_MAX_COUNT];
+#ifdef DEBUGMODE
+size_t heap_releaseCalls;			//Aufrufe von vmm_unusePages, wird von mm_heapBenchmark gelesen
+#endif
+#endif
 static char **real_environ;
 
 //Global visible
@@ -745,6 +790,144 @@ static void remove_empty_heap(heap_empty_t *node, bool with_list)
 	}
 }
 
+/*
+ * Berechnet die Pages eines freien Blocks, welche zurückgegeben werden können. Der Header mit der Erweiterung für
+ * den Baum und die Page des nächsten Blocks müssen erhalten bleiben.
+ * Parameter:	heap = freier Block
+ * 				start = erhält die Adresse der ersten Page
+ * Rückgabe:	Anzahl Pages
+ */
+static size_t heap_getReleasablePages(const heap_t *heap, uintptr_t *start)
+{
+	uintptr_t bottom = ((uintptr_t)heap + sizeof(heap_empty_t) + 0xFFF) & ~0xFFF;
+	uintptr_t top = ((uintptr_t)heap + heap->Length + sizeof(heap_t)) & ~0xFFF;
+	*start = bottom;
+	return (top > bottom) ? (top - bottom) / 4096 : 0;
+}
+
+/*
+ * Berechnet, wie viele der zurückgebbaren Pages eines freien Blocks schon zurückgegeben wurden
+ */
+static size_t heap_getReleasedPages(const heap_t *heap)
+{
+	uintptr_t start;
+	if(heap->Length <= HEAP_SMALL_MAX_SIZE)
+		return 0;
+	return heap_getReleasablePages(heap, &start) - heap->residentPages;
+}
+
+/*
+ * Trägt einen freien Block in die Liste seiner Grösse oder in den AVL-Baum ein. Bei Blöcken für den Baum muss
+ * residentPages gesetzt sein.
+ */
+static void heap_freeBlockAdd(heap_empty_t *node)
+{
+	freeBlocks++;
+	freeBytes += node->heap_base.Length;
+	if(node->heap_base.Length > HEAP_SMALL_MAX_SIZE)
+	{
+		residentFreePages += node->heap_base.residentPages;
+		add_empty_heap(node);
+		return;
+	}
+
+	size_t class = HEAP_SMALL_CLASS(node->heap_base.Length);
+	node->prev = NULL;
+	node->next = smallHeaps[class];
+	if(node->next != NULL)
+		((heap_empty_t*)node->next)->prev = node;
+	smallHeaps[class] = node;
+	smallHeapsMap |= 1u << class;
+}
+
+/*
+ * Entfernt einen freien Block aus der Liste seiner Grösse oder aus dem AVL-Baum
+ */
+static void heap_freeBlockRemove(heap_empty_t *node)
+{
+	freeBlocks--;
+	freeBytes -= node->heap_base.Length;
+	if(node->heap_base.Length > HEAP_SMALL_MAX_SIZE)
+	{
+		residentFreePages -= node->heap_base.residentPages;
+		remove_empty_heap(node, false);
+		return;
+	}
+
+	size_t class = HEAP_SMALL_CLASS(node->heap_base.Length);
+	if(node->prev != NULL)
+		((heap_empty_t*)node->prev)->next = node->next;
+	else
+		smallHeaps[class] = node->next;
+	if(node->next != NULL)
+		((heap_empty_t*)node->next)->prev = node->prev;
+	if(smallHeaps[class] == NULL)
+		smallHeapsMap &= ~(1u << class);
+}
+
+/*
+ * Sucht den kleinsten freien Block, der mindestens size Bytes gross ist. Kleine Grössen werden zuerst in den
+ * Listen gesucht, erst wenn dort kein Block passt wird der Baum durchsucht.
+ */
+static heap_empty_t *heap_freeBlockSearch(size_t size)
+{
+	if(size <= HEAP_SMALL_MAX_SIZE)
+	{
+		uint32_t map = smallHeapsMap & (~0u << HEAP_SMALL_CLASS(size));
+		if(map != 0)
+			return smallHeaps[__builtin_ctz(map)];
+	}
+	return search_empty_heap(size);
+}
+
+/*
+ * Gibt die Pages eines freien Blocks zurück. Der Heap darf dabei nicht gelockt sein.
+ */
+static void heap_releasePages(heap_t *heap)
+{
+	uintptr_t start;
+	size_t pages = heap_getReleasablePages(heap, &start);
+	if(pages > 0)
+	{
+#ifdef BUILD_KERNEL
+		extern context_t kernel_context;
+		vmm_unusePages(&kernel_context, (void*)start, pages);
+#ifdef DEBUGMODE
+		__sync_fetch_and_add(&heap_releaseCalls, 1);
+#endif
+#else
+		syscall_unusePages((void*)start, pages);
+#endif
+	}
+}
+
+/*
+ * Sucht in einem Teilbaum die Blöcke, deren Pages zurückgegeben werden sollen, beginnend bei den grössten Blöcken.
+ * Der Heap muss gelockt sein.
+ * Parameter:	blocks = erhält höchstens HEAP_TRIM_BATCH Blöcke
+ * 				count = Anzahl der gefundenen Blöcke
+ * 				pages = Summe der noch nicht zurückgegebenen Pages der gefundenen Blöcke
+ * Rückgabe:	true = die Suche ist beendet
+ */
+static bool heap_trimCollect(heap_empty_t *node, size_t pad, heap_t **blocks, size_t *count, size_t *pages)
+{
+	if(node == NULL)
+		return false;
+	if(heap_trimCollect(node->bigger, pad, blocks, count, pages))
+		return true;
+	for(heap_empty_t *entry = node; entry != NULL; entry = (entry == node) ? node->list : entry->next)
+	{
+		if((residentFreePages - *pages) * 4096 <= pad || *count >= HEAP_TRIM_BATCH)
+			return true;
+		if(entry->heap_base.residentPages > 0)
+		{
+			blocks[(*count)++] = &entry->heap_base;
+			*pages += entry->heap_base.residentPages;
+		}
+	}
+	return heap_trimCollect(node->smaller, pad, blocks, count, pages);
+}
+
 static void setupNewHeapEntry(heap_t *old, heap_t *new)
 {
 	new->Prev = old;
@@ -755,111 +938,207 @@ static void setupNewHeapEntry(heap_t *old, heap_t *new)
 	new->Flags = HEAP_FLAGS;
 }
 
-void *calloc(size_t nitems, size_t size)
+static void heap_lockAcquire(lock_node_t *node, bool *irq)
 {
-	void *Address = malloc(nitems * size);
-	if(Address == NULL) return NULL;
-	memset(Address, 0, nitems * size);
+#ifdef BUILD_KERNEL
+	//Deferred interrupt work runs on top of the interrupted thread and may allocate memory itself
+	*irq = cpu_disableInterrupts();
+#else
+	*irq = false;
+#endif
+	lock(&heap_lock, node);
+}
+
+static void heap_lockRelease(lock_node_t *node, bool irq)
+{
+	unlock(&heap_lock, node);
+#ifdef BUILD_KERNEL
+	cpu_restoreInterrupts(irq);
+#else
+	(void)irq;
+#endif
+}
+
+//Size sollte ein Vielfaches von HEAP_ALIGNMENT sein und mindestens gross genug für die Erweiterung des Baumes
+static size_t heap_roundSize(size_t size)
+{
+	return MAX(sizeof(heap_empty_t) - sizeof(heap_t), ((size + HEAP_ALIGNMENT - 1) & ~(HEAP_ALIGNMENT - 1)));
+}
+
+#ifdef BUILD_KERNEL
+/*
+ * Holt einen Block der passenden Grösse aus dem Cache der aktuellen CPU
+ * Rückgabe:	Adresse des Blocks oder NULL, wenn der Cache keinen solchen Block enthält
+ */
+static void *heap_cacheGet(size_t size)
+{
+	if(size > HEAP_CACHE_MAX_SIZE)
+		return NULL;
+
+	void *Address = NULL;
+	bool irq = cpu_disableInterrupts();
+	heap_cache_t *cache = &heap_caches[cpu_getIndex()];
+	size_t class = HEAP_CACHE_CLASS(size);
+	if(cache->count[class] > 0)
+	{
+		heap_t *heap = cache->blocks[class][--cache->count[class]];
+		heap->Flags &= ~HEAP_CACHED;
+		Address = (void*)heap + sizeof(heap_t);
+	}
+	cpu_restoreInterrupts(irq);
 	return Address;
 }
 
-void free(void *ptr)
+/*
+ * Legt einen freigegebenen Block in den Cache der aktuellen CPU. Der Block bleibt im Heap reserviert.
+ * Rückgabe:	true = Block wurde in den Cache gelegt
+ * 				false = Block ist zu gross oder der Cache ist voll
+ */
+static bool heap_cachePut(heap_t *heap)
 {
-	heap_t *heap, *tmpheap;
-	if(ptr == NULL) return;
-	heap = ptr - sizeof(heap_t);
-	//Ist dies eine gültige Addresse
-	if(heap->Flags == (HEAP_FLAGS | HEAP_RESERVED))
+	if(heap->Length > HEAP_CACHE_MAX_SIZE)
+		return false;
+
+	bool cached = false;
+	bool irq = cpu_disableInterrupts();
+	heap_cache_t *cache = &heap_caches[cpu_getIndex()];
+	size_t class = HEAP_CACHE_CLASS(heap->Length);
+	if(cache->count[class] < HEAP_CACHE_DEPTH)
 	{
-		//Wenn möglich Speicherbereiche zusammenführen
-		if(heap->Prev != NULL)
+		heap->Flags |= HEAP_CACHED;
+		cache->blocks[class][cache->count[class]++] = heap;
+		cached = true;
+	}
+	cpu_restoreInterrupts(irq);
+	return cached;
+}
+#endif
+
+/*
+ * Gibt einen reservierten Block frei. Der Heap muss gelockt sein.
+ * Parameter:	releasedPages = Anzahl der Pages des Blocks, welche schon zurückgegeben wurden
+ */
+static void heap_release(heap_t *heap, size_t releasedPages)
+{
+	heap_t *tmpheap;
+
+	//Wenn möglich Speicherbereiche zusammenführen. Die schon zurückgegebenen Pages der Nachbarn bleiben auch im
+	//zusammengeführten Block zurückgegeben.
+	if(heap->Prev != NULL)
+	{
+		tmpheap = heap->Prev;
+		if(((uintptr_t)tmpheap + tmpheap->Length + sizeof(heap_t)) == (uintptr_t)heap
+				&& !(tmpheap->Flags & HEAP_RESERVED))	//Wenn der Speicherbereich vornedran frei ist, dann mit diesem fusionieren
 		{
-			tmpheap = heap->Prev;
-			if(((uintptr_t)tmpheap + tmpheap->Length + sizeof(heap_t)) == (uintptr_t)heap
-					&& !(tmpheap->Flags & HEAP_RESERVED))	//Wenn der Speicherbereich vornedran frei ist, dann mit diesem fusionieren
+			//Aus den freien Blöcken entfernen
+			releasedPages += heap_getReleasedPages(tmpheap);
+			heap_freeBlockRemove((heap_empty_t*)tmpheap);
+			tmpheap->Next = heap->Next;
+			tmpheap->Length += heap->Length + sizeof(heap_t);
+			heap = tmpheap;
+
+			//Prev-Eintrag des nächsten Eintrages korrigieren
+			if(heap->Next != NULL)
 			{
-				//Aus AVL-Baum entfernen
-				remove_empty_heap((heap_empty_t*)tmpheap, false);
-				tmpheap->Next = heap->Next;
-				tmpheap->Length += heap->Length + sizeof(heap_t);
-				heap = tmpheap;
-
-				//Prev-Eintrag des nächsten Eintrages korrigieren
-				if(heap->Next != NULL)
-				{
-					tmpheap = heap->Next;
-					tmpheap->Prev = heap;
-				}
+				tmpheap = heap->Next;
+				tmpheap->Prev = heap;
+			}
+			else
+			{
+				lastHeap = heap;
 			}
 		}
-		if(heap->Next != NULL)
+	}
+	if(heap->Next != NULL)
+	{
+		tmpheap = heap->Next;
+		if(((uintptr_t)heap + heap->Length + sizeof(heap_t)) == (uintptr_t)tmpheap
+				&& !(tmpheap->Flags & HEAP_RESERVED))	//Wenn der Speicherbereich hintendran frei ist, dann mit diesem fusionieren
 		{
-			tmpheap = heap->Next;
-			if(((uintptr_t)heap + heap->Length + sizeof(heap_t)) == (uintptr_t)tmpheap
-					&& !(tmpheap->Flags & HEAP_RESERVED))	//Wenn der Speicherbereich hintendran frei ist, dann mit diesem fusionieren
+			//Aus den freien Blöcken entfernen
+			releasedPages += heap_getReleasedPages(tmpheap);
+			heap_freeBlockRemove((heap_empty_t*)tmpheap);
+			heap->Next = tmpheap->Next;
+			heap->Length += tmpheap->Length + sizeof(heap_t);
+
+			//Prev-Eintrag des nächsten Eintrages korrigieren
+			if(heap->Next != NULL)
 			{
-				//Aus AVL-Baum entfernen
-				remove_empty_heap((heap_empty_t*)tmpheap, false);
-				heap->Next = tmpheap->Next;
-				heap->Length += tmpheap->Length + sizeof(heap_t);
-
-				//Prev-Eintrag des nächsten Eintrages korrigieren
-				if(heap->Next != NULL)
-				{
-					tmpheap = heap->Next;
-					tmpheap->Prev = heap;
-				}
-				else if(tmpheap == lastHeap)
-				{
-					lastHeap = heap;
-				}
+				tmpheap = heap->Next;
+				tmpheap->Prev = heap;
+			}
+			else if(tmpheap == lastHeap)
+			{
+				lastHeap = heap;
 			}
 		}
-		heap->Flags = HEAP_FLAGS;
+	}
+	heap->Flags = HEAP_FLAGS;
+	//Die Pages des freigegebenen Blocks selbst werden als benutzt gezählt
+	uintptr_t start;
+	const size_t pages = heap_getReleasablePages(heap, &start);
+	heap->residentPages = (pages > releasedPages) ? pages - releasedPages : 0;
+
+	//Speicherbereich als frei eintragen
+	heap_freeBlockAdd((heap_empty_t*)heap);
+}
 
-		//Wenn möglich überflüssige Pages als unbenutzt markieren. 1 Page bleibt mindestens benutzt
-		if(heap->Length > 4096)
-		{
-			//Aufrunden auf nächste Pagegrenze
-			uintptr_t bottom = ((uintptr_t)heap + 0xFFF) & ~0xFFF;
-			//Die Page des nächsten Heaps dürfen wir nicht freigeben
-			uintptr_t top = ((uintptr_t)heap + heap->Length + sizeof(heap_t)) & ~0xFFF;
+/*
+ * Gibt ungenutzte Pages zurück, bis nur noch pad Bytes in ungenutzten Pages liegen. Der Heap darf nicht gelockt sein:
+ * Die Blöcke werden unter dem Lock aus dem Heap genommen und ihre Pages erst danach zurückgegeben, damit das
+ * Invalidieren der TLBs anderer CPUs nicht unter dem Lock geschieht.
+ * Rückgabe:	true = es wurden Pages zurückgegeben
+ */
+static bool heap_trim(size_t pad)
+{
+	heap_t *blocks[HEAP_TRIM_BATCH];
+	size_t count;
+	bool released = false;
+	lock_node_t node;
+	bool irq;
 
-			if(top > bottom)
-			{
-				if((uintptr_t)heap >= bottom) bottom += 4096;
+	do
+	{
+		size_t pages = 0;
+		count = 0;
+		heap_lockAcquire(&node, &irq);
+		heap_trimCollect(base_emptyHeap, pad, blocks, &count, &pages);
+		//Als reserviert markierte Blöcke werden weder vergeben noch mit ihren Nachbarn zusammengeführt
+		for(size_t i = 0; i < count; i++)
+		{
+			heap_freeBlockRemove((heap_empty_t*)blocks[i]);
+			blocks[i]->Flags = HEAP_FLAGS | HEAP_RESERVED | HEAP_TRIMMING;
+		}
+		heap_lockRelease(&node, irq);
 
-				uint64_t Pages = (top - bottom) / 4096;
+		for(size_t i = 0; i < count; i++)
+			heap_releasePages(blocks[i]);
 
-				if(Pages > 0)
-				{
-#ifdef BUILD_KERNEL
-					extern context_t kernel_context;
-					vmm_unusePages(&kernel_context, (void*)bottom, Pages);
-#else
-					syscall_unusePages((void*)bottom, Pages);
-#endif
-				}
-			}
+		heap_lockAcquire(&node, &irq);
+		for(size_t i = 0; i < count; i++)
+		{
+			uintptr_t start;
+			heap_release(blocks[i], heap_getReleasablePages(blocks[i], &start));
 		}
-
-		//Speicherbereich in AVL-Baum eintragen
-		add_empty_heap((heap_empty_t*)heap);
+		heap_lockRelease(&node, irq);
+		released |= count > 0;
 	}
+	while(count == HEAP_TRIM_BATCH);
+
+	return released;
 }
 
-void *malloc(size_t size)
+/*
+ * Reserviert einen Block. Der Heap muss gelockt sein.
+ * Parameter:	size = mit heap_roundSize angepasste Grösse
+ */
+static void *heap_alloc(size_t size)
 {
 	heap_t *heap, *tmp_heap;
 	void *Address;
-	if(size == 0)
-		return NULL;
-
-	//Size sollte ein Vielfaches von 8 sein und mindestens gross genug für die Erweiterung des Baumes
-	size = MAX(sizeof(heap_empty_t) - sizeof(heap_t), ((size + HEAP_ALIGNMENT - 1) & ~(HEAP_ALIGNMENT - 1)));
 
 	//Nach passendem Eintrag suchen
-	heap_empty_t *node = search_empty_heap(size);
+	heap_empty_t *node = heap_freeBlockSearch(size);
 
 	if(node == NULL)
 	{
@@ -870,6 +1149,7 @@ void *malloc(size_t size)
 		node = syscall_allocPages(pages);
 #endif
 		if(node == NULL) return NULL;
+		arenaSize += pages * 4096;
 		node->heap_base.Next = NULL;
 		if(lastHeap == NULL)
 			node->heap_base.Prev = NULL;
@@ -881,9 +1161,11 @@ void *malloc(size_t size)
 		lastHeap = (heap_t*)node;
 		node->heap_base.Length = pages * 4096 - sizeof(heap_t);
 		node->heap_base.Flags = HEAP_FLAGS;
+		uintptr_t start;
+		node->heap_base.residentPages = heap_getReleasablePages(&node->heap_base, &start);
 	}
 	else
-		remove_empty_heap((heap_empty_t*)node, false);
+		heap_freeBlockRemove(node);
 
 	//Eintrag anpassen
 	heap = (heap_t*)node;
@@ -894,19 +1176,135 @@ void *malloc(size_t size)
 		setupNewHeapEntry(heap, tmp_heap);
 		tmp_heap->Length = heap->Length - size - sizeof(heap_t);
 		heap->Length = size;				//Länge anpassen
+		//Es ist nicht bekannt, welche Pages zurückgegeben wurden, deshalb wird höchstens gleich viel gezählt
+		uintptr_t start;
+		tmp_heap->residentPages = MIN(heap_getReleasablePages(tmp_heap, &start), (size_t)heap->residentPages);
 
-		//Eintragen in AVL-Baum
-		add_empty_heap((heap_empty_t*)tmp_heap);
+		//Als frei eintragen
+		heap_freeBlockAdd((heap_empty_t*)tmp_heap);
 		if(tmp_heap->Next == NULL)
 			lastHeap = tmp_heap;
 	}
-	heap->Flags |= HEAP_RESERVED;		//Als reserviert markieren
+	heap->Flags = HEAP_FLAGS | HEAP_RESERVED;		//Als reserviert markieren
 
 	assert(((uintptr_t)Address & (HEAP_ALIGNMENT - 1)) == 0);
 
 	return Address;
 }
 
+/*
+ * Vergrössert einen reservierten Block, falls hintendran genügend freier Platz ist. Der Heap muss gelockt sein.
+ * Rückgabe:	true = Block wurde vergrössert
+ * 				false = Block muss verschoben werden
+ */
+static bool heap_grow(heap_t *Heap, size_t size)
+{
+	heap_t *tmpHeap;
+
+	//Ist hinten noch freier Platz?
+	if(Heap->Next == NULL)
+		return false;
+
+	tmpHeap = Heap->Next;
+	//Wenn hintendran noch freier Platz ist können wir unseren einfach vergrössern
+	if(((uintptr_t)Heap + Heap->Length + sizeof(heap_t)) != (uintptr_t)tmpHeap
+			|| tmpHeap->Flags & HEAP_RESERVED || Heap->Length + tmpHeap->Length + sizeof(heap_t) < size)
+		return false;
+
+	//Aus den freien Blöcken entfernen
+	heap_freeBlockRemove((heap_empty_t*)tmpHeap);
+	//Müssen wir den Header auch noch nehmen? Der Rest muss noch gross genug für die Erweiterung des Baumes sein.
+	if(tmpHeap->Length < (size - Heap->Length) + sizeof(heap_empty_t) - sizeof(heap_t))
+	{
+		Heap->Next = tmpHeap->Next;
+		if(tmpHeap->Next != NULL)
+		{
+			((heap_t*)tmpHeap->Next)->Prev = Heap;
+		}
+		Heap->Length += tmpHeap->Length + sizeof(heap_t);
+		if(lastHeap == tmpHeap)
+			lastHeap = Heap;
+	}
+	//Ansonsten verschieben wir den Header des nächsten Eintrags einfach
+	else
+	{
+		heap_t *oldHeap = tmpHeap;
+		tmpHeap = memmove((void*)Heap + sizeof(heap_t) + size, tmpHeap, sizeof(heap_t));
+		Heap->Next = tmpHeap;
+		tmpHeap->Length -= size - Heap->Length;
+		uintptr_t start;
+		tmpHeap->residentPages = MIN(heap_getReleasablePages(tmpHeap, &start), (size_t)tmpHeap->residentPages);
+		//Eintrag des übernächsten Eintrags aktualisieren
+		if(tmpHeap->Next != NULL)
+		{
+			((heap_t*)tmpHeap->Next)->Prev = tmpHeap;
+		}
+		Heap->Length = size;
+		if(lastHeap == oldHeap)
+			lastHeap = tmpHeap;
+		//Wieder als frei eintragen
+		heap_freeBlockAdd((heap_empty_t*)tmpHeap);
+	}
+	return true;
+}
+
+void *calloc(size_t nitems, size_t size)
+{
+	void *Address = malloc(nitems * size);
+	if(Address == NULL) return NULL;
+	memset(Address, 0, nitems * size);
+	return Address;
+}
+
+void free(void *ptr)
+{
+	heap_t *heap;
+	if(ptr == NULL) return;
+	heap = ptr - sizeof(heap_t);
+	//Ist dies eine gültige Addresse
+	if(heap->Flags != (HEAP_FLAGS | HEAP_RESERVED))
+		return;
+
+#ifdef BUILD_KERNEL
+	if(heap_cachePut(heap))
+		return;
+#endif
+
+	lock_node_t node;
+	bool irq;
+	heap_lockAcquire(&node, &irq);
+	heap_release(heap, 0);
+	//Ungenutzte Pages werden gesammelt zurückgegeben, damit wiederverwendete Blöcke nicht jedes Mal neu gemappt werden
+	bool trim = residentFreePages * 4096 > trimThreshold;
+	heap_lockRelease(&node, irq);
+
+	if(trim)
+		heap_trim(trimThreshold / 2);
+}
+
+void *malloc(size_t size)
+{
+	void *Address;
+	if(size == 0)
+		return NULL;
+
+	size = heap_roundSize(size);
+
+#ifdef BUILD_KERNEL
+	Address = heap_cacheGet(size);
+	if(Address != NULL)
+		return Address;
+#endif
+
+	lock_node_t node;
+	bool irq;
+	heap_lockAcquire(&node, &irq);
+	Address = heap_alloc(size);
+	heap_lockRelease(&node, irq);
+
+	return Address;
+}
+
 void *realloc(void *ptr, size_t size)
 {
 	if(ptr == NULL && size == 0)
@@ -918,93 +1316,70 @@ void *realloc(void *ptr, size_t size)
 		free(ptr);
 		return NULL;
 	}
-	heap_t *Heap, *tmpHeap;
-	void *Address = NULL;
+	heap_t *Heap;
+	void *Address;
 	Heap = ptr - sizeof(heap_t);
 
-	//Size sollte ein Vielfaches von 8 sein und mindestens gross genug für die Erweiterung des Baumes
-	size = MAX(sizeof(heap_empty_t) - sizeof(heap_t), ((size + HEAP_ALIGNMENT - 1) & ~(HEAP_ALIGNMENT - 1)));
+	size = heap_roundSize(size);
 	//Ist dieser Heap gültig?
-	if(Heap->Flags == (HEAP_FLAGS | HEAP_RESERVED))
+	if(Heap->Flags != (HEAP_FLAGS | HEAP_RESERVED))
+		return NULL;
+
+	//TODO: Vielleicht könnte man hier auch Speicherplatz freigeben?
+	//Wenn der PLatz noch da ist müssen wir nichts untenehmen
+	if(Heap->Length >= size)
+		return ptr;
+
+	lock_node_t node;
+	bool irq;
+	heap_lockAcquire(&node, &irq);
+	bool grown = heap_grow(Heap, size);
+	heap_lockRelease(&node, irq);
+	if(grown)
+		return ptr;
+
+	Address = malloc(size);
+	if(Address)
 	{
-		Address = ptr;
-		//TODO: Vielleicht könnte man hier auch Speicherplatz freigeben?
-		//Wenn der PLatz noch da ist müssen wir nichts untenehmen
-		if(Heap->Length < size)
-		{
-			//Ist hinten noch freier Platz?
-			if(Heap->Next != NULL)
-			{
-				tmpHeap = Heap->Next;
-				//Wenn hintendran noch freier Platz ist können wir unseren einfach vergrössern
-				if(!(tmpHeap->Flags & HEAP_RESERVED) && Heap->Length + tmpHeap->Length + sizeof(heap_t) >= size)
-				{
-					//Aus AVL-Baum entfernen
-					remove_empty_heap((heap_empty_t*)tmpHeap, false);
-					//Müssen wir den Header auch noch nehmen?
-					if(tmpHeap->Length < (size - Heap->Length) || tmpHeap->Length <= sizeof(heap_empty_t) - sizeof(heap_t))
-					{
-						Heap->Next = tmpHeap->Next;
-						if(tmpHeap->Next != NULL)
-						{
-							((heap_t*)tmpHeap->Next)->Prev = Heap;
-						}
-						Heap->Length += tmpHeap->Length + sizeof(heap_t);
-						if(lastHeap == tmpHeap)
-							lastHeap = Heap;
-					}
-					//Ansonsten verschieben wir den Header des nächsten Eintrags einfach
-					else
-					{
-						heap_t *oldHeap = tmpHeap;
-						tmpHeap = memmove((void*)Heap + sizeof(heap_t) + size, tmpHeap, sizeof(heap_t));
-						Heap->Next = tmpHeap;
-						tmpHeap->Length -= size - Heap->Length;
-						//Eintrag des übernächsten Eintrags aktualisieren
-						if(tmpHeap->Next != NULL)
-						{
-							((heap_t*)tmpHeap->Next)->Prev = tmpHeap;
-						}
-						Heap->Length = size;
-						if(lastHeap == oldHeap)
-							lastHeap = tmpHeap;
-						//Wieder in den AVL-Baum eintragen
-						add_empty_heap((heap_empty_t*)tmpHeap);
-					}
-				}
-				else
-				{
-					Address = malloc(size);
-					if(Address)
-					{
-						if(size > Heap->Length)
-							memcpy(Address, ptr, Heap->Length);
-						else
-							memcpy(Address, ptr, size);
-						free(ptr);
-					}
-				}
-			}
-			else
-			{
-				Address = malloc(size);
-				if(Address)
-				{
-					if(size > Heap->Length)
-						memcpy(Address, ptr, Heap->Length);
-					else
-						memcpy(Address, ptr, size);
-					free(ptr);
-				}
-			}
-		}
+		memcpy(Address, ptr, Heap->Length);
+		free(ptr);
 	}
 
-	assert(((uintptr_t)Address & (HEAP_ALIGNMENT - 1)) == 0);
-
 	return Address;
 }
 
+int malloc_trim(size_t pad)
+{
+	return heap_trim(pad);
+}
+
+struct mallinfo mallinfo(void)
+{
+	//Die Zähler werden ohne Lock gelesen, damit die Statistik den Heap nicht blockiert
+	struct mallinfo info = {
+		.arena = arenaSize,
+		.ordblks = freeBlocks,
+		.fordblks = freeBytes,
+		.keepcost = residentFreePages * 4096
+	};
+	info.uordblks = (info.arena > info.fordblks) ? info.arena - info.fordblks : 0;
+	return info;
+}
+
+int mallopt(int param, int value)
+{
+	switch(param)
+	{
+		case M_TRIM_THRESHOLD:
+			if(value < 0)
+				return 0;
+			trimThreshold = value;
+			return 1;
+		default:
+			return 0;
+	}
+}
+
 #define ABS_IMPL(T, name)						\
 T name(T x) {									\
 	return (x < 0) ? -x : x;					\
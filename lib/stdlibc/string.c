@@ -340,9 +340,22 @@ int memcmp(const void *lhs, const void *rhs, size_t count)
 
 void *memset(void *block, int c, size_t n)
 {
-	unsigned char volatile *i;
-	for(i = block; (uintptr_t)i < (uintptr_t)block + n; i++)
-		*i = (unsigned char)c;
+	const uint64_t pattern = 0x0101010101010101ul * (unsigned char)c;
+	void *dest = block;
+	size_t count;
+
+	//Grosse Blöcke werden nach dem Ausrichten auf 8 Bytes mit ganzen Quadwords beschrieben
+	if(n >= 2 * sizeof(uint64_t))
+	{
+		count = -(uintptr_t)dest & (sizeof(uint64_t) - 1);
+		n -= count;
+		asm volatile("rep stosb" : "+D"(dest), "+c"(count) : "a"(pattern) : "memory");
+		count = n / sizeof(uint64_t);
+		n %= sizeof(uint64_t);
+		asm volatile("rep stosq" : "+D"(dest), "+c"(count) : "a"(pattern) : "memory");
+	}
+	count = n;
+	asm volatile("rep stosb" : "+D"(dest), "+c"(count) : "a"(pattern) : "memory");
 	return block;
 }
 
@@ -27,6 +27,27 @@ void syscall_unusePages(void *Address, size_t Pages)
 	syscall(SYSCALL_UNUSE_PAGES, Address, Pages);
 }
 
+void *syscall_mmap(void *address, size_t length, int prot, int flags, uint64_t stream, uint64_t offset)
+{
+	//Der Syscall hat nur 5 Parameter, deshalb werden die Flags zusammengefasst
+	return (void*)syscall(SYSCALL_MMAP, address, length, ((uint64_t)(uint32_t)flags << 32) | (uint32_t)prot, stream, offset);
+}
+
+int syscall_munmap(void *address, size_t length)
+{
+	return syscall(SYSCALL_MUNMAP, address, length);
+}
+
+int syscall_msync(void *address, size_t length)
+{
+	return syscall(SYSCALL_MSYNC, address, length);
+}
+
+int syscall_mprotect(void *address, size_t length, int prot)
+{
+	return syscall(SYSCALL_MPROTECT, address, length, prot);
+}
+
 pid_t syscall_createProcess(const char *path, const char *cmd, const char **env, const char *stdin, const char *stdout, const char *stderr)
 {
 	const char *stddevs[3] = {stdin, stdout, stderr};
@@ -45,6 +66,26 @@ pid_t syscall_wait(pid_t pid, int *status)
 	return (pid_t)syscall(SYSCALL_WAIT, pid, status);
 }
 
+pid_t syscall_fork(void)
+{
+	return (pid_t)syscall(SYSCALL_FORK);
+}
+
+int syscall_nice(int incr)
+{
+	return syscall(SYSCALL_NICE, incr);
+}
+
+int syscall_getPriority(int which, pid_t who, int *value)
+{
+	return syscall(SYSCALL_GET_PRIORITY, which, who, value);
+}
+
+int syscall_setPriority(int which, pid_t who, int value)
+{
+	return syscall(SYSCALL_SET_PRIORITY, which, who, value);
+}
+
 tid_t syscall_createThread(void *entry, void *arg)
 {
 	return (tid_t)syscall(SYSCALL_THREAD_CREATE, entry, arg);
@@ -12,6 +12,7 @@
 #include "vmm.h"
 #include "stdlib.h"
 #include "assert.h"
+#include "loader.h"
 
 typedef uint64_t	elf64_addr;
 typedef uint16_t 	elf64_half;
@@ -213,24 +214,33 @@ ERROR_TYPE(pid_t) elfLoad(vfs_stream_t *file, const char *cmd, const char **env,
 		//Wenn kein ladbares Segment, dann Springe zum nächsten Segment
 		if(ProgramHeader[i].p_type != ELF_PT_LOAD) continue;
 
-		size_t pages = ProgramHeader[i].p_memsz / 4096;
-		pages += (ProgramHeader[i].p_memsz % 4096) ? 1 : 0;
-		void *dest = mm_SysAlloc(pages);
-		assert(dest != NULL);
-		uintptr_t dest_off = ProgramHeader[i].p_vaddr % 0x1000;
-		vfs_Read(file, ProgramHeader[i].p_offset, ProgramHeader[i].p_filesz, dest + dest_off);
-
-		//Eventuell mit nullen auffüllen
-		memset(dest + dest_off + ProgramHeader[i].p_filesz, 0, ProgramHeader[i].p_memsz - ProgramHeader[i].p_filesz);
-
 		uint16_t flags = VMM_FLAGS_USER;
 		if(ProgramHeader[i].p_flags & ELF_PF_W)
 			flags |= VMM_FLAGS_WRITE;
 		if(!(ProgramHeader[i].p_flags & ELF_PF_X))
 			flags |= VMM_FLAGS_NX;
 
-		//Speicherbereich an die richtige Addresse mappen
-		vmm_ReMap(&kernel_context, dest, task->Context, (void*)ProgramHeader[i].p_vaddr, pages, flags);
+		//Schreibgeschützte Segmente werden mit anderen Prozessen geteilt, welche dieselbe Datei ausführen
+		vmm_page_cache_t *cache = NULL;
+		if(!(flags & VMM_FLAGS_WRITE))
+		{
+			const uintptr_t start = ProgramHeader[i].p_vaddr & ~(MM_BLOCK_SIZE - 1);
+			const uintptr_t end = (ProgramHeader[i].p_vaddr + ProgramHeader[i].p_memsz + MM_BLOCK_SIZE - 1) & ~(MM_BLOCK_SIZE - 1);
+			cache = loader_getSegmentCache(file, i, start, (end - start) / MM_BLOCK_SIZE);
+		}
+
+		//Das Segment wird erst beim ersten Zugriff auf die jeweilige Page aus der Datei geladen
+		void *mapped = vmm_MapFile(task->Context, (void*)ProgramHeader[i].p_vaddr, ProgramHeader[i].p_memsz, flags,
+				file, ProgramHeader[i].p_offset, ProgramHeader[i].p_filesz, cache);
+		if(cache != NULL)
+			REFCOUNT_RELEASE(cache);
+		if(mapped == NULL)
+		{
+			free(ProgramHeader);
+			vfs_deinitUserspace(task);
+			pm_DestroyTask(task);
+			return ERROR_RETURN_ERROR(pid_t, E_NO_MEMORY);
+		}
 	}
 
 	//Temporäre Daten wieder freigeben
@@ -9,6 +9,52 @@
 #include "vfs.h"
 #include "elf.h"
 #include "string.h"
+#include "stdlib.h"
+#include "lock.h"
+#include "pmm.h"
+
+#define LOADER_IMAGE_CACHE_SIZE	32		//Maximale Anzahl Segmente im Cache
+
+//Geteilte Pages eines schreibgeschützten Segments einer ausführbaren Datei
+typedef struct loader_image_segment{
+	struct loader_image_segment *next;
+	vfs_stream_t *file;			//Solange der Stream offen ist, wird er für dieselbe Datei wiederverwendet
+	uint64_t size, changeTime;	//Damit Änderungen an der Datei erkannt werden
+	uint16_t index;				//Index im Program Header
+	uintptr_t address;
+	vmm_page_cache_t *cache;
+}loader_image_segment_t;
+
+//Zuletzt verwendete Segmente stehen am Anfang der Liste
+static loader_image_segment_t *image_cache = NULL;
+static size_t image_cache_count = 0;
+static lock_t image_cache_lock = LOCK_INIT;
+
+static void image_segment_free(loader_image_segment_t *segment)
+{
+	vfs_Close(segment->file);
+	REFCOUNT_RELEASE(segment->cache);
+	free(segment);
+}
+
+/*
+ * Sucht das Segment im Cache und entfernt es aus der Liste.
+ * Muss mit image_cache_lock aufgerufen werden.
+ */
+static loader_image_segment_t *image_cache_take(vfs_stream_t *file, uint16_t index)
+{
+	for(loader_image_segment_t **s = &image_cache; *s != NULL; s = &(*s)->next)
+	{
+		loader_image_segment_t *segment = *s;
+		if(segment->file == file && segment->index == index)
+		{
+			*s = segment->next;
+			image_cache_count--;
+			return segment;
+		}
+	}
+	return NULL;
+}
 
 ERROR_TYPE(pid_t) loader_load(const char *path, const char *cmd, const char **env, const char *stdin, const char *stdout, const char *stderr)
 {
@@ -50,3 +96,88 @@ pid_t loader_syscall_load(const char *path, const char *cmd, const char **env, c
 		return 0;
 	return ERROR_GET_VALUE(loader_load(path, cmd, env, stddevs[0], stddevs[1], stddevs[2]));	//TODO: pass error to userspace
 }
+
+vmm_page_cache_t *loader_getSegmentCache(vfs_stream_t *file, uint16_t index, uintptr_t address, size_t pages)
+{
+	const uint64_t size = vfs_getFileinfo(file, VFS_INFO_FILESIZE);
+	const uint64_t changeTime = vfs_getFileinfo(file, VFS_INFO_CHANGETIME);
+	loader_image_segment_t *stale = NULL;
+	loader_image_segment_t *evicted = NULL;
+
+	lock_node_t lock_node;
+	lock(&image_cache_lock, &lock_node);
+	loader_image_segment_t *segment = image_cache_take(file, index);
+	if(segment != NULL && (segment->size != size || segment->changeTime != changeTime
+			|| segment->address != address || segment->cache->pages != pages))
+	{
+		//Die Datei wurde verändert
+		stale = segment;
+		segment = NULL;
+	}
+	if(segment == NULL && (segment = malloc(sizeof(loader_image_segment_t))) != NULL)
+	{
+		ERROR_TYPE_POINTER(vfs_stream_t) stream_ret = vfs_Reopen(file, VFS_MODE_READ);
+		segment->cache = vmm_createPageCache(pages);
+		if(ERROR_DETECT(stream_ret) || segment->cache == NULL)
+		{
+			if(!ERROR_DETECT(stream_ret))
+				vfs_Close(ERROR_GET_VALUE(stream_ret));
+			if(segment->cache != NULL)
+				REFCOUNT_RELEASE(segment->cache);
+			free(segment);
+			segment = NULL;
+		}
+		else
+		{
+			segment->file = ERROR_GET_VALUE(stream_ret);
+			segment->size = size;
+			segment->changeTime = changeTime;
+			segment->index = index;
+			segment->address = address;
+		}
+	}
+
+	vmm_page_cache_t *cache = NULL;
+	if(segment != NULL)
+	{
+		cache = REFCOUNT_RETAIN(segment->cache);
+		segment->next = image_cache;
+		image_cache = segment;
+		if(++image_cache_count > LOADER_IMAGE_CACHE_SIZE)
+		{
+			//Das am längsten nicht mehr verwendete Segment entfernen
+			loader_image_segment_t **s = &image_cache;
+			while((*s)->next != NULL)
+				s = &(*s)->next;
+			evicted = *s;
+			*s = NULL;
+			image_cache_count--;
+		}
+	}
+	unlock(&image_cache_lock, &lock_node);
+
+	if(stale != NULL)
+		image_segment_free(stale);
+	if(evicted != NULL)
+		image_segment_free(evicted);
+	return cache;
+}
+
+size_t loader_getSharedPages(void)
+{
+	size_t pages = 0;
+	LOCKED_TASK(image_cache_lock, {
+		for(const loader_image_segment_t *segment = image_cache; segment != NULL; segment = segment->next)
+		{
+			for(size_t i = 0; i < segment->cache->pages; i++)
+			{
+				//Der Cache und der erste Prozess besitzen die Page, jeder weitere Prozess spart eine Kopie
+				paddr_t frame = segment->cache->frames[i];
+				size_t owners = (frame != 0) ? pmm_getRefCount(frame) : 0;
+				if(owners > 2)
+					pages += owners - 2;
+			}
+		}
+	});
+	return pages;
+}
@@ -9,9 +9,29 @@
 #define LOADER_H_
 
 #include "pm.h"
+#include "vfs.h"
 
 ERROR_TYPE(pid_t) loader_load(const char *path, const char *cmd, const char **env, const char *stdin, const char *stdout, const char *stderr);
 
+/**
+ * \brief Returns the cache of the pages of a read-only segment of an executable.
+ *
+ * Processes running the same executable share the pages of its read-only segments. The cache is dropped
+ * if the size or the change time of the file differ from when it was created.
+ *
+ * @param file Stream of the executable
+ * @param index Index of the segment in the program header
+ * @param address Page aligned virtual address of the segment
+ * @param pages Number of pages of the segment
+ * @return Retained cache or NULL if there is not enough memory
+ */
+vmm_page_cache_t *loader_getSegmentCache(vfs_stream_t *file, uint16_t index, uintptr_t address, size_t pages);
+
+/**
+ * \brief Returns the number of pages which are saved by sharing the read-only segments of executables.
+ */
+size_t loader_getSharedPages(void);
+
 //Syscalls
 pid_t loader_syscall_load(const char *path, const char *cmd, const char **env, const char *stddevs[3]);
 
@@ -31,11 +31,33 @@
 #include "drivermanager.h"
 #include "devicemng.h"
 #include "console.h"
+#include "meminfo.h"
 #include "syscalls.h"
+#include "smp.h"
+#include "pmm.h"
+#include "thread.h"
 #include <dispatcher.h>
 
 static multiboot_structure static_MBS;
 
+#ifdef DEBUGMODE
+/*
+ * Führt die Benchmarks der einzelnen Module nacheinander aus, damit sich die Messungen nicht gegenseitig beeinflussen
+ */
+static void __attribute__((noreturn)) benchmarkThread()
+{
+	pmm_benchmark();
+	mm_heapBenchmark();
+	thread_benchmark();
+	scheduler_benchmark();
+	pit_benchmark();
+	SysLog("SYSTEM", "Benchmarks abgeschlossen");
+
+	//Kernelthreads können nicht beendet werden
+	while(1) thread_block_self(NULL, NULL, THREAD_BLOCKED_WAIT);
+}
+#endif
+
 multiboot_structure *Init(multiboot_structure *MBS);
 
 void __attribute__((noreturn)) main(multiboot_structure *MBS)
@@ -65,7 +87,7 @@ multiboot_structure *Init(multiboot_structure *MBS)
 {
 	Display_Init();		//Anzeige Intialisieren
 	cpu_init(true);		//CPU Initialisieren
-	GDT_Init();			//GDT initialisieren
+	GDT_Init(&cpuLocal[0]);	//GDT initialisieren
 	IDT_Init();			//IDT initialisieren
 	TSS_Init();			//TSS initialisieren
 
@@ -93,7 +115,14 @@ multiboot_structure *Init(multiboot_structure *MBS)
 	drivermanager_init();
 	dmng_Init();
 	pm_Init();			//Tasks initialisieren
+	#ifdef DEBUGMODE
+	mm_heapStressTest();
+	ERROR_TYPE_POINTER(thread_t) benchmark = thread_create(&kernel_process, benchmarkThread, 0, NULL, true);
+	if(!ERROR_DETECT(benchmark))
+		thread_unblock(ERROR_GET_VALUE(benchmark));
+	#endif
 	console_Init();
+	meminfo_Init();
 	dispatcher_init(100);
 
 	SysLog("SYSTEM", "Initialisierung abgeschlossen");
@@ -102,6 +131,8 @@ multiboot_structure *Init(multiboot_structure *MBS)
 	printf("Aktiviere Interrupts\n\r");
 	#endif
 	CPU_ENABLE_INTERRUPTS();
+	smp_Init();			//Application Processors starten
+	pit_enableTickless();
 	cdi_init();			//CDI und -Treiber initialisieren
 	return MBS;
 }
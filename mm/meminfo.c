@@ -0,0 +1,189 @@
+/*
+ * meminfo.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: pascal
+ */
+
+#include "meminfo.h"
+#include "pmm.h"
+#include "vmm.h"
+#include "slab.h"
+#include "loader.h"
+#include "memory.h"
+#include "devfs.h"
+#include "stdlib.h"
+#include "stdio.h"
+#include "string.h"
+#include "stdarg.h"
+#include "malloc.h"
+
+#define MIN(a, b)			((a < b) ? a : b)
+#define KB(pages)			((uint64_t)(pages) * (MM_BLOCK_SIZE / 1024))
+#define MEMINFO_BASE_SIZE	2048	//Space for everything except the slab caches
+#define MEMINFO_CACHE_SIZE	96		//Space for one line per slab cache
+
+typedef struct{
+	char *buffer;
+	size_t size;
+	size_t length;
+}meminfo_text_t;
+
+static const char *zoneNames[PMM_ZONE_COUNT] = {"DMA16", "DMA32", "Normal"};
+
+static void append(meminfo_text_t *text, const char *format, ...)
+{
+	if(text->length >= text->size)
+		return;
+
+	va_list arg;
+	va_start(arg, format);
+	int written = vsnprintf(text->buffer + text->length, text->size - text->length, format, arg);
+	va_end(arg);
+	if(written > 0)
+		text->length = MIN(text->length + written, text->size - 1);
+}
+
+/*
+ * Generates the text of the file. The caller has to free the buffer.
+ */
+static bool generate(meminfo_text_t *text)
+{
+	//The number of caches can grow until we fetch the statistics so we reserve some more entries
+	size_t cacheCount = slab_getStatistics(NULL, 0) + 4;
+	slab_cache_stats_t *caches = malloc(cacheCount * sizeof(*caches));
+	if(caches == NULL)
+		return false;
+	cacheCount = MIN(slab_getStatistics(caches, cacheCount), cacheCount);
+
+	text->size = MEMINFO_BASE_SIZE + cacheCount * MEMINFO_CACHE_SIZE;
+	text->length = 0;
+	text->buffer = malloc(text->size);
+	if(text->buffer == NULL)
+	{
+		free(caches);
+		return false;
+	}
+	text->buffer[0] = '\0';
+
+	uint64_t totalPages = pmm_getTotalPages();
+	uint64_t freePages = pmm_getFreePages();
+	append(text, "MemTotal:          %10lu kB\n", KB(totalPages));
+	append(text, "MemFree:           %10lu kB\n", KB(freePages));
+	append(text, "MemUsed:           %10lu kB\n", KB(totalPages - freePages));
+
+	for(pmm_zone_t zone = 0; zone < PMM_ZONE_COUNT; zone++)
+	{
+		pmm_zone_stats_t zoneStats;
+		pmm_getZoneStatistics(zone, &zoneStats);
+		append(text, "Zone %-6s Total: %10lu kB\n", zoneNames[zone], KB(zoneStats.totalPages));
+		append(text, "Zone %-6s Free:  %10lu kB\n", zoneNames[zone], KB(zoneStats.freePages));
+		append(text, "Zone %-6s Used:  %10lu kB\n", zoneNames[zone], KB(zoneStats.totalPages - zoneStats.freePages));
+	}
+
+	pmm_cache_stats_t cacheStats;
+	pmm_getCacheStatistics(&cacheStats);
+	append(text, "PageCache:         %10lu kB\n", KB(cacheStats.pages));
+	append(text, "PageCacheHits:     %10lu\n", cacheStats.hits);
+	append(text, "PageCacheMisses:   %10lu\n", cacheStats.misses);
+
+	pmm_zero_stats_t zeroStats;
+	pmm_getZeroPoolStatistics(&zeroStats);
+	append(text, "ZeroPool:          %10lu kB\n", KB(zeroStats.pages));
+	append(text, "ZeroPoolHits:      %10lu\n", zeroStats.hits);
+	append(text, "ZeroPoolMisses:    %10lu\n", zeroStats.misses);
+	append(text, "ZeroPoolZeroed:    %10lu\n", zeroStats.zeroed);
+
+	struct mallinfo heap = mallinfo();
+	append(text, "HeapArena:         %10zu kB\n", heap.arena / 1024);
+	append(text, "HeapUsed:          %10zu kB\n", heap.uordblks / 1024);
+	append(text, "HeapFree:          %10zu kB\n", heap.fordblks / 1024);
+	append(text, "HeapFreeBlocks:    %10zu\n", heap.ordblks);
+	append(text, "HeapKeep:          %10zu kB\n", heap.keepcost / 1024);
+
+	append(text, "PageTables:        %10lu kB\n", KB(vmm_getTotalPageTablePages()));
+	append(text, "SharedImages:      %10lu kB\n", KB(loader_getSharedPages()));
+
+	pmm_dma_stats_t dmaStats;
+	pmm_getDMAStatistics(&dmaStats);
+	append(text, "DMAAllocations:    %10lu\n", dmaStats.allocations);
+	append(text, "DMAAllocated:      %10lu kB\n", KB(dmaStats.pages));
+	append(text, "DMAFailures:       %10lu\n", dmaStats.failures);
+
+	vmm_fault_stats_t faultStats;
+	vmm_getFaultStatistics(&faultStats);
+	append(text, "PageFaults:        %10lu\n", faultStats.total);
+	append(text, "PageFaultsCOW:     %10lu\n", faultStats.copyOnWrite);
+	append(text, "PageFaultsFile:    %10lu\n", faultStats.file);
+	append(text, "PageFaultsDemand:  %10lu\n", faultStats.demand);
+	append(text, "PageFaultsLarge:   %10lu\n", faultStats.largePages);
+	append(text, "PageFaultsFailed:  %10lu\n", faultStats.unresolved);
+
+	append(text, "\nSlab cache               Size     InUse     Total     Slabs\n");
+	for(size_t i = 0; i < cacheCount; i++)
+	{
+		append(text, "%-24.24s %5zu %9zu %9zu %9zu\n", caches[i].name, caches[i].objectSize, caches[i].objectsInUse,
+				caches[i].objectsTotal, caches[i].slabs);
+	}
+
+	free(caches);
+	return true;
+}
+
+static size_t meminfo_read(vfs_node_dev_t *node __attribute__((unused)), uint64_t start, size_t size, void *buffer)
+{
+	meminfo_text_t text;
+	if(!generate(&text))
+		return 0;
+
+	size_t length = 0;
+	if(start < text.length)
+	{
+		length = MIN(size, text.length - start);
+		memcpy(buffer, text.buffer + start, length);
+	}
+	free(text.buffer);
+	return length;
+}
+
+static size_t meminfo_write(vfs_node_dev_t *node __attribute__((unused)), uint64_t start __attribute__((unused)),
+		size_t size __attribute__((unused)), const void *buffer __attribute__((unused)))
+{
+	return 0;
+}
+
+static int meminfo_getAttribute(vfs_node_t *node __attribute__((unused)), vfs_fileinfo_t attribute, uint64_t *value)
+{
+	switch(attribute)
+	{
+		case VFS_INFO_FILESIZE:
+		{
+			meminfo_text_t text;
+			if(!generate(&text))
+				return 1;
+			*value = text.length;
+			free(text.buffer);
+		}
+		break;
+		default:
+			return 1;
+	}
+
+	return 0;
+}
+
+void meminfo_Init(void)
+{
+	vfs_node_dev_t *node = calloc(1, sizeof(vfs_node_dev_t));
+	if(node == NULL || vfs_node_dev_init(node, "meminfo"))
+	{
+		free(node);
+		return;
+	}
+	node->type = VFS_DEVICE_CHARACTER | VFS_DEVICE_VIRTUAL;
+	node->read = meminfo_read;
+	node->write = meminfo_write;
+	node->base.getAttribute = meminfo_getAttribute;
+
+	devfs_registerDeviceNode(node);
+}
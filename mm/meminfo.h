@@ -0,0 +1,24 @@
+/*
+ * meminfo.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: pascal
+ */
+
+/**
+ * \file
+ * Memory statistics of the kernel exported as the device /dev/meminfo.
+ *
+ * The text is generated on every read from counters which are maintained by the memory managers anyway. Apart from the
+ * short per cache locks of the slab allocator no lock is taken so reading the file does not stall the system.
+ */
+
+#ifndef MEMINFO_H_
+#define MEMINFO_H_
+
+/**
+ * \brief Registers the device node meminfo in the devfs.
+ */
+void meminfo_Init(void);
+
+#endif /* MEMINFO_H_ */
@@ -17,6 +17,10 @@
 #define USERSPACE_END		0xFFFFFF7FFFFFFFFF		//Userspace Ende
 #define MAX_ADDRESS			0xFFFFFFFFFFFFFFFF		//Maximale Adresse
 
+//Der gesamte physische Speicher ist ab dieser Adresse im Kernel gemappt
+#define MAPPED_PHYS_MEM_BASE		0xFFFFFF8000000000
+#define MAPPED_PHYS_MEM_GET(addr)	((void*)(MAPPED_PHYS_MEM_BASE + (uintptr_t)(addr)))
+
 #define MM_KERN_STACK_SIZE	(4 * MM_BLOCK_SIZE)		//Stackgrösse für einen Thread im Kernelspace
 
 #define MM_USER_STACK		USERSPACE_END			//Stackaddresse für Prozesse
@@ -12,6 +12,18 @@
 #include "pmm.h"
 #include "memory.h"
 #include "scheduler.h"
+#include "vfs.h"
+#include <sys/mman.h>
+
+#define MIN(a, b)	((a < b) ? a : b)
+#ifdef DEBUGMODE
+#include "thread.h"
+#include "stdlib.h"
+#include "malloc.h"
+#include "string.h"
+#include "stdio.h"
+#include "pit.h"
+#endif
 
 //Speicherverwaltung
 bool mm_Init(const mmap *map, uint32_t map_length)
@@ -35,6 +47,134 @@ void mm_Free(void *Address, uint64_t Pages)
 	vmm_Free(currentProcess->Context, Address, Pages);
 }
 
+/*
+ * Markiert Pages als unbenutzt. Der physische Speicher wird freigegeben und beim nächsten Zugriff neu alloziiert.
+ * Parameter:	Address = virt. Adresse des Speicherbereichs
+ * 				Pages = Anzahl Pages
+ */
+void mm_Unuse(void *Address, uint64_t Pages)
+{
+	if(!vmm_userspacePointerValid(Address, Pages * MM_BLOCK_SIZE))
+		return;
+	vmm_unusePages(currentProcess->Context, Address, Pages);
+}
+
+//Zugriffsrechte für mmap und mprotect
+static uint8_t getProtectionFlags(int prot)
+{
+	uint8_t flags = VMM_FLAGS_USER;
+	if(prot == PROT_NONE)
+		flags |= VMM_FLAGS_NO_ACCESS;
+	if(prot & PROT_WRITE)
+		flags |= VMM_FLAGS_WRITE;
+	if(!(prot & PROT_EXEC))
+		flags |= VMM_FLAGS_NX;
+	return flags;
+}
+
+/*
+ * Mappt einen Bereich, dessen Pages aus dem Page Cache einer Datei geladen werden.
+ * Rückgabewert:	Adresse des Bereichs oder NULL bei Fehler
+ */
+static void *mapFile(context_t *context, void *address, size_t pages, uint8_t vmm_flags, int flags, vfs_file_t fd, uint64_t offset)
+{
+	if(offset & (MM_BLOCK_SIZE - 1))
+		return NULL;
+
+	vfs_stream_t *stream = vfs_getUserspaceStream(currentProcess, fd);
+	if(stream == NULL)
+		return NULL;
+
+	//In geteilte beschreibbare Mappings wird zurückgeschrieben
+	const bool shared = flags & MAP_SHARED;
+	const vfs_mode_t mode = vfs_getStreamMode(stream);
+	void *mapped = NULL;
+	if((mode & VFS_MODE_READ) && (!shared || !(vmm_flags & VMM_FLAGS_WRITE) || (mode & VFS_MODE_WRITE)))
+	{
+		const uint64_t fileSize = vfs_getFileinfo(stream, VFS_INFO_FILESIZE);
+		const size_t dataSize = (fileSize > offset) ? MIN(fileSize - offset, pages * MM_BLOCK_SIZE) : 0;
+		vmm_page_cache_t *cache = vfs_getPageCache(stream, offset / MM_BLOCK_SIZE + pages);
+		if(cache != NULL)
+		{
+			if(flags & MAP_FIXED)
+				vmm_UnMap(context, address, pages, true);
+			mapped = vmm_MapFileCached(context, address, pages, vmm_flags, stream, offset, dataSize, cache, shared);
+			if(mapped == NULL && address != NULL && !(flags & MAP_FIXED))
+				mapped = vmm_MapFileCached(context, NULL, pages, vmm_flags, stream, offset, dataSize, cache, shared);
+			REFCOUNT_RELEASE(cache);
+		}
+	}
+	vfs_Close(stream);
+	return mapped;
+}
+
+/*
+ * Mappt einen Bereich in den Userspace. Anonyme Bereiche werden beim ersten Zugriff alloziiert. Mit PROT_NONE wird
+ * der Bereich nur reserviert, mit mprotect werden die Pages später freigegeben.
+ * Dateien werden über den Page Cache der Datei gemappt, bei MAP_SHARED werden Änderungen zurückgeschrieben.
+ * Parameter:		address = gewünschte Adresse (ohne MAP_FIXED nur ein Hinweis) oder NULL
+ * 					length = Grösse des Bereichs in Bytes
+ * 					protFlags = Zugriffsrechte (PROT_*) in den unteren 32 Bits, MAP_* in den oberen 32 Bits
+ * 					fd = Stream der Datei (nicht bei MAP_ANONYMOUS)
+ * 					offset = Offset in der Datei (muss an einer Page ausgerichtet sein)
+ * Rückgabewert:	Adresse des Bereichs oder NULL bei Fehler
+ */
+void *mm_syscall_mmap(void *address, size_t length, uint64_t protFlags, uint64_t fd, uint64_t offset)
+{
+	const int prot = (uint32_t)protFlags;
+	const int flags = protFlags >> 32;
+	if(length == 0 || length > USERSPACE_END - USERSPACE_START || ((uintptr_t)address & (MM_BLOCK_SIZE - 1)))
+		return NULL;
+	//Ohne Adresse würde MAP_FIXED ab 0 (Kernelspace) ersetzen
+	if(address == NULL && (flags & MAP_FIXED))
+		return NULL;
+
+	context_t *context = currentProcess->Context;
+	const size_t pages = (length + MM_BLOCK_SIZE - 1) / MM_BLOCK_SIZE;
+	const uint8_t vmm_flags = getProtectionFlags(prot) | ((flags & MAP_POPULATE) ? VMM_FLAGS_ALLOCATE : 0);
+	if(address != NULL && !vmm_userspacePointerValid(address, pages * MM_BLOCK_SIZE))
+	{
+		if(flags & MAP_FIXED)
+			return NULL;
+		address = NULL;
+	}
+
+	if(!(flags & MAP_ANONYMOUS))
+		return mapFile(context, address, pages, vmm_flags & ~VMM_FLAGS_ALLOCATE, flags, fd, offset);
+
+	//Bestehende Mappings werden ersetzt
+	if(flags & MAP_FIXED)
+		vmm_UnMap(context, address, pages, true);
+	void *mapped = vmm_Map(context, address, 0, pages, vmm_flags);
+	if(mapped == NULL && address != NULL && !(flags & MAP_FIXED))
+		mapped = vmm_Map(context, NULL, 0, pages, vmm_flags);
+	return mapped;
+}
+
+int mm_syscall_munmap(void *address, size_t length)
+{
+	if(length == 0 || ((uintptr_t)address & (MM_BLOCK_SIZE - 1)) || !vmm_userspacePointerValid(address, length))
+		return -1;
+	vmm_UnMap(currentProcess->Context, address, (length + MM_BLOCK_SIZE - 1) / MM_BLOCK_SIZE, true);
+	return 0;
+}
+
+int mm_syscall_msync(void *address, size_t length)
+{
+	if(((uintptr_t)address & (MM_BLOCK_SIZE - 1)) || !vmm_userspacePointerValid(address, length))
+		return -1;
+	vmm_SyncFile(currentProcess->Context, address, (length + MM_BLOCK_SIZE - 1) / MM_BLOCK_SIZE);
+	return 0;
+}
+
+int mm_syscall_mprotect(void *address, size_t length, int prot)
+{
+	if(((uintptr_t)address & (MM_BLOCK_SIZE - 1)) || !vmm_userspacePointerValid(address, length))
+		return -1;
+	const size_t pages = (length + MM_BLOCK_SIZE - 1) / MM_BLOCK_SIZE;
+	return vmm_Protect(currentProcess->Context, address, pages, getProtectionFlags(prot)) ? 0 : -1;
+}
+
 //System
 /*
  * Reserviert Speicher für das System
@@ -65,3 +205,194 @@ bool mm_SysFree(void *Address, uint64_t Size)
 	vmm_SysFree(Address, Size);
 	return true;
 }
+
+#ifdef DEBUGMODE
+#define HEAP_TEST_THREADS		4
+#define HEAP_TEST_ITERATIONS	20000
+#define HEAP_TEST_SLOTS			64
+
+#define HEAP_BENCHMARK_TIME		200		//Dauer einer Messung von mm_heapBenchmark in ms
+#define HEAP_BENCHMARK_BLOCKS	1024	//Gleichzeitig reservierte Blöcke
+#define HEAP_BENCHMARK_BUFFER	(64 * 1024)
+
+static size_t heapTestRunning;
+
+static void checkBlock(const uint8_t *block, size_t size, uint8_t pattern)
+{
+	for(size_t i = 0; i < size; i++)
+	{
+		if(block[i] != pattern)
+			Panic("MM", "Heap-Stresstest: Speicherblock wurde ueberschrieben");
+	}
+}
+
+/*
+ * Reserviert und gibt zufällig Speicherblöcke frei und prüft dabei, dass kein anderer Thread die Blöcke überschreibt
+ */
+static void __attribute__((noreturn)) heapStressThread()
+{
+	uint8_t *blocks[HEAP_TEST_SLOTS] = {NULL};
+	size_t sizes[HEAP_TEST_SLOTS];
+	uint8_t pattern = currentThread->tid;
+	uint64_t seed = (uintptr_t)currentThread | 1;
+
+	for(size_t i = 0; i < HEAP_TEST_ITERATIONS; i++)
+	{
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		size_t slot = seed % HEAP_TEST_SLOTS;
+		//Mostly small blocks which are served by the per cpu caches and sometimes bigger ones
+		size_t size = (seed >> 8) % ((seed & 0xF) ? 256 : 16384) + 1;
+
+		if(blocks[slot] == NULL)
+		{
+			blocks[slot] = malloc(size);
+			if(blocks[slot] == NULL)
+				Panic("MM", "Heap-Stresstest: malloc fehlgeschlagen");
+			memset(blocks[slot], pattern, size);
+			sizes[slot] = size;
+		}
+		else if((seed & 0x30) == 0)
+		{
+			checkBlock(blocks[slot], sizes[slot], pattern);
+			blocks[slot] = realloc(blocks[slot], size);
+			if(blocks[slot] == NULL)
+				Panic("MM", "Heap-Stresstest: realloc fehlgeschlagen");
+			checkBlock(blocks[slot], (size < sizes[slot]) ? size : sizes[slot], pattern);
+			memset(blocks[slot], pattern, size);
+			sizes[slot] = size;
+		}
+		else
+		{
+			checkBlock(blocks[slot], sizes[slot], pattern);
+			free(blocks[slot]);
+			blocks[slot] = NULL;
+		}
+	}
+
+	for(size_t slot = 0; slot < HEAP_TEST_SLOTS; slot++)
+	{
+		if(blocks[slot] != NULL)
+		{
+			checkBlock(blocks[slot], sizes[slot], pattern);
+			free(blocks[slot]);
+		}
+	}
+
+	if(__sync_sub_and_fetch(&heapTestRunning, 1) == 0)
+		SysLog("MM", "Heap-Stresstest erfolgreich");
+
+	//Kernelthreads können nicht beendet werden
+	while(1) thread_block_self(NULL, NULL, THREAD_BLOCKED_WAIT);
+}
+
+/*
+ * Startet mehrere Kernelthreads, welche gleichzeitig den Kernelheap benutzen
+ */
+void mm_heapStressTest()
+{
+	heapTestRunning = HEAP_TEST_THREADS;
+	for(size_t i = 0; i < HEAP_TEST_THREADS; i++)
+	{
+		ERROR_TYPE_POINTER(thread_t) thread = thread_create(&kernel_process, heapStressThread, 0, NULL, true);
+		if(ERROR_DETECT(thread))
+			Panic("MM", "Heap-Stresstest: Thread konnte nicht erstellt werden");
+		thread_unblock(ERROR_GET_VALUE(thread));
+	}
+}
+static uint8_t *benchmarkBlocks[HEAP_BENCHMARK_BLOCKS];
+
+/*
+ * Gibt für HEAP_BENCHMARK_TIME ms zufällig einen der HEAP_BENCHMARK_BLOCKS Blöcke frei und reserviert einen neuen
+ * Block mit zufälliger Grösse.
+ * Parameter:	minSize = kleinste Grösse der Blöcke
+ * 				maxSize = grösste Grösse der Blöcke
+ * Rückgabewert:	Nanosekunden pro free() und malloc()
+ */
+static uint64_t benchmarkMalloc(size_t minSize, size_t maxSize)
+{
+	uint64_t seed = 0x2545F4914F6CDD1Dul;
+	uint64_t operations = 0;
+
+	for(size_t i = 0; i < HEAP_BENCHMARK_BLOCKS; i++)
+		benchmarkBlocks[i] = malloc(minSize);
+
+	uint64_t start = pit_getUptime(), elapsed = 0;
+	while(elapsed < HEAP_BENCHMARK_TIME)
+	{
+		for(size_t i = 0; i < HEAP_BENCHMARK_BLOCKS; i++)
+		{
+			seed ^= seed << 13;
+			seed ^= seed >> 7;
+			seed ^= seed << 17;
+			size_t slot = seed % HEAP_BENCHMARK_BLOCKS;
+			free(benchmarkBlocks[slot]);
+			benchmarkBlocks[slot] = malloc(minSize + (seed >> 16) % (maxSize - minSize + 1));
+		}
+		operations += HEAP_BENCHMARK_BLOCKS;
+		elapsed = pit_getUptime() - start;
+	}
+
+	for(size_t i = 0; i < HEAP_BENCHMARK_BLOCKS; i++)
+		free(benchmarkBlocks[i]);
+
+	return elapsed * 1000000 / operations;
+}
+
+/*
+ * Reserviert für HEAP_BENCHMARK_TIME ms einen Puffer, beschreibt jede seiner Pages und gibt ihn wieder frei.
+ * Parameter:	trim = nach jedem free() alle freien Pages zurückgeben, wie es free() früher selbst gemacht hat
+ * 				calls = erhält die Aufrufe von vmm_unusePages pro 1000 Durchläufe
+ * Rückgabewert:	Nanosekunden pro Durchlauf
+ */
+static uint64_t benchmarkBuffer(bool trim, uint64_t *calls)
+{
+	extern size_t heap_releaseCalls;
+	uint64_t operations = 0;
+	size_t startCalls = heap_releaseCalls;
+
+	uint64_t start = pit_getUptime(), elapsed = 0;
+	while(elapsed < HEAP_BENCHMARK_TIME)
+	{
+		for(size_t i = 0; i < 64; i++)
+		{
+			uint8_t *buffer = malloc(HEAP_BENCHMARK_BUFFER);
+			if(buffer == NULL)
+				Panic("MM", "Heap-Benchmark: malloc fehlgeschlagen");
+			for(size_t offset = 0; offset < HEAP_BENCHMARK_BUFFER; offset += MM_BLOCK_SIZE)
+				buffer[offset] = offset;
+			free(buffer);
+			if(trim)
+				malloc_trim(0);
+		}
+		operations += 64;
+		elapsed = pit_getUptime() - start;
+	}
+
+	*calls = (heap_releaseCalls - startCalls) * 1000 / operations;
+	return elapsed * 1000000 / operations;
+}
+
+/*
+ * Misst die Geschwindigkeit des Kernelheaps mit einem Thread. Die Ergebnisse können mit denen anderer Versionen
+ * verglichen werden.
+ */
+void mm_heapBenchmark()
+{
+	char msg[80];
+
+	sprintf(msg, "malloc/free 16-512 Bytes: %lu ns", benchmarkMalloc(16, 512));
+	SysLog("MM", msg);
+	sprintf(msg, "malloc/free 16-4096 Bytes: %lu ns", benchmarkMalloc(16, 4096));
+	SysLog("MM", msg);
+
+	uint64_t time, calls;
+	time = benchmarkBuffer(false, &calls);
+	sprintf(msg, "Puffer 64KiB: %lu ns, %lu unusePages pro 1000", time, calls);
+	SysLog("MM", msg);
+	time = benchmarkBuffer(true, &calls);
+	sprintf(msg, "Puffer 64KiB mit malloc_trim: %lu ns, %lu unusePages pro 1000", time, calls);
+	SysLog("MM", msg);
+}
+#endif
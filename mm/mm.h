@@ -11,14 +11,26 @@
 #include "stdint.h"
 #include "paging.h"
 #include "stdbool.h"
+#include "stddef.h"
 #include "multiboot.h"
 
 //Speicherverwaltung
 bool mm_Init(const mmap *map, uint32_t map_length);
 void *mm_Alloc(uint64_t Size);
 void mm_Free(void *Address, uint64_t Size);
+void mm_Unuse(void *Address, uint64_t Pages);
+
+void *mm_syscall_mmap(void *address, size_t length, uint64_t protFlags, uint64_t fd, uint64_t offset);
+int mm_syscall_munmap(void *address, size_t length);
+int mm_syscall_msync(void *address, size_t length);
+int mm_syscall_mprotect(void *address, size_t length, int prot);
 
 void *mm_SysAlloc(uint64_t Size);
 bool mm_SysFree(void *Address, uint64_t Size);
 
+#ifdef DEBUGMODE
+void mm_heapStressTest();
+void mm_heapBenchmark();
+#endif
+
 #endif /* MM_H_ */
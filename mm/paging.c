@@ -8,7 +8,6 @@
 #include "paging.h"
 #include "cpu.h"
 
-inline void FlushTLB(void);
 
 /*Flags:
  * Present: 1: Page ist im Speicher; 0: Page ist nicht im Speicher, der ganze Eintrag wird ignoriert
@@ -116,9 +115,71 @@ void clearPTEntry(uint16_t i, PT_t *PT)
  */
 void InvalidateTLBEntry(void *Address)
 {
-	asm volatile("invlpg (%0)" : :"r" (Address));
+	asm volatile("invlpg (%0)" : :"r" (Address): "memory");
 }
 
-inline void FlushTLB() {
+void InvalidateTLBRange(void *Address, size_t Pages, bool global)
+{
+	if(Pages > PG_TLB_FLUSH_THRESHOLD)
+	{
+		if(global)
+			FlushTLBGlobal();
+		else
+			FlushTLB();
+	}
+	else
+	{
+		for(size_t i = 0; i < Pages; i++)
+			InvalidateTLBEntry(Address + i * MAP);
+	}
+}
+
+/*
+ * Leert alle nicht globalen Einträge der aktuellen PCID
+ */
+void FlushTLB() {
 	cpu_writeControlRegister(CPU_CR3, cpu_readControlRegister(CPU_CR3));
 }
+
+/*
+ * Leert alle Einträge inklusive der globalen Pages und aller PCIDs
+ */
+void FlushTLBGlobal() {
+	if(cpuInfo.invpcid)
+	{
+		struct {
+			uint64_t pcid;
+			uint64_t address;
+		} descriptor = {};
+		asm volatile("invpcid %0, %1":: "m"(descriptor), "r"(2ul): "memory");
+	}
+	else if(cpuInfo.GlobalPage)
+	{
+		//Das Ändern von CR4.PGE leert den ganzen TLB
+		uint64_t cr4 = cpu_readControlRegister(CPU_CR4);
+		cpu_writeControlRegister(CPU_CR4, cr4 ^ (1 << 7));
+		cpu_writeControlRegister(CPU_CR4, cr4);
+	}
+	else
+	{
+		FlushTLB();
+	}
+}
+
+void InvalidatePCIDEntry(uint16_t pcid, void *Address)
+{
+	struct {
+		uint64_t pcid;
+		uint64_t address;
+	} descriptor = {pcid, (uintptr_t)Address};
+	asm volatile("invpcid %0, %1":: "m"(descriptor), "r"(0ul): "memory");
+}
+
+void InvalidatePCID(uint16_t pcid)
+{
+	struct {
+		uint64_t pcid;
+		uint64_t address;
+	} descriptor = {pcid, 0};
+	asm volatile("invpcid %0, %1":: "m"(descriptor), "r"(1ul): "memory");
+}
@@ -10,6 +10,7 @@
 
 #include "stdint.h"
 #include "stdbool.h"
+#include "stddef.h"
 #include "pmm.h"
 
 /*Pagingstrukturen
@@ -33,12 +34,18 @@
 #define PG_D		0x40
 #define PG_PAT		0x80
 #define PG_G		0x100LL
+//Nur in PDPE und PDE vorhanden
+#define PG_PS		0x80
 //Allgemein
 #define PG_AVL1		0xE00LL
 #define PG_ADDRESS	0xFFFFFFFFFF000LL
 #define PG_AVL2		0x7FF0000000000000LL
 #define PG_NX		0x8000000000000000LL
 #define PG_AVL(Entry)	(((Entry & PG_AVL1) | ((Entry & PG_AVL2) >> 40)) >> 9)
+#define PG_AVL_BITS(avl)	((((uint64_t)(avl) << 9) & PG_AVL1) | (((uint64_t)(avl) << 49) & PG_AVL2))
+//Adresse einer 2MiB bzw. 1GiB Page
+#define PG_LARGE_ADDRESS	0xFFFFFFFE00000LL
+#define PG_HUGE_ADDRESS		0xFFFFFC0000000LL
 
 //Indices der Tabellen in der virtuellen Addresse
 #define PG_PML4_INDEX	0xFF8000000000
@@ -47,6 +54,8 @@
 #define PG_PT_INDEX		0x1FF000
 
 #define PG_PAGE_SIZE				4096
+#define PG_LARGE_PAGE_SIZE			0x200000		//2MiB
+#define PG_HUGE_PAGE_SIZE			0x40000000		//1GiB
 #define PG_PAGE_ALIGN_ROUND_DOWN(n)	((n) & PG_ADDRESS)
 #define PG_PAGE_ALIGN_ROUND_UP(n)	(((n) + ~PG_ADDRESS) & PG_ADDRESS)
 #define PG_NUM_PAGES(size)			(PG_PAGE_ALIGN_ROUND_UP(size) / PG_PAGE_SIZE)
@@ -54,6 +63,10 @@
 #define MAP				4096	//Anzahl der Bytes pro Map (4kb)
 #define PAGE_ENTRIES	512		//Anzahl der Einträge pro Tabelle
 
+#define PG_TLB_FLUSH_THRESHOLD	32		//Ab so vielen Pages wird der ganze TLB geleert statt einzelne Einträge
+#define PG_CR3_NOFLUSH			(1ul << 63)	//TLB-Einträge der PCID beim Schreiben von CR3 behalten
+#define PG_CR3_PCID				0xFFF
+
 typedef union {
 	struct {
 		bool P: 1;
@@ -106,4 +119,19 @@ void clearPDEntry(uint16_t i, PD_t *PD);
 void clearPTEntry(uint16_t i, PT_t *PT);
 
 void InvalidateTLBEntry(void *Address);
+
+/*
+ * Invalidiert die Pages eines Bereichs im aktuellen Adressraum. Bei mehr als PG_TLB_FLUSH_THRESHOLD Pages wird
+ * der ganze TLB geleert (mit global = true auch die globalen Pages).
+ */
+void InvalidateTLBRange(void *Address, size_t Pages, bool global);
+
+void FlushTLB(void);
+void FlushTLBGlobal(void);
+
+/*
+ * Invalidiert eine Page bzw. alle Pages einer PCID (nur mit INVPCID)
+ */
+void InvalidatePCIDEntry(uint16_t pcid, void *Address);
+void InvalidatePCID(uint16_t pcid);
 #endif /* PAGING_H_ */
@@ -14,6 +14,11 @@
 #include "string.h"
 #include "assert.h"
 #include "stdio.h"
+#include "lock.h"
+#include "cpu.h"
+#ifdef DEBUGMODE
+#include "pit.h"
+#endif
 
 #define PMM_BITS_PER_ELEMENT	(sizeof(*Map) * 8)
 #define PMM_MAP_ALIGN_SIZE(x)	((x + (sizeof(*Map) - 1)) & ~(sizeof(*Map) - 1))
@@ -23,19 +28,592 @@
 #define MAX(a, b)				((a > b) ? a : b)
 #define MIN(a, b)				((a < b) ? a : b)
 
+#define PMM_ORDERS				19			//Blocks from 1 page (order 0) up to 1GiB (order 18)
+#define PMM_NO_PAGE				UINT32_MAX
+
+#define PMM_PAGE_FREE_BLOCK		(1 << 0)	//Page is the first page of a free block
+
+#define PMM_CACHE_SIZE			(2 * PMM_CACHE_BATCH)
+
+#define PMM_ZERO_POOL_SIZE		256			//Maximum number of pre-zeroed pages (1MiB)
+#define PMM_ZERO_POOL_RESERVE	1024		//The pool is only refilled while more pages than this are free
+
+#define PMM_LARGE_RESERVE		4096		//pmm_AllocLarge leaves at least this many pages free in a zone (16MiB)
+
+#define PMM_LOW_PAGE_END		0x9F000		//The low page is taken below the EBDA
+
+#define PMM_BENCHMARK_TIME		200			//Duration of each measurement of pmm_benchmark in ms
+#define PMM_BENCHMARK_BATCH		64			//Number of blocks which are held at the same time by pmm_benchmark
+#define PMM_BENCHMARK_RANGE		(1ul << 18)	//Pages of the range which is searched by the search benchmark (1GiB)
+
+typedef struct{
+	uint32_t next, prev;	//Links of the free list the block is in
+	uint8_t order;			//Order of the block (only valid if PMM_PAGE_FREE_BLOCK is set)
+	uint8_t flags;
+	uint16_t refs;			//Number of additional owners of an allocated page (e.g. copy-on-write mappings)
+}pmm_page_t;
+
+//A zone has its own buddy allocator for the pages in [start, end)
+typedef struct{
+	size_t start, end;
+	uint32_t freeLists[PMM_ORDERS];
+	uint64_t freePages;
+	uint64_t totalPages;
+	lock_t lock;
+}zone_t;
+
+//Per cpu cache of single pages in front of the buddy allocator
+typedef struct{
+	lock_t lock;			//Only contended by pmm_markPageReserved, always taken before a zone lock
+	size_t count;
+	uint32_t pages[PMM_CACHE_SIZE];
+	pmm_cache_stats_t stats;
+	size_t searchHint[PMM_ZONE_COUNT];	//Next-fit hint for searches in the bitmap
+}pmm_cache_t;
+
 //Anfang und Ende des Kernels
 extern uint8_t kernel_start;
 extern uint8_t kernel_end;
 
 static uint64_t pmm_totalMemory;		//Maximal verfügbarer RAM (physisch)
 static uint64_t pmm_totalPages;			//Gesamtanzahl an phys. Pages
-static uint64_t pmm_freePages;			//Verfügbarer (freier) physischer Speicher (4kb)
 static uint64_t pmm_Kernelsize;			//Grösse des Kernels in Bytes
 
 //Ein Bit ist gesetzt, wenn die Page frei ist
 static uint64_t *Map;
 static size_t mapSize;			//Grösse der Bitmap
 
+//Summary of the bitmap: a bit is set if the corresponding element of the bitmap has any free page
+static uint64_t *Summary;
+
+//Buddy allocator: one entry per physical page and one free list per order and zone
+static pmm_page_t *Pages;
+static size_t pageCount;
+static zone_t zones[PMM_ZONE_COUNT] = {
+	[PMM_ZONE_DMA16]	{.start = 0, .end = PMM_ZONE_DMA16_END / MM_BLOCK_SIZE},
+	[PMM_ZONE_DMA32]	{.start = PMM_ZONE_DMA16_END / MM_BLOCK_SIZE, .end = PMM_ZONE_DMA32_END / MM_BLOCK_SIZE},
+	[PMM_ZONE_NORMAL]	{.start = PMM_ZONE_DMA32_END / MM_BLOCK_SIZE, .end = -1ul}
+};
+
+static pmm_cache_t pmm_caches[CPU_MAX_COUNT];
+
+static pmm_dma_stats_t dma_stats;
+
+//Pages which were zeroed while the cpu was idle
+static uint32_t zeroPool[PMM_ZERO_POOL_SIZE];
+static size_t zeroPoolCount;
+static lock_t zeroPoolLock = LOCK_INIT;
+static pmm_zero_stats_t zero_stats;
+
+//Page below 1MiB for the startup code of the application processors, memory below 1MiB is never freed
+static paddr_t lowPage = 1;
+
+static zone_t *getZone(size_t pfn)
+{
+	if(pfn < zones[PMM_ZONE_DMA16].end)
+		return &zones[PMM_ZONE_DMA16];
+	else if(pfn < zones[PMM_ZONE_DMA32].end)
+		return &zones[PMM_ZONE_DMA32];
+	return &zones[PMM_ZONE_NORMAL];
+}
+
+static void pmm_lockAcquire(zone_t *zone, lock_node_t *node, bool *irq)
+{
+	//The page fault handler allocates pages with interrupts disabled so we must not be preempted while holding the lock
+	*irq = cpu_disableInterrupts();
+	lock(&zone->lock, node);
+}
+
+static void pmm_lockRelease(zone_t *zone, lock_node_t *node, bool irq)
+{
+	unlock(&zone->lock, node);
+	cpu_restoreInterrupts(irq);
+}
+
+static bool isPageFree(size_t pfn)
+{
+	return (Map[pfn / PMM_BITS_PER_ELEMENT] >> (pfn % PMM_BITS_PER_ELEMENT)) & 1;
+}
+
+/*
+ * Sets or clears the bits of count pages starting at pfn in the bitmap
+ */
+static void markPages(size_t pfn, size_t count, bool free)
+{
+	while(count > 0)
+	{
+		size_t i = pfn / PMM_BITS_PER_ELEMENT;
+		uint8_t bit = pfn % PMM_BITS_PER_ELEMENT;
+		size_t bits = MIN(count, PMM_BITS_PER_ELEMENT - bit);
+		uint64_t mask = (bits == PMM_BITS_PER_ELEMENT) ? -1ul : ((1ul << bits) - 1) << bit;
+		if(free)
+			Map[i] |= mask;
+		else
+			Map[i] &= ~mask;
+
+		//An element of the summary never spans multiple zones so this is protected by the zone lock
+		uint64_t summary_mask = 1ul << (i % PMM_BITS_PER_ELEMENT);
+		if(Map[i])
+			Summary[i / PMM_BITS_PER_ELEMENT] |= summary_mask;
+		else
+			Summary[i / PMM_BITS_PER_ELEMENT] &= ~summary_mask;
+		pfn += bits;
+		count -= bits;
+	}
+}
+
+/*
+ * Searches the first free page in [pfn, end) with the help of the summary
+ * Rückgabewert:	pfn of the free page
+ * 					PMM_NO_PAGE if there is no free page in the range
+ */
+static size_t findFreePage(size_t pfn, size_t end)
+{
+	while(pfn < end)
+	{
+		size_t i = pfn / PMM_BITS_PER_ELEMENT;
+		uint64_t element = Map[i] & (-1ul << (pfn % PMM_BITS_PER_ELEMENT));
+		if(element != 0)
+		{
+			pfn = i * PMM_BITS_PER_ELEMENT + __builtin_ctzl(element);
+			return (pfn < end) ? pfn : PMM_NO_PAGE;
+		}
+
+		//Skip all elements of the bitmap without free pages
+		i++;
+		if(i * PMM_BITS_PER_ELEMENT >= end)
+			break;
+		size_t j = i / PMM_BITS_PER_ELEMENT;
+		uint64_t summary = Summary[j] & (-1ul << (i % PMM_BITS_PER_ELEMENT));
+		while(summary == 0)
+		{
+			j++;
+			if(j * PMM_BITS_PER_ELEMENT * PMM_BITS_PER_ELEMENT >= end)
+				return PMM_NO_PAGE;
+			summary = Summary[j];
+		}
+		pfn = (j * PMM_BITS_PER_ELEMENT + __builtin_ctzl(summary)) * PMM_BITS_PER_ELEMENT;
+	}
+	return PMM_NO_PAGE;
+}
+
+static void buddy_push(zone_t *zone, uint8_t order, size_t pfn)
+{
+	pmm_page_t *page = &Pages[pfn];
+	page->order = order;
+	page->flags |= PMM_PAGE_FREE_BLOCK;
+	page->prev = PMM_NO_PAGE;
+	page->next = zone->freeLists[order];
+	if(page->next != PMM_NO_PAGE)
+		Pages[page->next].prev = pfn;
+	zone->freeLists[order] = pfn;
+}
+
+static void buddy_remove(zone_t *zone, uint8_t order, size_t pfn)
+{
+	pmm_page_t *page = &Pages[pfn];
+	if(page->prev != PMM_NO_PAGE)
+		Pages[page->prev].next = page->next;
+	else
+		zone->freeLists[order] = page->next;
+	if(page->next != PMM_NO_PAGE)
+		Pages[page->next].prev = page->prev;
+	page->flags &= ~PMM_PAGE_FREE_BLOCK;
+}
+
+/*
+ * Splits the (already removed) block at pfn of order from into a block of order to.
+ * The upper halves are put back into the free lists.
+ */
+static void buddy_split(zone_t *zone, size_t pfn, uint8_t from, uint8_t to)
+{
+	while(from > to)
+	{
+		from--;
+		buddy_push(zone, from, pfn + (1ul << from));
+	}
+}
+
+/*
+ * Returns the first page of the free block which contains the free page pfn
+ */
+static size_t buddy_findBlock(size_t pfn)
+{
+	size_t head = pfn;
+	for(uint8_t order = 0; order < PMM_ORDERS; order++)
+	{
+		head = pfn & ~((1ul << order) - 1);
+		if((Pages[head].flags & PMM_PAGE_FREE_BLOCK) && Pages[head].order >= order)
+			break;
+	}
+	return head;
+}
+
+/*
+ * Takes a block of the requested order from the free lists
+ * Rückgabewert:	pfn of the first page of the block
+ * 					PMM_NO_PAGE if no block is available
+ */
+static size_t buddy_alloc(zone_t *zone, uint8_t order)
+{
+	uint8_t o;
+	for(o = order; o < PMM_ORDERS && zone->freeLists[o] == PMM_NO_PAGE; o++);
+	if(o >= PMM_ORDERS)
+		return PMM_NO_PAGE;
+
+	size_t pfn = zone->freeLists[o];
+	buddy_remove(zone, o, pfn);
+	buddy_split(zone, pfn, o, order);
+
+	markPages(pfn, 1ul << order, false);
+	zone->freePages -= 1ul << order;
+	return pfn;
+}
+
+/*
+ * Returns a block to the free lists and merges it with its buddies
+ */
+static void buddy_free(zone_t *zone, size_t pfn, uint8_t order)
+{
+	markPages(pfn, 1ul << order, true);
+	zone->freePages += 1ul << order;
+
+	while(order < PMM_ORDERS - 1)
+	{
+		//Blocks never cross zone boundaries
+		size_t buddy = pfn ^ (1ul << order);
+		if(buddy < zone->start || buddy >= zone->end || !(Pages[buddy].flags & PMM_PAGE_FREE_BLOCK) || Pages[buddy].order != order)
+			break;
+		buddy_remove(zone, order, buddy);
+		pfn &= ~(1ul << order);
+		order++;
+	}
+	buddy_push(zone, order, pfn);
+}
+
+/*
+ * Frees an arbitrary range of pages by splitting it into naturally aligned blocks
+ */
+static void buddy_freeRange(zone_t *zone, size_t pfn, size_t count)
+{
+	while(count > 0)
+	{
+		uint8_t order = 0;
+		while(order < PMM_ORDERS - 1 && (pfn & ((2ul << order) - 1)) == 0 && (2ul << order) <= count)
+			order++;
+		buddy_free(zone, pfn, order);
+		pfn += 1ul << order;
+		count -= 1ul << order;
+	}
+}
+
+static uint8_t buddy_order(size_t pages)
+{
+	uint8_t order = 0;
+	while((1ul << order) < pages)
+		order++;
+	return order;
+}
+
+/*
+ * Frees an arbitrary range of pages which may span multiple zones
+ */
+static void pmm_freeRange(size_t pfn, size_t count)
+{
+	size_t end = pfn + count;
+	while(pfn < end)
+	{
+		zone_t *zone = getZone(pfn);
+		size_t zone_end = MIN(end, zone->end);
+		buddy_freeRange(zone, pfn, zone_end - pfn);
+		pfn = zone_end;
+	}
+}
+
+/*
+ * Takes up to PMM_CACHE_BATCH pages from the buddy allocators and puts them into the cache.
+ * The zones are used from the highest to the lowest so that ordinary allocations don't use up the DMA zones.
+ * Must be called with interrupts disabled and the lock of the cache held.
+ */
+static void pmm_cacheRefill(pmm_cache_t *cache)
+{
+	for(int z = PMM_ZONE_COUNT - 1; z >= 0 && cache->count < PMM_CACHE_BATCH; z--)
+	{
+		zone_t *zone = &zones[z];
+		lock_node_t node;
+		size_t pfn;
+
+		if(zone->freePages == 0)
+			continue;
+
+		lock(&zone->lock, &node);
+		while(cache->count < PMM_CACHE_BATCH && (pfn = buddy_alloc(zone, 0)) != PMM_NO_PAGE)
+			cache->pages[cache->count++] = pfn;
+		unlock(&zone->lock, &node);
+	}
+	cache->stats.refills++;
+}
+
+/*
+ * Gives count pages of the cache back to the buddy allocators of their zones.
+ * Must be called with interrupts disabled and the lock of the cache held.
+ */
+static void pmm_cacheDrain(pmm_cache_t *cache, size_t count)
+{
+	zone_t *zone = NULL;
+	lock_node_t node;
+
+	while(count-- > 0 && cache->count > 0)
+	{
+		size_t pfn = cache->pages[--cache->count];
+		if(getZone(pfn) != zone)
+		{
+			if(zone != NULL)
+				unlock(&zone->lock, &node);
+			zone = getZone(pfn);
+			lock(&zone->lock, &node);
+		}
+		if(isPageFree(pfn))
+			printf("\e[33;mWarning:\e[0m Freed page which was already freed (0x%X)\n", pfn * MM_BLOCK_SIZE);
+		else
+			buddy_free(zone, pfn, 0);
+	}
+	if(zone != NULL)
+		unlock(&zone->lock, &node);
+	cache->stats.drains++;
+}
+
+#ifdef DEBUGMODE
+/*
+ * Checks the consistency of the buddy allocator by allocating and freeing blocks of all sizes
+ */
+static void pmm_selfTest()
+{
+	uint64_t freePages = pmm_getFreePages();
+	paddr_t pages[PMM_ORDERS];
+
+	for(uint8_t order = 0; order < PMM_ORDERS; order++)
+	{
+		pages[order] = pmm_AllocDMA(-1ul, 1ul << order);
+		if(pages[order] == 1)
+			continue;
+		assert((pages[order] / MM_BLOCK_SIZE) % (1ul << order) == 0);
+		for(size_t i = 0; i < (1ul << order); i++)
+			assert(!isPageFree(pages[order] / MM_BLOCK_SIZE + i));
+	}
+	for(uint8_t order = 0; order < PMM_ORDERS; order++)
+	{
+		if(pages[order] == 1)
+			continue;
+		for(size_t i = 0; i < (1ul << order); i++)
+			pmm_Free(pages[order] + i * MM_BLOCK_SIZE);
+	}
+	assert(pmm_getFreePages() == freePages);
+
+	//After freeing everything there must be no pair of free buddies left
+	for(uint8_t z = 0; z < PMM_ZONE_COUNT; z++)
+	{
+		const zone_t *zone = &zones[z];
+		for(uint8_t order = 0; order < PMM_ORDERS - 1; order++)
+		{
+			for(size_t pfn = zone->freeLists[order]; pfn != PMM_NO_PAGE; pfn = Pages[pfn].next)
+			{
+				size_t buddy = pfn ^ (1ul << order);
+				assert(pfn >= zone->start && pfn < zone->end);
+				assert(buddy < zone->start || buddy >= zone->end || !(Pages[buddy].flags & PMM_PAGE_FREE_BLOCK) || Pages[buddy].order != order);
+			}
+		}
+	}
+
+	//DMA allocations must be served from the requested zone
+	paddr_t dma = pmm_AllocDMA(PMM_ZONE_DMA16_END, 1);
+	if(dma != 1)
+	{
+		assert(dma < PMM_ZONE_DMA16_END);
+		pmm_Free(dma);
+	}
+	SysLog("PMM", "Selbsttest erfolgreich");
+}
+
+/*
+ * Reserves and frees blocks of the given size for PMM_BENCHMARK_TIME ms
+ * Rückgabewert:	allocations per second
+ */
+static uint64_t benchmarkAlloc(paddr_t maxAddress, size_t size)
+{
+	paddr_t blocks[PMM_BENCHMARK_BATCH];
+	uint64_t allocations = 0;
+	uint64_t start = pit_getUptime(), elapsed = 0;
+
+	while(elapsed < PMM_BENCHMARK_TIME)
+	{
+		size_t count;
+		for(count = 0; count < PMM_BENCHMARK_BATCH; count++)
+		{
+			blocks[count] = (size == 1 && maxAddress == -1ul) ? pmm_Alloc() : pmm_AllocDMA(maxAddress, size);
+			if(blocks[count] == 1)
+				break;
+		}
+		for(size_t i = 0; i < count; i++)
+		{
+			for(size_t j = 0; j < size; j++)
+				pmm_Free(blocks[i] + j * MM_BLOCK_SIZE);
+		}
+		allocations += count;
+		if(count == 0)
+			break;
+		elapsed = pit_getUptime() - start;
+	}
+
+	return (elapsed > 0) ? allocations * 1000 / elapsed : 0;
+}
+
+typedef enum{
+	SEARCH_LINEAR,			//Scan of every bitmap element from the start of the range like the old allocator did
+	SEARCH_SUMMARY,			//findFreePage from the start of the range
+	SEARCH_SUMMARY_HINT		//findFreePage from a next-fit hint like buddy_allocBelow
+}search_method_t;
+
+static volatile size_t benchmarkResult;
+
+static size_t scanLinear(size_t pfn, size_t end)
+{
+	for(size_t i = pfn / PMM_BITS_PER_ELEMENT; i * PMM_BITS_PER_ELEMENT < end; i++)
+	{
+		uint64_t element = Map[i] & ((i == pfn / PMM_BITS_PER_ELEMENT) ? (-1ul << (pfn % PMM_BITS_PER_ELEMENT)) : -1ul);
+		if(element != 0)
+		{
+			size_t free = i * PMM_BITS_PER_ELEMENT + __builtin_ctzl(element);
+			return (free < end) ? free : PMM_NO_PAGE;
+		}
+	}
+	return PMM_NO_PAGE;
+}
+
+/*
+ * Searches free pages in [start, end) with the given method for PMM_BENCHMARK_TIME ms. The bitmap is only read.
+ * Rückgabewert:	searches per second
+ */
+static uint64_t benchmarkSearch(size_t start, size_t end, search_method_t method)
+{
+	uint64_t searches = 0;
+	uint64_t begin = pit_getUptime(), elapsed = 0;
+	size_t hint = start;
+
+	while(elapsed < PMM_BENCHMARK_TIME)
+	{
+		for(size_t i = 0; i < PMM_BENCHMARK_BATCH; i++)
+		{
+			size_t pfn;
+			if(method == SEARCH_LINEAR)
+			{
+				pfn = scanLinear(start, end);
+			}
+			else if(method == SEARCH_SUMMARY)
+			{
+				pfn = findFreePage(start, end);
+			}
+			else
+			{
+				pfn = findFreePage(hint, end);
+				if(pfn == PMM_NO_PAGE)
+					pfn = findFreePage(start, hint);
+				hint = (pfn == PMM_NO_PAGE || pfn + 1 >= end) ? start : pfn + 1;
+			}
+			benchmarkResult = pfn;
+		}
+		searches += PMM_BENCHMARK_BATCH;
+		elapsed = pit_getUptime() - begin;
+	}
+
+	return (elapsed > 0) ? searches * 1000 / elapsed : 0;
+}
+
+/*
+ * Compares the search in the bitmap with and without summary and hint at 10%, 50% and 95% use of a range of the DMA32
+ * zone. The range is filled from its start with pages from pmm_AllocDMA, so it is nearly full at its beginning.
+ * The allocated pages are linked through their first bytes.
+ */
+static void benchmarkSearchRange()
+{
+	static const uint8_t usage[] = {10, 50, 95};
+	const zone_t *zone = &zones[PMM_ZONE_DMA32];
+	char msg[100];
+
+	if(zone->end <= zone->start + 1)
+	{
+		SysLog("PMM", "Suche: keine DMA32 Zone vorhanden");
+		return;
+	}
+
+	//The end lies inside the zone so that pmm_AllocDMA uses the next-fit search
+	size_t start = zone->start;
+	size_t end = MIN(start + PMM_BENCHMARK_RANGE, zone->end - 1);
+	size_t freePages = 0;
+	for(size_t pfn = start; pfn < end; pfn++)
+		freePages += isPageFree(pfn);
+
+	paddr_t list = 0;
+	for(size_t i = 0; i < sizeof(usage) / sizeof(*usage); i++)
+	{
+		while(freePages > (end - start) * (100 - usage[i]) / 100)
+		{
+			paddr_t page = pmm_AllocDMA(end * MM_BLOCK_SIZE, 1);
+			if(page == 1)
+				break;
+			*(paddr_t*)MAPPED_PHYS_MEM_GET(page) = list;
+			list = page;
+			if(page / MM_BLOCK_SIZE >= start)
+				freePages--;
+		}
+
+		sprintf(msg, "Suche bei %lu%% Belegung: linear %lu/s, Summary %lu/s, Summary und Hint %lu/s",
+				100 - freePages * 100 / (end - start),
+				benchmarkSearch(start, end, SEARCH_LINEAR),
+				benchmarkSearch(start, end, SEARCH_SUMMARY),
+				benchmarkSearch(start, end, SEARCH_SUMMARY_HINT));
+		SysLog("PMM", msg);
+	}
+
+	while(list != 0)
+	{
+		paddr_t next = *(paddr_t*)MAPPED_PHYS_MEM_GET(list);
+		pmm_Free(list);
+		list = next;
+	}
+}
+
+/*
+ * Measures the allocations per second of single pages and of contiguous blocks. The results are only meaningful with
+ * a memory map of more than 4GiB, where all zones are used. Must be called with interrupts enabled.
+ */
+void pmm_benchmark()
+{
+	static const struct{
+		const char *name;
+		paddr_t maxAddress;
+		size_t size;
+	}runs[] = {
+		{"pmm_Alloc", -1ul, 1},
+		{"16 Pages", -1ul, 16},
+		{"2MiB", -1ul, 512},
+		{"16 Pages unter 4GiB", PMM_ZONE_DMA32_END, 16},
+		{"1 Page unter 16MiB", PMM_ZONE_DMA16_END, 1},
+		{"1 Page unter 8MiB", PMM_ZONE_DMA16_END / 2, 1}
+	};
+	char msg[80];
+
+	sprintf(msg, "Benchmark mit %lu MB Speicher", pmm_totalMemory >> 20);
+	SysLog("PMM", msg);
+	for(size_t i = 0; i < sizeof(runs) / sizeof(*runs); i++)
+	{
+		sprintf(msg, "%s: %lu Allokationen/s", runs[i].name, benchmarkAlloc(runs[i].maxAddress, runs[i].size));
+		SysLog("PMM", msg);
+	}
+	benchmarkSearchRange();
+}
+#endif
+
 /*
  * Initialisiert die physikalische Speicherverwaltung
  */
@@ -62,9 +640,12 @@ bool pmm_Init(const mmap *map, uint32_t map_length)
 	pmm_totalPages = pmm_totalMemory / MM_BLOCK_SIZE;
 	assert(pmm_totalMemory % MM_BLOCK_SIZE == 0);
 
-	// Get memory for bitmap
+	// Get memory for bitmap and the page array of the buddy allocator
 	// TODO: what if we use a range which is not mapped?
-	size_t required_size = PMM_MAP_ALIGN_SIZE(maxAddress / MM_BLOCK_SIZE / 8);
+	size_t bitmap_size = PMM_MAP_ALIGN_SIZE(maxAddress / MM_BLOCK_SIZE / 8);
+	size_t page_count = bitmap_size * 8;
+	size_t summary_size = PMM_MAP_ALIGN_SIZE((bitmap_size / sizeof(*Map) + 7) / 8);
+	size_t required_size = bitmap_size + summary_size + page_count * sizeof(pmm_page_t);
 	for (mmap *m = map; m < (mmap*)((uintptr_t)map + map_length); m = (mmap*)((uintptr_t)m + m->size + 4)) {
 		if (m->type == 1) {
 			uintptr_t base_addr = m->base_addr;
@@ -72,7 +653,7 @@ bool pmm_Init(const mmap *map, uint32_t map_length)
 			if ((base_addr < (uintptr_t)&kernel_start && MIN((uintptr_t)&kernel_start - base_addr, size) >= required_size) || base_addr > (uintptr_t)&kernel_end) {
 				// Take memory from the beginning of the map
 				Map = (uint64_t*)base_addr;
-				mapSize = required_size;
+				mapSize = bitmap_size;
 
 				m->base_addr += required_size;
 				m->length -= required_size;
@@ -80,7 +661,7 @@ bool pmm_Init(const mmap *map, uint32_t map_length)
 			} else if (base_addr < (uintptr_t)&kernel_end && size - ((uintptr_t)&kernel_end - base_addr) >= required_size) {
 				// Take memory from the end of the map
 				Map = (uint64_t*)(base_addr + size - required_size);
-				mapSize = required_size;
+				mapSize = bitmap_size;
 
 				m->length -= required_size;
 				break;
@@ -91,26 +672,60 @@ bool pmm_Init(const mmap *map, uint32_t map_length)
 	if (Map == NULL) {
 		Panic("PMM", "No memory found to place bitmap");
 	}
-	memset(Map, 0, mapSize);
+	memset(Map, 0, required_size);
+
+	Summary = (uint64_t*)((uintptr_t)Map + mapSize);
+	Pages = (pmm_page_t*)((uintptr_t)Summary + summary_size);
+	pageCount = page_count;
+	for(uint8_t z = 0; z < PMM_ZONE_COUNT; z++)
+	{
+		zone_t *zone = &zones[z];
+		zone->start = MIN(zone->start, pageCount);
+		zone->end = MIN(zone->end, pageCount);
+		for(uint8_t order = 0; order < PMM_ORDERS; order++)
+			zone->freeLists[order] = PMM_NO_PAGE;
+	}
 
 	//Map analysieren und entsprechende Einträge in die Speicherverwaltung machen
+	paddr_t kernel_first_page = ROUND_DOWN_PAGESIZE((paddr_t)&kernel_start);
+	paddr_t kernel_last_page = ROUND_DOWN_PAGESIZE((paddr_t)&kernel_end);
 	for (mmap *m = map; m < (mmap*)((uintptr_t)map + map_length); m = (mmap*)((uintptr_t)m + m->size + 4))
 	{
-		if(m->type == 1 && m->base_addr >= 0x100000) {
+		if(m->type == 1 && m->base_addr < PMM_LOW_PAGE_END) {
+			//Keep the highest usable page below 1MiB which doesn't contain the memory map
 			paddr_t map_start = ROUND_UP_PAGESIZE(m->base_addr);
-			size_t map_end = ROUND_DOWN_PAGESIZE(m->base_addr + m->length);
-			printf("marking as free: %p - %p\n", map_start, map_end);
-			for(paddr_t i = map_start; i < map_end; i += MM_BLOCK_SIZE) {
-				if(i < (paddr_t)&kernel_start || i > (paddr_t)&kernel_end)
+			paddr_t page = ROUND_DOWN_PAGESIZE(MIN(m->base_addr + m->length, PMM_LOW_PAGE_END));
+			while(page > map_start)
+			{
+				page -= MM_BLOCK_SIZE;
+				if(page + MM_BLOCK_SIZE <= (paddr_t)map || page >= (paddr_t)map + map_length)
 				{
-					pmm_Free(i);
+					if(lowPage == 1 || page > lowPage)
+						lowPage = page;
+					break;
 				}
 			}
 		}
+		if(m->type == 1 && m->base_addr >= 0x100000) {
+			paddr_t map_start = ROUND_UP_PAGESIZE(m->base_addr);
+			paddr_t map_end = ROUND_DOWN_PAGESIZE(m->base_addr + m->length);
+			printf("marking as free: %p - %p\n", map_start, map_end);
+
+			//Pages of the kernel are never freed
+			paddr_t low_end = MIN(map_end, kernel_first_page);
+			paddr_t high_start = MAX(map_start, kernel_last_page + MM_BLOCK_SIZE);
+			if(map_start < low_end)
+				pmm_freeRange(map_start / MM_BLOCK_SIZE, (low_end - map_start) / MM_BLOCK_SIZE);
+			if(high_start < map_end)
+				pmm_freeRange(high_start / MM_BLOCK_SIZE, (map_end - high_start) / MM_BLOCK_SIZE);
+		}
 	}
+	for(uint8_t z = 0; z < PMM_ZONE_COUNT; z++)
+		zones[z].totalPages = zones[z].freePages;
 
 	#ifdef DEBUGMODE
 	printf("    %u MB Speicher gefunden\n    %u GB Speicher gefunden\n", pmm_totalMemory >> 20, pmm_totalMemory >> 30);
+	pmm_selfTest();
 	#endif
 
 	SysLog("PMM", "Initialisierung abgeschlossen");
@@ -118,10 +733,100 @@ bool pmm_Init(const mmap *map, uint32_t map_length)
 }
 
 void pmm_markPageReserved(paddr_t address) {
-	size_t i = address / MM_BLOCK_SIZE / PMM_BITS_PER_ELEMENT;
-	uint8_t bit = (address / MM_BLOCK_SIZE) % PMM_BITS_PER_ELEMENT;
-	__sync_fetch_and_and(&Map[i], ~(1ul << bit));
-	__sync_fetch_and_sub(&pmm_freePages, 1);
+	size_t pfn = address / MM_BLOCK_SIZE;
+
+	//The page tables of the loader might lie in low memory
+	if(ROUND_DOWN_PAGESIZE(address) == lowPage)
+		lowPage = 1;
+	if(pfn >= pageCount)
+		return;
+
+	zone_t *zone = getZone(pfn);
+	lock_node_t node;
+	lock_node_t cacheNodes[CPU_MAX_COUNT];
+
+	//The caches are locked first so that the page can't move between a cache and the buddy allocator
+	bool irq = cpu_disableInterrupts();
+	for(uint32_t cpu = 0; cpu < CPU_MAX_COUNT; cpu++)
+		lock(&pmm_caches[cpu].lock, &cacheNodes[cpu]);
+	lock(&zone->lock, &node);
+	if(isPageFree(pfn))
+	{
+		size_t head = buddy_findBlock(pfn);
+
+		//Split the block until only the page itself remains
+		uint8_t order = Pages[head].order;
+		buddy_remove(zone, order, head);
+		while(order > 0)
+		{
+			order--;
+			size_t half = 1ul << order;
+			if(pfn >= head + half)
+			{
+				buddy_push(zone, order, head);
+				head += half;
+			}
+			else
+			{
+				buddy_push(zone, order, head + half);
+			}
+		}
+
+		markPages(pfn, 1, false);
+		zone->freePages--;
+	}
+	else
+	{
+		//The page might be held by one of the caches
+		for(uint32_t cpu = 0; cpu < CPU_MAX_COUNT; cpu++)
+		{
+			pmm_cache_t *cache = &pmm_caches[cpu];
+			for(size_t i = 0; i < cache->count; i++)
+			{
+				if(cache->pages[i] == pfn)
+				{
+					cache->pages[i] = cache->pages[--cache->count];
+					break;
+				}
+			}
+		}
+	}
+	unlock(&zone->lock, &node);
+	for(uint32_t cpu = 0; cpu < CPU_MAX_COUNT; cpu++)
+		unlock(&pmm_caches[cpu].lock, &cacheNodes[cpu]);
+	cpu_restoreInterrupts(irq);
+}
+
+/*
+ * Takes a page from the pool of zeroed pages. Returns PMM_NO_PAGE if the pool is empty.
+ */
+static size_t zeroPoolPop(void)
+{
+	size_t pfn = PMM_NO_PAGE;
+	lock_node_t node;
+	bool irq = cpu_disableInterrupts();
+	lock(&zeroPoolLock, &node);
+	if(zeroPoolCount > 0)
+		pfn = zeroPool[--zeroPoolCount];
+	unlock(&zeroPoolLock, &node);
+	cpu_restoreInterrupts(irq);
+	return pfn;
+}
+
+static bool zeroPoolPush(size_t pfn)
+{
+	bool pushed = false;
+	lock_node_t node;
+	bool irq = cpu_disableInterrupts();
+	lock(&zeroPoolLock, &node);
+	if(zeroPoolCount < PMM_ZERO_POOL_SIZE)
+	{
+		zeroPool[zeroPoolCount++] = pfn;
+		pushed = true;
+	}
+	unlock(&zeroPoolLock, &node);
+	cpu_restoreInterrupts(irq);
+	return pushed;
 }
 
 /*
@@ -131,28 +836,66 @@ void pmm_markPageReserved(paddr_t address) {
  */
 paddr_t pmm_Alloc()
 {
-	while(pmm_freePages > 0)
+	size_t pfn = PMM_NO_PAGE;
+	lock_node_t node;
+	bool irq = cpu_disableInterrupts();
+	pmm_cache_t *cache = &pmm_caches[cpu_getIndex()];
+	lock(&cache->lock, &node);
+
+	if(cache->count > 0)
 	{
-		size_t i;
-		for(i = 4; i < mapSize; i++)
-		{
-			uint16_t tmp;
-			while((tmp = __builtin_ffsl(Map[i])) > 0)
-			{
-				uint16_t j;
-				bool status;
-				j = tmp - 1;
-				asm volatile("lock btr %2,%0;"
-							"setc %1": "=m"(Map[i]), "=r"(status): "r"(j): "cc", "memory");
-				if(status)
-				{
-					__sync_fetch_and_sub(&pmm_freePages, 1);
-					return (i * PMM_BITS_PER_ELEMENT + j) * MM_BLOCK_SIZE;
-				}
-			}
-		}
+		cache->stats.hits++;
 	}
-	return 1;
+	else
+	{
+		cache->stats.misses++;
+		pmm_cacheRefill(cache);
+	}
+	if(cache->count > 0)
+		pfn = cache->pages[--cache->count];
+	unlock(&cache->lock, &node);
+	cpu_restoreInterrupts(irq);
+
+	//Before giving up we use the pages which were kept zeroed
+	if(pfn == PMM_NO_PAGE)
+		pfn = zeroPoolPop();
+
+	return (pfn == PMM_NO_PAGE) ? 1 : pfn * MM_BLOCK_SIZE;
+}
+
+paddr_t pmm_AllocZeroed()
+{
+	size_t pfn = zeroPoolPop();
+	if(pfn != PMM_NO_PAGE)
+	{
+		__sync_fetch_and_add(&zero_stats.hits, 1);
+		return pfn * MM_BLOCK_SIZE;
+	}
+
+	__sync_fetch_and_add(&zero_stats.misses, 1);
+	paddr_t address = pmm_Alloc();
+	if(address != 1)
+		memset(MAPPED_PHYS_MEM_GET(address), 0, MM_BLOCK_SIZE);
+	return address;
+}
+
+bool pmm_zeroIdlePage()
+{
+	if(zeroPoolCount >= PMM_ZERO_POOL_SIZE || pmm_getFreePages() - zeroPoolCount <= PMM_ZERO_POOL_RESERVE)
+		return false;
+
+	paddr_t address = pmm_Alloc();
+	if(address == 1)
+		return false;
+	memset(MAPPED_PHYS_MEM_GET(address), 0, MM_BLOCK_SIZE);
+	if(!zeroPoolPush(address / MM_BLOCK_SIZE))
+	{
+		//Someone else filled the pool in the meantime
+		pmm_Free(address);
+		return false;
+	}
+	__sync_fetch_and_add(&zero_stats.zeroed, 1);
+	return true;
 }
 
 /*
@@ -163,102 +906,210 @@ paddr_t pmm_Alloc()
  */
 void pmm_Free(paddr_t Address)
 {
-	uint8_t bit_status;
-	//entsprechendes Bit in der Bitmap zurücksetzen
-	size_t i = Address / MM_BLOCK_SIZE / PMM_BITS_PER_ELEMENT;
-	uint8_t bit = (Address / MM_BLOCK_SIZE) % PMM_BITS_PER_ELEMENT;
-	asm volatile("lock bts %1,%2;"
-				"setc %0": "=r"(bit_status): "r"(bit & 0xFF), "m"(Map[i]): "cc", "memory");
-	if(bit_status == 0)
-		__sync_fetch_and_add(&pmm_freePages, 1);
-	else
+	size_t pfn = Address / MM_BLOCK_SIZE;
+
+	//Shared pages are only freed when the last owner releases them
+	if(pfn < pageCount)
+	{
+		uint16_t refs;
+		while((refs = Pages[pfn].refs) > 0)
+		{
+			if(__sync_bool_compare_and_swap(&Pages[pfn].refs, refs, refs - 1))
+				return;
+		}
+	}
+
+	//Pages which are in one of the caches can't be detected here, they are checked when the cache is drained
+	if(isPageFree(pfn))
+	{
 		printf("\e[33;mWarning:\e[0m Freed page which was already freed (0x%X)\n", Address);
+		return;
+	}
+
+	lock_node_t node;
+	bool irq = cpu_disableInterrupts();
+	pmm_cache_t *cache = &pmm_caches[cpu_getIndex()];
+	lock(&cache->lock, &node);
+	if(cache->count >= PMM_CACHE_SIZE)
+		pmm_cacheDrain(cache, PMM_CACHE_BATCH);
+	cache->pages[cache->count++] = pfn;
+	unlock(&cache->lock, &node);
+	cpu_restoreInterrupts(irq);
 }
 
-//Für DMA erforderlich
-paddr_t pmm_AllocDMA(paddr_t maxAddress, size_t size)
+/*
+ * Adds an owner to an allocated page. The page is freed after pmm_Free has been called once per owner.
+ * Params: phys. address of the page
+ * Return: false if the page can not be shared (not managed or too many owners)
+ */
+bool pmm_Ref(paddr_t Address)
 {
-	size_t maxIndex = maxAddress / MM_BLOCK_SIZE / PMM_BITS_PER_ELEMENT;
-	uint8_t maxBit = (maxAddress / MM_BLOCK_SIZE) % PMM_BITS_PER_ELEMENT;
-	size_t i, bitCount, bitAlloc, startIndex, lastIndex;
-	uint8_t startBit;
-	uint8_t lastBit;
-	size_t bitFreed;
-	search:
-	while(pmm_freePages >= size)
+	size_t pfn = Address / MM_BLOCK_SIZE;
+	if(pfn >= pageCount)
+		return false;
+
+	uint16_t refs;
+	do
+	{
+		refs = Pages[pfn].refs;
+		if(refs == UINT16_MAX)
+			return false;
+	}
+	while(!__sync_bool_compare_and_swap(&Pages[pfn].refs, refs, refs + 1));
+	return true;
+}
+
+/*
+ * Returns the number of owners of an allocated page
+ */
+size_t pmm_getRefCount(paddr_t Address)
+{
+	size_t pfn = Address / MM_BLOCK_SIZE;
+	return (pfn < pageCount) ? Pages[pfn].refs + 1u : 1;
+}
+
+/*
+ * Takes a block of the requested order from a zone whose first size pages lie below maxPfn.
+ * This is only used if maxPfn lies inside the zone. The free blocks are searched in the bitmap
+ * starting at the position where the last search of this cpu ended (next-fit).
+ * Must be called with the lock of the zone held.
+ */
+static size_t buddy_allocBelow(zone_t *zone, uint8_t order, size_t size, size_t maxPfn)
+{
+	size_t *hint = &pmm_caches[cpu_getIndex()].searchHint[zone - zones];
+	size_t end = MIN(zone->end, maxPfn);
+	size_t start = (*hint >= zone->start && *hint < end) ? *hint : zone->start;
+
+	//Search from the hint to the end and then wrap around
+	for(uint8_t pass = 0; pass < 2; pass++)
 	{
-		size_t maxI = MIN(mapSize - 1, maxIndex);
-		bitCount = 0;
-		startIndex = lastIndex = -1;
-		startBit = lastBit = -1;
-		for(i = 4; i <= maxI; i++)
+		size_t pfn = (pass == 0) ? start : zone->start;
+		size_t pass_end = (pass == 0) ? end : start;
+		while((pfn = findFreePage(pfn, pass_end)) != PMM_NO_PAGE)
 		{
-			uint8_t bit;
-			uint8_t maxBitIndex = (i == maxI) ? maxBit : PMM_BITS_PER_ELEMENT - 1;
-			for(bit = 0; bit <= maxBitIndex; bit++)
+			size_t head = buddy_findBlock(pfn);
+			uint8_t o = Pages[head].order;
+			if(o >= order && head + size <= maxPfn)
 			{
-				bool status;
-				asm volatile(
-						"bt %2,%1;"
-						"setc %0"
-						: "=r"(status) : "m"(Map[i]), "r"((uint16_t)bit): "cc");
-				if(status)
-				{
-					if(((lastIndex == i && lastBit == bit - 1) || (lastIndex == i - 1 && lastBit == PMM_BITS_PER_ELEMENT - 1 && bit == 0))
-							&& bitCount > 0)
-					{
-						lastIndex = i;
-						lastBit = bit;
-						bitCount++;
-					}
-					else
-					{
-						bitCount = 1;
-						startIndex = lastIndex = i;
-						startBit = lastBit = bit;
-					}
-					if(bitCount == size)
-						goto found;
-				}
+				buddy_remove(zone, o, head);
+				buddy_split(zone, head, o, order);
+				markPages(head, 1ul << order, false);
+				zone->freePages -= 1ul << order;
+				*hint = head + (1ul << order);
+				return head;
 			}
+			pfn = head + (1ul << o);
 		}
 	}
-	return 1;
+	return PMM_NO_PAGE;
+}
 
-	found:
-	bitAlloc = 0;
-	for(i = startIndex; i <= lastIndex; i++)
+/*
+ * Reserves size physically contiguous pages which all lie below maxAddress.
+ * The zones are tried from the highest one which lies completely below maxAddress to the lowest one.
+ * A zone which lies completely below maxAddress serves the request in constant time.
+ * The block is taken from a buddy allocator and therefore aligned to the next power of two of size.
+ * Unused pages at the end of the block are returned to the allocator immediately.
+ * Rückgabewert:	phys. Addresse des Speicherbereichs
+ * 					1 = Kein passender Speicherbereich vorhanden
+ */
+paddr_t pmm_AllocDMA(paddr_t maxAddress, size_t size)
+{
+	if(size == 0)
+		return 1;
+
+	uint8_t order = buddy_order(size);
+	if(order >= PMM_ORDERS)
+		return 1;
+
+	size_t maxPfn = maxAddress / MM_BLOCK_SIZE;
+	size_t pfn = PMM_NO_PAGE;
+	bool retry = true;
+	lock_node_t node;
+	bool irq;
+
+	search:
+	for(int z = PMM_ZONE_COUNT - 1; z >= 0 && pfn == PMM_NO_PAGE; z--)
 	{
-		uint8_t bit;
-		uint8_t lastBitIndex = (i == lastIndex) ? lastBit : PMM_BITS_PER_ELEMENT - 1;
-		uint8_t startBitIndex = (i == startIndex) ? startBit : 0;
-		for(bit = startBitIndex; bit <= lastBitIndex; bit++)
-		{
-			bool status;
-			asm volatile(
-					"lock btr %2,%1;"
-					"setc %0"
-					: "=r"(status), "=m"(Map[i]): "r"((uint16_t)bit): "cc");
-			if(!status)
-				goto failure;
-			else
-				bitAlloc++;
-		}
+		zone_t *zone = &zones[z];
+		if(zone->start >= maxPfn || zone->freePages < size)
+			continue;
+
+		pmm_lockAcquire(zone, &node, &irq);
+		if(zone->end <= maxPfn)
+			pfn = buddy_alloc(zone, order);
+		else
+			pfn = buddy_allocBelow(zone, order, size, maxPfn);
+		if(pfn != PMM_NO_PAGE)
+			buddy_freeRange(zone, pfn + size, (1ul << order) - size);
+		pmm_lockRelease(zone, &node, irq);
+	}
+
+	//The pages we need might be held by the cache of this cpu
+	if(pfn == PMM_NO_PAGE && retry)
+	{
+		irq = cpu_disableInterrupts();
+		pmm_cache_t *cache = &pmm_caches[cpu_getIndex()];
+		lock(&cache->lock, &node);
+		retry = cache->count > 0;
+		pmm_cacheDrain(cache, cache->count);
+		unlock(&cache->lock, &node);
+		cpu_restoreInterrupts(irq);
+		if(retry)
+			goto search;
 	}
-	__sync_fetch_and_add(&pmm_freePages, -size);
-	return (startIndex * PMM_BITS_PER_ELEMENT + startBit) * MM_BLOCK_SIZE;
 
-	failure:
-	bitFreed = bitAlloc;
-	//Alles rückgängig machen
-	for(i = startIndex; bitAlloc > 0; i++)
+	if(pfn == PMM_NO_PAGE)
+	{
+		__sync_fetch_and_add(&dma_stats.failures, 1);
+		return 1;
+	}
+	__sync_fetch_and_add(&dma_stats.allocations, 1);
+	__sync_fetch_and_add(&dma_stats.pages, size);
+	return pfn * MM_BLOCK_SIZE;
+}
+
+/*
+ * Takes the page below 1MiB which pmm_Init kept for the startup code of the application processors.
+ * The page can be taken only once and is never freed.
+ * Rückgabewert:	phys. Addresse der Page
+ * 					1 = Keine Page unter 1MB vorhanden
+ */
+paddr_t pmm_AllocLowPage()
+{
+	return __sync_lock_test_and_set(&lowPage, 1);
+}
+
+/*
+ * Reserves size physically contiguous pages for a large page. Unlike pmm_AllocDMA this never uses the DMA16 zone,
+ * doesn't drain the caches and fails if the zone would be left with less than PMM_LARGE_RESERVE free pages,
+ * so large pages don't take the memory which drivers need for DMA.
+ * Rückgabewert:	phys. Addresse des Speicherbereichs
+ * 					1 = Kein passender Speicherbereich vorhanden
+ */
+paddr_t pmm_AllocLarge(size_t size)
+{
+	uint8_t order = buddy_order(size);
+	if(size == 0 || order >= PMM_ORDERS)
+		return 1;
+
+	for(int z = PMM_ZONE_COUNT - 1; z > PMM_ZONE_DMA16; z--)
 	{
-		uint8_t bit;
-		for(bit = (i == startIndex) ? startBit : 0; bit < PMM_BITS_PER_ELEMENT && bitAlloc > 0; bit++, bitAlloc--)
-			asm volatile("lock bts %1,%0": "=m"(Map[i]): "r"((uint16_t)bit): "cc");
+		zone_t *zone = &zones[z];
+		lock_node_t node;
+		bool irq;
+		if(zone->freePages < size + PMM_LARGE_RESERVE)
+			continue;
+
+		pmm_lockAcquire(zone, &node, &irq);
+		size_t pfn = buddy_alloc(zone, order);
+		if(pfn != PMM_NO_PAGE)
+			buddy_freeRange(zone, pfn + size, (1ul << order) - size);
+		pmm_lockRelease(zone, &node, irq);
+		if(pfn != PMM_NO_PAGE)
+			return pfn * MM_BLOCK_SIZE;
 	}
-	__sync_fetch_and_add(&pmm_freePages, bitFreed);
-	goto search;
+	return 1;
 }
 
 uint64_t pmm_getTotalPages()
@@ -268,9 +1119,47 @@ uint64_t pmm_getTotalPages()
 
 uint64_t pmm_getFreePages()
 {
-	return pmm_freePages;
+	uint64_t freePages = 0;
+	for(uint8_t z = 0; z < PMM_ZONE_COUNT; z++)
+		freePages += zones[z].freePages;
+	for(uint32_t cpu = 0; cpu < CPU_MAX_COUNT; cpu++)
+		freePages += pmm_caches[cpu].count;
+	return freePages + zeroPoolCount;
 }
 
 paddr_t pmm_getHighestAddress() {
 	return mapSize * PMM_BITS_PER_ELEMENT * MM_BLOCK_SIZE;
 }
+
+void pmm_getCacheStatistics(pmm_cache_stats_t *stats)
+{
+	*stats = (pmm_cache_stats_t){};
+	for(uint32_t cpu = 0; cpu < CPU_MAX_COUNT; cpu++)
+	{
+		const pmm_cache_t *cache = &pmm_caches[cpu];
+		stats->hits += cache->stats.hits;
+		stats->misses += cache->stats.misses;
+		stats->refills += cache->stats.refills;
+		stats->drains += cache->stats.drains;
+		stats->pages += cache->count;
+	}
+}
+
+void pmm_getDMAStatistics(pmm_dma_stats_t *stats)
+{
+	*stats = dma_stats;
+}
+
+void pmm_getZeroPoolStatistics(pmm_zero_stats_t *stats)
+{
+	*stats = zero_stats;
+	stats->pages = zeroPoolCount;
+}
+
+void pmm_getZoneStatistics(pmm_zone_t zone, pmm_zone_stats_t *stats)
+{
+	*stats = (pmm_zone_stats_t){
+		.totalPages = zones[zone].totalPages,
+		.freePages = zones[zone].freePages
+	};
+}
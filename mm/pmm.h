@@ -15,15 +15,67 @@
 
 //Eine Speicherstelle = 4kb
 
+#define PMM_CACHE_BATCH	32		//Number of pages moved at once between the per cpu caches and the buddy allocator
+
+#define PMM_ZONE_DMA16_END	0x1000000		//End of the zone for ISA DMA (16MiB)
+#define PMM_ZONE_DMA32_END	0x100000000		//End of the zone for 32 bit DMA (4GiB)
+
 typedef uintptr_t paddr_t;
 
+typedef enum{
+	PMM_ZONE_DMA16,		//Memory below 16MiB
+	PMM_ZONE_DMA32,		//Memory between 16MiB and 4GiB
+	PMM_ZONE_NORMAL,	//Memory above 4GiB
+	PMM_ZONE_COUNT
+}pmm_zone_t;
+
+typedef struct{
+	uint64_t totalPages;	//Pages managed by the zone
+	uint64_t freePages;		//Free pages of the zone (without the pages in the per cpu caches)
+}pmm_zone_stats_t;
+
+typedef struct{
+	uint64_t hits;			//Allocations served by the cache
+	uint64_t misses;		//Allocations which found the cache empty
+	uint64_t refills;		//Number of batches taken from the buddy allocator
+	uint64_t drains;		//Number of batches given back to the buddy allocator
+	uint64_t pages;			//Pages currently held by the caches
+}pmm_cache_stats_t;
+
+typedef struct{
+	uint64_t allocations;	//Successful calls of pmm_AllocDMA
+	uint64_t pages;			//Pages handed out by pmm_AllocDMA
+	uint64_t failures;		//Calls which found no suitable memory
+}pmm_dma_stats_t;
+
+typedef struct{
+	uint64_t hits;			//Calls of pmm_AllocZeroed served by the pool
+	uint64_t misses;		//Calls which had to zero the page themselves
+	uint64_t zeroed;		//Pages zeroed while the cpu was idle
+	uint64_t pages;			//Pages currently held by the pool
+}pmm_zero_stats_t;
+
 bool pmm_Init(const mmap *map, uint32_t map_length);					//Initialisiert die physikalische Speicherverwaltung
 void pmm_markPageReserved(paddr_t address);
 paddr_t pmm_Alloc(void);				//Allokiert eine Speicherstelle
+paddr_t pmm_AllocZeroed(void);			//Allocates a page which is filled with zeros
+bool pmm_zeroIdlePage(void);			//Zeroes one page for the pool of pmm_AllocZeroed, called by the idle thread
 void pmm_Free(paddr_t Address);		//Gibt eine Speicherstelle frei
+bool pmm_Ref(paddr_t Address);			//Fügt einer Speicherstelle einen weiteren Besitzer hinzu
+size_t pmm_getRefCount(paddr_t Address);
 paddr_t pmm_AllocDMA(paddr_t maxAddress, size_t Size);
+paddr_t pmm_AllocLarge(size_t Size);	//Allocates contiguous pages for a large page without using the DMA16 zone
+paddr_t pmm_AllocLowPage(void);			//Returns the page below 1MiB reserved for the startup code of the APs
 uint64_t pmm_getTotalPages();
 uint64_t pmm_getFreePages();
 paddr_t pmm_getHighestAddress();
+void pmm_getCacheStatistics(pmm_cache_stats_t *stats);
+void pmm_getZoneStatistics(pmm_zone_t zone, pmm_zone_stats_t *stats);
+void pmm_getDMAStatistics(pmm_dma_stats_t *stats);
+void pmm_getZeroPoolStatistics(pmm_zero_stats_t *stats);
+
+#ifdef DEBUGMODE
+void pmm_benchmark();
+#endif
 
 #endif /* PMM_H_ */
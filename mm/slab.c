@@ -0,0 +1,232 @@
+/*
+ * slab.c
+ *
+ *  Created on: 17.10.2026
+ *      Author: pascal
+ */
+
+#include "slab.h"
+#include "mm.h"
+#include "memory.h"
+#include "cpu.h"
+#include "assert.h"
+
+#define SLAB_SIZE			MM_BLOCK_SIZE
+#define SLAB_ALIGN			sizeof(void*)
+#define SLAB_MAX_EMPTY		1		//Number of empty slabs kept per cache
+
+#define ALIGN_UP(x, a)		(((x) + (a) - 1) & ~((a) - 1))
+#define SLAB_HEADER_SIZE	ALIGN_UP(sizeof(slab_t), SLAB_ALIGN)
+
+//A slab lies at the beginning of its page and is followed by the objects
+typedef struct slab{
+	struct slab *next, *prev;
+	void *freeList;
+	size_t used;
+}slab_t;
+
+static slab_cache_t *caches = NULL;
+static lock_t caches_lock = LOCK_INIT;
+
+static void slab_lockAcquire(slab_cache_t *cache, lock_node_t *node, bool *irq)
+{
+	//Objects are freed from interrupt handlers so we must not be interrupted while holding the lock
+	*irq = cpu_disableInterrupts();
+	lock(&cache->lock, node);
+}
+
+static void slab_lockRelease(slab_cache_t *cache, lock_node_t *node, bool irq)
+{
+	unlock(&cache->lock, node);
+	cpu_restoreInterrupts(irq);
+}
+
+static void **getLink(const slab_cache_t *cache, void *object)
+{
+	return object + cache->linkOffset;
+}
+
+static void slabListRemove(slab_t **list, slab_t *slab)
+{
+	if(slab->prev != NULL)
+		slab->prev->next = slab->next;
+	else
+		*list = slab->next;
+	if(slab->next != NULL)
+		slab->next->prev = slab->prev;
+}
+
+static void slabListPush(slab_t **list, slab_t *slab)
+{
+	slab->prev = NULL;
+	slab->next = *list;
+	if(*list != NULL)
+		(*list)->prev = slab;
+	*list = slab;
+}
+
+/*
+ * Computes the layout of the objects and registers the cache for the statistics
+ */
+static void cacheSetup(slab_cache_t *cache)
+{
+	size_t size = ALIGN_UP(cache->size ?: 1, SLAB_ALIGN);
+	//A constructed object must not be overwritten by the free list link
+	if(cache->ctor != NULL)
+	{
+		cache->linkOffset = size;
+		cache->slotSize = size + sizeof(void*);
+	}
+	else
+	{
+		cache->linkOffset = 0;
+		cache->slotSize = size;
+	}
+	cache->objectsPerSlab = (SLAB_SIZE - SLAB_HEADER_SIZE) / cache->slotSize;
+	assert(cache->objectsPerSlab > 0);
+
+	cache->stats.name = cache->name;
+	cache->stats.objectSize = cache->slotSize;
+
+	LOCKED_TASK(caches_lock, {
+		if(!cache->initialised)
+		{
+			cache->next = caches;
+			caches = cache;
+			cache->initialised = true;
+		}
+	});
+}
+
+/*
+ * Allocates a new slab and constructs its objects
+ */
+static slab_t *slabCreate(slab_cache_t *cache)
+{
+	slab_t *slab = mm_SysAlloc(SLAB_SIZE / MM_BLOCK_SIZE);
+	if(slab == NULL)
+		return NULL;
+	assert(((uintptr_t)slab & (SLAB_SIZE - 1)) == 0);
+
+	slab->used = 0;
+	slab->freeList = NULL;
+	void *objects = (void*)slab + SLAB_HEADER_SIZE;
+	for(size_t i = cache->objectsPerSlab; i-- > 0;)
+	{
+		void *object = objects + i * cache->slotSize;
+		if(cache->ctor != NULL)
+			cache->ctor(object);
+		*getLink(cache, object) = slab->freeList;
+		slab->freeList = object;
+	}
+	return slab;
+}
+
+void *slab_alloc(slab_cache_t *cache)
+{
+	if(!cache->initialised)
+		cacheSetup(cache);
+
+	void *object = NULL;
+	slab_t *surplus = NULL;
+	lock_node_t lock_node;
+	bool irq;
+	slab_lockAcquire(cache, &lock_node, &irq);
+	while(object == NULL)
+	{
+		slab_t *slab = cache->partial;
+		if(slab == NULL && (slab = cache->empty) != NULL)
+		{
+			slabListRemove(&cache->empty, slab);
+			cache->emptyCount--;
+			slabListPush(&cache->partial, slab);
+		}
+		if(slab == NULL)
+		{
+			//New slabs are allocated without holding the lock
+			slab_lockRelease(cache, &lock_node, irq);
+			slab = slabCreate(cache);
+			if(slab == NULL)
+				return NULL;
+			slab_lockAcquire(cache, &lock_node, &irq);
+			slabListPush(&cache->empty, slab);
+			cache->emptyCount++;
+			cache->stats.slabs++;
+			cache->stats.objectsTotal += cache->objectsPerSlab;
+			continue;
+		}
+
+		object = slab->freeList;
+		slab->freeList = *getLink(cache, object);
+		if(++slab->used == cache->objectsPerSlab)
+		{
+			slabListRemove(&cache->partial, slab);
+			slabListPush(&cache->full, slab);
+		}
+	}
+	cache->stats.allocations++;
+	cache->stats.objectsInUse++;
+
+	//Empty slabs are only given back here because slab_free may be called from interrupt handlers
+	if(cache->emptyCount > SLAB_MAX_EMPTY)
+	{
+		surplus = cache->empty;
+		slabListRemove(&cache->empty, surplus);
+		cache->emptyCount--;
+		cache->stats.slabs--;
+		cache->stats.objectsTotal -= cache->objectsPerSlab;
+	}
+	slab_lockRelease(cache, &lock_node, irq);
+
+	if(surplus != NULL)
+		mm_SysFree(surplus, SLAB_SIZE / MM_BLOCK_SIZE);
+	return object;
+}
+
+void slab_free(slab_cache_t *cache, void *object)
+{
+	if(object == NULL)
+		return;
+	assert(cache->initialised);
+
+	slab_t *slab = (slab_t*)((uintptr_t)object & ~(SLAB_SIZE - 1));
+	lock_node_t lock_node;
+	bool irq;
+	slab_lockAcquire(cache, &lock_node, &irq);
+	assert(slab->used > 0);
+	if(slab->used-- == cache->objectsPerSlab)
+	{
+		slabListRemove(&cache->full, slab);
+		slabListPush(&cache->partial, slab);
+	}
+	if(slab->used == 0)
+	{
+		slabListRemove(&cache->partial, slab);
+		slabListPush(&cache->empty, slab);
+		cache->emptyCount++;
+	}
+	*getLink(cache, object) = slab->freeList;
+	slab->freeList = object;
+	cache->stats.frees++;
+	cache->stats.objectsInUse--;
+	slab_lockRelease(cache, &lock_node, irq);
+}
+
+size_t slab_getStatistics(slab_cache_stats_t *stats, size_t count)
+{
+	size_t i = 0;
+	LOCKED_TASK(caches_lock, {
+		for(slab_cache_t *cache = caches; cache != NULL; cache = cache->next, i++)
+		{
+			if(i < count)
+			{
+				lock_node_t lock_node;
+				bool irq;
+				slab_lockAcquire(cache, &lock_node, &irq);
+				stats[i] = cache->stats;
+				slab_lockRelease(cache, &lock_node, irq);
+			}
+		}
+	});
+	return i;
+}
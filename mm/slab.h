@@ -0,0 +1,108 @@
+/*
+ * slab.h
+ *
+ *  Created on: 17.10.2026
+ *      Author: pascal
+ */
+
+/**
+ * \file
+ * Object caches for fixed-size kernel objects.
+ *
+ * Every cache hands out objects of one size from page sized slabs. Free objects are kept in a free list per slab
+ * so allocating and freeing an object is a constant time operation without any per object header.
+ */
+
+#ifndef SLAB_H_
+#define SLAB_H_
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+#include "lock.h"
+
+struct slab;
+
+/**
+ * \brief Usage statistics of a cache
+ */
+typedef struct{
+	const char *name;
+	size_t objectSize;		//Size of an object including the alignment
+	size_t objectsInUse;	//Objects which are currently allocated
+	size_t objectsTotal;	//Objects which fit into the slabs of the cache
+	size_t slabs;			//Number of slabs of the cache
+	uint64_t allocations;
+	uint64_t frees;
+}slab_cache_stats_t;
+
+/**
+ * \brief Cache of objects of one type.
+ *
+ * Caches are defined statically with #SLAB_CACHE_INIT. The fields are private to slab.c.
+ */
+typedef struct slab_cache{
+	const char *name;
+	size_t size;
+	void (*ctor)(void*);
+
+	size_t slotSize;			//Size of an object and its free list link
+	size_t linkOffset;			//Offset of the free list link in an object
+	size_t objectsPerSlab;
+	bool initialised;
+
+	lock_t lock;
+	struct slab *partial, *full, *empty;
+	size_t emptyCount;
+	slab_cache_stats_t stats;
+
+	struct slab_cache *next;	//List of all caches used for the statistics
+}slab_cache_t;
+
+/**
+ * \brief Initializer of a cache.
+ *
+ * If a constructor is given it is called once for every object when a new slab is created. Objects have to be freed in
+ * their constructed state so the constructor is not called again when an object is reused.
+ *
+ * \param cache_name Name of the cache shown in the statistics
+ * \param object_size Size of the objects
+ * \param constructor Function to initialize an object or NULL
+ */
+#define SLAB_CACHE_INIT(cache_name, object_size, constructor)	{	\
+		.name = (cache_name),										\
+		.size = (object_size),										\
+		.ctor = (constructor),										\
+		.lock = LOCK_INIT											\
+	}
+
+/**
+ * \brief Allocates an object from a cache.
+ *
+ * This function can not be called from interrupt handlers because it may allocate a new slab.
+ *
+ * @param cache Cache of the object
+ * @return The object or NULL if there is not enough memory
+ */
+void *slab_alloc(slab_cache_t *cache);
+
+/**
+ * \brief Returns an object to its cache.
+ *
+ * This function can be called from interrupt handlers.
+ *
+ * @param cache Cache from which the object was allocated
+ * @param object The object or NULL
+ */
+void slab_free(slab_cache_t *cache, void *object);
+
+/**
+ * \brief Returns the statistics of all caches which were used until now.
+ *
+ * @param stats Array which receives the statistics of the caches
+ * @param count Number of elements of the array
+ * @return Number of caches (can be greater than count)
+ */
+size_t slab_getStatistics(slab_cache_stats_t *stats, size_t count);
+
+#endif /* SLAB_H_ */
@@ -17,6 +17,9 @@
 #include "string.h"
 #include "lock.h"
 #include "cpu.h"
+#include "smp.h"
+#include "avl.h"
+#include "vfs.h"
 #include <assert.h>
 
 #define NULL (void*)0
@@ -28,12 +31,17 @@
 //Flags für AVL Bits
 #define VMM_PAGE_FULL			(1 << 0)
 #define VMM_GUARD_PAGE			(1 << 1)
+#define VMM_COW_PAGE			(1 << 3)	//Page ist beschreibbar, wird aber erst beim ersten Schreibzugriff kopiert
+#define VMM_FILE_PAGE			(1 << 4)	//Inhalt der Page wird beim ersten Zugriff aus einer Datei geladen
+#define VMM_SHARED_PAGE			(1 << 5)	//Page eines geteilten Dateibereichs, wird nie kopiert
 
 #define VMM_PAGES_PER_PML4		VMM_PAGES_PER_PDP * PAGE_ENTRIES
 #define VMM_PAGES_PER_PDP		VMM_PAGES_PER_PD * PAGE_ENTRIES
 #define VMM_PAGES_PER_PD		VMM_PAGES_PER_PT * PAGE_ENTRIES
 #define VMM_PAGES_PER_PT		PAGE_ENTRIES
 
+#define VMM_IS_LARGE_ALIGNED(address)	(((uintptr_t)(address) & (PG_LARGE_PAGE_SIZE - 1)) == 0)
+
 #define VMM_EXTEND(address)	((int64_t)((address) << 16) >> 16)
 #define VMM_GET_ADDRESS(PML4i, PDPi, PDi, PTi)	(void*)VMM_EXTEND(((uint64_t)PML4i << 39) | ((uint64_t)PDPi << 30) | (PDi << 21) | (PTi << 12))
 #define VMM_ALLOCATED(entry) ((entry & PG_P) || (PG_AVL(entry) & (VMM_UNUSED_PAGE | VMM_GUARD_PAGE)))	//Prüft, ob diese Page schon belegt ist
@@ -44,16 +52,62 @@
 #define PD_INDEX(address)					PAGE_TABLE_INDEX(address, 2)
 #define PT_INDEX(address)					PAGE_TABLE_INDEX(address, 3)
 
-#define MAPPED_PHYS_MEM_BASE		0xFFFFFF8000000000
-#define MAPPED_PHYS_MEM_GET(addr)	((void*)(MAPPED_PHYS_MEM_BASE + (paddr_t)(addr)))
+#define VMM_RANGE_SLOT_SIZE			32	//Grösse eines Knotens bzw. eines Bereichs in den Bereichsbäumen
+#define VMM_GATHER_SIZE				64	//Anzahl Einträge, die gesammelt werden, bevor der TLB invalidiert wird
+#define VMM_PROMOTE_MIN_PAGES		384	//So viele Pages einer Page Table müssen benutzt sein, bevor sie zu einer 2MiB Page wird
+#define VMM_PROMOTE_INTERVAL		64	//Nur bei jeder so vielten Page einer Page Table wird eine 2MiB Page versucht
+#define VMM_PCID_COUNT				4096
+
+#define MAX(a, b)	((a > b) ? a : b)
+#define MIN(a, b)	((a < b) ? a : b)
+
+//Bereich, dessen Pages beim ersten Zugriff aus einer Datei geladen werden
+typedef struct vmm_file_region {
+	REFCOUNT_FIELD;
+	struct vmm_file_region *next;
+	uintptr_t start, end;		//Gemappte Pages
+	uintptr_t data;				//Adresse, an welche der Dateiinhalt geladen wird
+	uint64_t offset;			//Offset des Inhalts in der Datei
+	size_t size;				//Anzahl Bytes, die aus der Datei geladen werden
+	vfs_stream_t *stream;
+	vmm_page_cache_t *cache;	//Pages, die mit anderen Kontexten geteilt werden (oder NULL)
+	uintptr_t cacheStart;		//Virtuelle Adresse, an welcher cache->frames[0] liegen würde
+	bool shared;				//Änderungen werden in die Datei zurückgeschrieben
+} vmm_file_region_t;
 
 struct vmm_context {
 	paddr_t physAddress;
+	avl_tree *freeRanges;		//Freie Bereiche im Userspace bzw. beim Kernelkontext im Kernelspace
+	vmm_file_region_t *fileRegions;	//Neuere Bereiche stehen vorne und verdecken ältere
+	lock_t regionsLock;			//Wird auch im Page Fault Handler benutzt, deshalb nur mit deaktivierten Interrupts halten
+	size_t tablePages;			//Anzahl Pages, die von den Page Tables des Kontextes belegt werden
+	uint16_t pcid;				//0 = keine eigene PCID, der TLB wird bei jedem Wechsel geleert
+	volatile uint64_t staleCpus;	//CPUs, welche beim nächsten Aktivieren die TLB-Einträge der PCID leeren müssen
 };
 
+//Sammelt Pages, welche erst freigegeben werden dürfen, wenn die TLB-Einträge ungültig gemacht wurden
+typedef struct {
+	context_t *context;
+	uintptr_t start, end;		//Bereich, dessen TLB-Einträge ungültig gemacht werden müssen
+	size_t count;
+	struct {
+		paddr_t paddr;
+		size_t pages;
+	} free[VMM_GATHER_SIZE];
+} tlb_gather_t;
+
+//Freier Bereich des virtuellen Adressraums
+typedef struct {
+	uintptr_t start;
+	size_t pages;
+	size_t maxPages;			//Grösster freier Bereich im Teilbaum
+} vmm_range_t;
+
 struct unmap_result {
 	paddr_t paddr;
 	uint16_t avl;
+	uint8_t tableCount;
+	paddr_t tables[3];			//Nicht mehr benötigte Page Tables
 };
 
 const uint16_t PML4e = PML4_INDEX(KERNELSPACE_END) + 1;
@@ -63,8 +117,36 @@ const uint16_t PTe = PT_INDEX(KERNELSPACE_END) + 1;
 
 static lock_t vmm_lock = LOCK_INIT;
 
+//Der Page Fault Handler holt den Lock mit deaktivierten Interrupts. Deshalb darf ein Thread, welcher den Lock hält,
+//nicht unterbrochen werden, sonst wartet der Handler auf derselben CPU für immer.
+#define VMM_LOCKED_RESULT(task)									\
+	({															\
+		bool ___irq = cpu_disableInterrupts();					\
+		typeof((task)) ___vmm_result = LOCKED_RESULT(vmm_lock, task);	\
+		cpu_restoreInterrupts(___irq);							\
+		___vmm_result;											\
+	})
+
+#define VMM_LOCKED_TASK(task)									\
+	{															\
+		bool ___irq = cpu_disableInterrupts();					\
+		LOCKED_TASK(vmm_lock, task);							\
+		cpu_restoreInterrupts(___irq);							\
+	}
+
+//Freie Speicherplätze für Knoten der Bereichsbäume
+static void *range_pool = NULL;
+
+//Belegte PCIDs. PCID 0 wird vom Kernelkontext und von Kontexten ohne eigene PCID verwendet.
+static uint64_t pcid_map[VMM_PCID_COUNT / 64] = {1};
+
 context_t kernel_context;
 
+//Anzahl Pages, die von allen Page Tables belegt werden
+static size_t totalTablePages;
+
+static vmm_fault_stats_t fault_stats;
+
 //Funktionen, die nur in dieser Datei aufgerufen werden sollen
 uint8_t vmm_ChangeMap(context_t *context, void *vAddress, paddr_t pAddress, uint8_t flags, uint16_t avl);
 
@@ -77,6 +159,87 @@ static void clearPage(void *address)
 	asm volatile("rep stosq" : :"c"(VMM_SIZE_PER_PAGE / sizeof(uint64_t)), "D"((uintptr_t)address & ~0xFFF), "a"(0) :"memory");
 }
 
+static bool isActive(const context_t *context)
+{
+	return (cpu_readControlRegister(CPU_CR3) & PG_ADDRESS) == context->physAddress;
+}
+
+/*
+ * Macht die TLB-Einträge eines Bereichs ungültig. Kernelpages sind global und daher in allen Kontexten gleich.
+ * Für nicht aktive Kontexte werden die Einträge mit INVPCID entfernt oder beim nächsten Aktivieren geleert.
+ * Muss mit deaktivierten Interrupts aufgerufen werden.
+ */
+static void invalidateRange(context_t *context, void *address, size_t pages)
+{
+	if((uintptr_t)address <= KERNELSPACE_END)
+	{
+		InvalidateTLBRange(address, pages, true);
+		smp_invalidateTLB(NULL, address, pages);
+		return;
+	}
+
+	const uint64_t self = 1ul << cpu_getIndex();
+	if(isActive(context))
+	{
+		InvalidateTLBRange(address, pages, false);
+	}
+	else if(context->pcid != 0)
+	{
+		if(cpuInfo.invpcid && pages <= PG_TLB_FLUSH_THRESHOLD)
+		{
+			for(size_t i = 0; i < pages; i++)
+				InvalidatePCIDEntry(context->pcid, address + i * VMM_SIZE_PER_PAGE);
+		}
+		else
+		{
+			__sync_fetch_and_or(&context->staleCpus, self);
+		}
+	}
+	//Andere CPUs behalten Einträge der PCID auch nach einem Kontextwechsel. Sie leeren diese beim nächsten Aktivieren,
+	//nur die CPUs, welche den Kontext gerade geladen haben, müssen unterbrochen werden.
+	if(context->pcid != 0)
+		__sync_fetch_and_or(&context->staleCpus, ~self);
+	smp_invalidateTLB(context, address, pages);
+}
+
+static void gather_init(tlb_gather_t *gather, context_t *context)
+{
+	gather->context = context;
+	gather->start = (uintptr_t)-1;
+	gather->end = 0;
+	gather->count = 0;
+}
+
+/*
+ * Macht die gesammelten TLB-Einträge ungültig und gibt danach die Pages frei
+ */
+static void gather_flush(tlb_gather_t *gather)
+{
+	if(gather->start < gather->end)
+		invalidateRange(gather->context, (void*)gather->start, (gather->end - gather->start) / VMM_SIZE_PER_PAGE);
+	for(size_t i = 0; i < gather->count; i++)
+	{
+		for(size_t j = 0; j < gather->free[i].pages; j++)
+			pmm_Free(gather->free[i].paddr + j * VMM_SIZE_PER_PAGE);
+	}
+	gather_init(gather, gather->context);
+}
+
+static void gather_range(tlb_gather_t *gather, void *address, size_t pages)
+{
+	gather->start = MIN(gather->start, (uintptr_t)address);
+	gather->end = MAX(gather->end, (uintptr_t)address + pages * VMM_SIZE_PER_PAGE);
+}
+
+static void gather_free(tlb_gather_t *gather, paddr_t paddr, size_t pages)
+{
+	if(gather->count == VMM_GATHER_SIZE)
+		gather_flush(gather);
+	gather->free[gather->count].paddr = paddr;
+	gather->free[gather->count].pages = pages;
+	gather->count++;
+}
+
 /*
  * Gibt zurück, ob die entsprechende Page belegt ist oder nicht
  * Parameter:		Address = virtuelle Addresse
@@ -91,36 +254,179 @@ static bool isPageFree(const uint64_t *const PML4E, const uint64_t *const PDPE,
 	//Ansonsten überprüfe PDP-Eintrag
 	else if((*PDPE & PG_P) == 0)	//Wenn PDP-Eintrag vorhanden ist
 		return true;
+	//1GiB Page
+	else if(*PDPE & PG_PS)
+		return false;
 	//Ansonsten überprüfe PD-Eintrag
 	else if((*PDE & PG_P) == 0)		//Wenn PD-Eintrag vorhanden ist
 		return true;
+	//2MiB Page
+	else if(*PDE & PG_PS)
+		return false;
 	//Ansonsten überprüfe PT-Eintrag
 	return !VMM_ALLOCATED(*PTE);
 }
 
-static uint8_t map_entry(void *vAddress, paddr_t pAddress, uint8_t flags, uint16_t avl, PageTable_t table, uint32_t level)
+/*
+ * Gibt einen Zeiger auf den PD-Eintrag der Adresse zurück
+ * Rückgabewert:	NULL = Es existiert kein Page Directory für diese Adresse
+ */
+static uint64_t *getPDEntry(context_t *context, const void *address)
+{
+	PML4_t *const PML4 = MAPPED_PHYS_MEM_GET(context->physAddress);
+	if(!(PML4->PML4E[PML4_INDEX(address)] & PG_P))
+		return NULL;
+	PDP_t *const PDP = MAPPED_PHYS_MEM_GET(PML4->PML4E[PML4_INDEX(address)] & PG_ADDRESS);
+	if((PDP->PDPE[PDP_INDEX(address)] & (PG_P | PG_PS)) != PG_P)
+		return NULL;
+	PD_t *const PD = MAPPED_PHYS_MEM_GET(PDP->PDPE[PDP_INDEX(address)] & PG_ADDRESS);
+	return &PD->PDE[PD_INDEX(address)];
+}
+
+/*
+ * Zählt erstellte bzw. freigegebene Page Tables. Die Tabellen des Kernelspaces gehören zum Kernelkontext.
+ */
+static void accountTables(context_t *context, const void *address, int64_t pages)
+{
+	context_t *owner = ((uintptr_t)address <= KERNELSPACE_END) ? &kernel_context : context;
+	__sync_fetch_and_add(&owner->tablePages, pages);
+	__sync_fetch_and_add(&totalTablePages, pages);
+}
+
+/*
+ * Ersetzt eine 2MiB Page durch eine Page Table, welche denselben Speicher mit 4KiB Pages mappt.
+ * Parameter:		PDE = PD-Eintrag der 2MiB Page
+ * 					address = eine virtuelle Adresse innerhalb der Page
+ * Rückgabewert:	false = zu wenig phys. Speicher für die Page Table vorhanden
+ */
+static bool splitLargePage(context_t *context, uint64_t *PDE, void *address)
+{
+	paddr_t table = pmm_Alloc();
+	if(table == 1)
+		return false;
+	accountTables(context, address, 1);
+
+	const uint64_t entry = *PDE;
+	const uint64_t flags = entry & (PG_P | PG_RW | PG_US | PG_PWT | PG_PCD | PG_A | PG_D | PG_G | PG_NX);
+	const uint16_t avl = PG_AVL(entry) & ~VMM_PAGE_FULL;
+	PT_t *const PT = MAPPED_PHYS_MEM_GET(table);
+	for(uint16_t i = 0; i < PAGE_ENTRIES; i++)
+		PT->PTE[i] = ((entry & PG_LARGE_ADDRESS) + i * VMM_SIZE_PER_PAGE) | flags | PG_AVL_BITS(avl);
+
+	//Alle Einträge der neuen Page Table sind belegt
+	*PDE = table | PG_P | PG_RW | PG_PWT | (entry & PG_US) | PG_AVL_BITS(VMM_PAGE_FULL);
+	invalidateRange(context, (void*)((uintptr_t)address & ~(PG_LARGE_PAGE_SIZE - 1)), 1);
+	return true;
+}
+
+/*
+ * Ersetzt eine Page Table, deren anonyme Pages grösstenteils schon benutzt werden, durch eine 2MiB Page. Damit wird ein
+ * TLB-Eintrag für den ganzen Bereich benötigt und die Page Table kann freigegeben werden. Die benutzten Pages werden in
+ * die 2MiB Page kopiert, nur die übrigen Pages müssen gelöscht werden. Muss mit gehaltenem vmm_lock aufgerufen werden.
+ * Parameter:		address = virtuelle Adresse, auf welche zugegriffen wurde
+ * Rückgabewert:	true = Der Bereich wurde mit einer 2MiB Page gemappt
+ */
+static bool promoteLargePage(context_t *context, void *address)
+{
+	const uint64_t flagsMask = PG_RW | PG_US | PG_PWT | PG_PCD | PG_G | PG_NX;
+	uint64_t *PDE = getPDEntry(context, address);
+	if(PDE == NULL || (*PDE & (PG_P | PG_PS)) != PG_P)
+		return false;
+
+	//Alle Pages müssen gleich gemappte anonyme Pages sein
+	PT_t *const PT = MAPPED_PHYS_MEM_GET(*PDE & PG_ADDRESS);
+	const uint64_t reference = PT->PTE[PT_INDEX(address)];
+	const uint16_t avl = PG_AVL(reference) & ~VMM_UNUSED_PAGE;
+	if(avl & (VMM_GUARD_PAGE | VMM_COW_PAGE | VMM_FILE_PAGE | VMM_SHARED_PAGE))
+		return false;
+	uint16_t used = 0;
+	for(uint16_t i = 0; i < PAGE_ENTRIES; i++)
+	{
+		const uint64_t entry = PT->PTE[i];
+		const bool unused = PG_AVL(entry) & VMM_UNUSED_PAGE;
+		if((entry & flagsMask) != (reference & flagsMask) || (PG_AVL(entry) & ~VMM_UNUSED_PAGE) != avl || !(entry & PG_P) != unused)
+			return false;
+		used += !unused;
+	}
+	if(used < VMM_PROMOTE_MIN_PAGES)
+		return false;
+
+	//Die DMA-Zonen werden nicht für 2MiB Pages benutzt
+	paddr_t pAddress = pmm_AllocLarge(PAGE_ENTRIES);
+	if(pAddress == 1)
+		return false;
+
+	//Andere CPUs dürfen nicht mehr in die alten Pages schreiben, während sie kopiert werden. Ihre Zugriffe lösen einen
+	//Page Fault aus, welcher auf den vmm_lock wartet und danach die 2MiB Page vorfindet.
+	const uintptr_t start = (uintptr_t)address & ~(PG_LARGE_PAGE_SIZE - 1);
+	for(uint16_t i = 0; i < PAGE_ENTRIES; i++)
+		__sync_fetch_and_and(&PT->PTE[i], ~PG_P);
+	invalidateRange(context, (void*)start, PAGE_ENTRIES);
+
+	for(uint16_t i = 0; i < PAGE_ENTRIES; i++)
+	{
+		void *dst = MAPPED_PHYS_MEM_GET(pAddress + i * VMM_SIZE_PER_PAGE);
+		if(PG_AVL(PT->PTE[i]) & VMM_UNUSED_PAGE)
+			clearPage(dst);
+		else
+			memcpy(dst, MAPPED_PHYS_MEM_GET(PT->PTE[i] & PG_ADDRESS), VMM_SIZE_PER_PAGE);
+	}
+
+	paddr_t table = *PDE & PG_ADDRESS;
+	*PDE = pAddress | PG_P | PG_PS | (reference & flagsMask) | PG_AVL_BITS(avl | VMM_PAGE_FULL);
+	invalidateRange(context, (void*)start, 1);
+
+	for(uint16_t i = 0; i < PAGE_ENTRIES; i++)
+	{
+		if(!(PG_AVL(PT->PTE[i]) & VMM_UNUSED_PAGE))
+			pmm_Free(PT->PTE[i] & PG_ADDRESS);
+	}
+	pmm_Free(table);
+	accountTables(context, address, -1);
+	return true;
+}
+
+/*
+ * Mappt eine Page. Wenn large gesetzt ist, wird eine 2MiB Page direkt im Page Directory eingetragen.
+ * Rückgabewert:	0 = Erfolgreich
+ * 					1 = zu wenig phys. Speicher vorhanden
+ * 					2 = Adresse ist schon belegt
+ */
+static uint8_t map_entry(context_t *context, void *vAddress, paddr_t pAddress, uint8_t flags, uint16_t avl, PageTable_t table, uint32_t level,
+		bool large)
 {
 	uint32_t index = PAGE_TABLE_INDEX(vAddress, level);
 	PageTable_t next_table = MAPPED_PHYS_MEM_GET(table[index].Address << 12);
+	const uint32_t last_level = large ? 2 : 3;
+	bool created = false;
 
 	if(!table[index].P) {
 		table[index].entry = 0;
 
-		if(level == 3) {
+		if(level == last_level) {
+			if(large)
+			{
+				table[index].PS_PAT = 1;
+				//Eine 2MiB Page ist ein voller Eintrag
+				avl |= VMM_PAGE_FULL;
+			}
 			table[index].P = !(avl & (VMM_UNUSED_PAGE | VMM_GUARD_PAGE));
 			table[index].RW = flags & VMM_FLAGS_WRITE;
-			table[index].US = flags & VMM_FLAGS_USER;
+			table[index].US = (flags & VMM_FLAGS_USER) && !(flags & VMM_FLAGS_NO_ACCESS);
 			table[index].PWT = flags & VMM_FLAGS_PWT;
 			table[index].PCD = flags & VMM_FLAGS_NO_CACHE;
-			table[index].G = flags & VMM_FLAGS_GLOBAL;
+			//Kernelpages sind in allen Kontexten gleich und werden deshalb immer global gemappt
+			table[index].G = (flags & VMM_FLAGS_GLOBAL) || (uintptr_t)vAddress <= KERNELSPACE_END;
 			table[index].AVL1 = avl;
 			table[index].AVL2 = avl >> 3;
 			table[index].Address = pAddress >> 12;
 			table[index].NX = flags & VMM_FLAGS_NX;
 			return 0;
 		} else {
-			paddr_t address = pmm_Alloc();
+			paddr_t address = pmm_AllocZeroed();
 			if(address == 1) return 1;
+			accountTables(context, vAddress, 1);
+			created = true;
 
 			table[index].P = 1;
 			table[index].PWT = 1;
@@ -128,9 +434,8 @@ static uint8_t map_entry(void *vAddress, paddr_t pAddress, uint8_t flags, uint16
 			table[index].Address = address >> 12;
 
 			next_table = MAPPED_PHYS_MEM_GET(address);
-			clearPage(next_table);
 		}
-	} else if (level == 3) {
+	} else if (level == last_level || (level > 0 && table[index].PS_PAT)) {
 		return 2;
 	}
 
@@ -138,7 +443,20 @@ static uint8_t map_entry(void *vAddress, paddr_t pAddress, uint8_t flags, uint16
 	table[index].US |= flags & VMM_FLAGS_USER;
 	// There is no need for TLB invalidation here as the CPU will rewalk the page tables if it encounters a restriction validation
 
-	uint8_t res = map_entry(vAddress, pAddress, flags, avl, next_table, level + 1);
+	uint8_t res = map_entry(context, vAddress, pAddress, flags, avl, next_table, level + 1, large);
+
+	//Eine neue Tabelle, in welche nichts eingetragen werden konnte, wird wieder freigegeben.
+	//Die Tabellen des Kernelspaces werden von allen Kontexten benutzt und bleiben deshalb bestehen.
+	if(res != 0 && created && (uintptr_t)vAddress > KERNELSPACE_END) {
+		uint16_t i;
+		for(i = 0; i < PAGE_ENTRIES && !next_table[i].P && !VMM_ALLOCATED(next_table[i].entry); i++);
+		if(i == PAGE_ENTRIES) {
+			pmm_Free(table[index].Address << 12);
+			table[index].entry = 0;
+			accountTables(context, vAddress, -1);
+			return res;
+		}
+	}
 
 	//Full flags setzen
 	uint16_t i;
@@ -155,164 +473,278 @@ static uint8_t map_entry(void *vAddress, paddr_t pAddress, uint8_t flags, uint16
 }
 
 static uint8_t map(context_t *context, void *vAddress, paddr_t pAddress, uint8_t flags, uint16_t avl) {
-	return map_entry(vAddress, pAddress, flags, avl, MAPPED_PHYS_MEM_GET(context->physAddress), 0);
+	return map_entry(context, vAddress, pAddress, flags, avl, MAPPED_PHYS_MEM_GET(context->physAddress), 0, false);
+}
+
+static uint8_t mapLarge(context_t *context, void *vAddress, paddr_t pAddress, uint8_t flags) {
+	return map_entry(context, vAddress, pAddress, flags, 0, MAPPED_PHYS_MEM_GET(context->physAddress), 0, true);
 }
 
-static void *getFreePages(context_t *context, void *start, void *end, size_t pages)
+//Speicher für die Bereichsbäume. Er wird direkt vom PMM bezogen, da malloc selbst die VMM benutzt.
+static void *range_alloc(size_t size, void *context __attribute__((unused)))
 {
-	PML4_t *const PML4 = MAPPED_PHYS_MEM_GET(context->physAddress);
+	assert(size <= VMM_RANGE_SLOT_SIZE);
+	if(range_pool == NULL)
+	{
+		paddr_t page = pmm_Alloc();
+		if(page == 1)
+			return NULL;
+		uint8_t *slots = MAPPED_PHYS_MEM_GET(page);
+		for(size_t i = 0; i < VMM_SIZE_PER_PAGE; i += VMM_RANGE_SLOT_SIZE)
+		{
+			*(void**)(slots + i) = range_pool;
+			range_pool = slots + i;
+		}
+	}
+	void *slot = range_pool;
+	range_pool = *(void**)slot;
+	return slot;
+}
 
-	size_t found_pages = 0;
+static void range_free(void *slot, void *context __attribute__((unused)))
+{
+	*(void**)slot = range_pool;
+	range_pool = slot;
+}
 
-	//Einträge in die Page Tabellen
-	uint16_t start_PML4i = PML4_INDEX(start);
-	uint16_t start_PDPi = PDP_INDEX(start);
-	uint16_t start_PDi = PD_INDEX(start);
-	uint16_t start_PTi = PT_INDEX(start);
-	uint16_t end_PML4i = PML4_INDEX(end);
-	uint16_t end_PDPi = PDP_INDEX(end);
-	uint16_t end_PDi = PD_INDEX(end);
-	uint16_t end_PTi = PT_INDEX(end);
-
-	//Anfang des zusammenhängenden Bereichs
-	uint16_t begin_PML4i = start_PML4i;
-	uint16_t begin_PDPi = start_PDPi;
-	uint16_t begin_PDi = start_PDi;
-	uint16_t begin_PTi = start_PTi;
-
-	for (uint16_t PML4i = start_PML4i; PML4i <= end_PML4i; PML4i++)
-	{
-		if((PML4->PML4E[PML4i] & PG_P))
-		{
-			//Es sind noch Pages frei
-			if(!(PG_AVL(PML4->PML4E[PML4i]) & VMM_PAGE_FULL))
-			{
-				PDP_t *const PDP = MAPPED_PHYS_MEM_GET(PML4->PML4E[PML4i] & PG_ADDRESS);
-				uint16_t last_PDPi = (PML4i == end_PML4i) ? end_PDPi : PAGE_ENTRIES - 1;
-				for(uint16_t PDPi = (PML4i == start_PML4i) ? start_PDPi : 0; PDPi <= last_PDPi; PDPi++)
-				{
-					if((PDP->PDPE[PDPi] & PG_P))
-					{
-						//Es sind noch Pages frei
-						if(!(PG_AVL(PDP->PDPE[PDPi]) & VMM_PAGE_FULL))
-						{
-							PD_t *const PD = MAPPED_PHYS_MEM_GET(PDP->PDPE[PDPi] & PG_ADDRESS);
-							uint16_t last_PDi = (PML4i == end_PML4i && PDPi == end_PDPi) ? end_PDi : PAGE_ENTRIES - 1;
-							for(uint16_t PDi = (PML4i == start_PML4i && PDPi == start_PDPi) ? start_PDi : 0; PDi <= last_PDi; PDi++)
-							{
-								if((PD->PDE[PDi] & PG_P))
-								{
-									//Es sind noch Pages frei
-									if(!(PG_AVL(PD->PDE[PDi]) & VMM_PAGE_FULL))
-									{
-										PT_t *const PT = MAPPED_PHYS_MEM_GET(PD->PDE[PDi] & PG_ADDRESS);
-										uint16_t last_PTi = (PML4i == end_PML4i && PDPi == end_PDPi && PDi == end_PDi) ? end_PTi : PAGE_ENTRIES - 1;
-										for(uint16_t PTi = (PML4i == start_PML4i && PDPi == start_PDPi && PDi == start_PDi) ? start_PTi : 0;
-												PTi <= last_PTi; PTi++)
-										{
-											if(VMM_ALLOCATED(PT->PTE[PTi]))
-											{
-												found_pages = 0;
-												continue;
-											}
-											else
-											{
-												if(found_pages == 0)
-												{
-													begin_PTi = PTi;
-													begin_PDi = PDi;
-													begin_PDPi = PDPi;
-													begin_PML4i = PML4i;
-												}
-												found_pages++;
-											}
-
-											if(found_pages >= pages)
-												return VMM_GET_ADDRESS(begin_PML4i, begin_PDPi, begin_PDi, begin_PTi);
-										}
-									}
-									else
-									{
-										found_pages = 0;
-										continue;
-									}
-								}
-								else
-								{
-									if(found_pages == 0)
-									{
-										begin_PTi = 0;
-										begin_PDi = PDi;
-										begin_PDPi = PDPi;
-										begin_PML4i = PML4i;
-									}
-									found_pages += VMM_PAGES_PER_PT;
-								}
-
-								if(found_pages >= pages)
-									return VMM_GET_ADDRESS(begin_PML4i, begin_PDPi, begin_PDi, begin_PTi);
-							}
-						}
-						else
-						{
-							found_pages = 0;
-							continue;
-						}
-					}
-					else
-					{
-						if(found_pages == 0)
-						{
-							begin_PTi = 0;
-							begin_PDi = 0;
-							begin_PDPi = PDPi;
-							begin_PML4i = PML4i;
-						}
-						found_pages += VMM_PAGES_PER_PD;
-					}
+static void range_destroy(void *range)
+{
+	range_free(range, NULL);
+}
 
-					if(found_pages >= pages)
-						return VMM_GET_ADDRESS(begin_PML4i, begin_PDPi, begin_PDi, begin_PTi);
-				}
-			}
-			else
-			{
-				found_pages = 0;
-				continue;
-			}
+//Hält die Grösse des grössten freien Bereichs im Teilbaum aktuell
+static void range_update(avl_tree *node, void *context __attribute__((unused)))
+{
+	vmm_range_t *range = avl_value(node);
+	range->maxPages = range->pages;
+	if(avl_left(node) != NULL)
+		range->maxPages = MAX(range->maxPages, ((vmm_range_t*)avl_value(avl_left(node)))->maxPages);
+	if(avl_right(node) != NULL)
+		range->maxPages = MAX(range->maxPages, ((vmm_range_t*)avl_value(avl_right(node)))->maxPages);
+}
+
+static const avl_callbacks range_callbacks = {
+	.alloc = range_alloc,
+	.free = range_free,
+	.update = range_update
+};
+
+static int range_cmp(const void *a, const void *b, void *context __attribute__((unused)))
+{
+	const vmm_range_t *ra = a, *rb = b;
+	return (ra->start > rb->start) - (ra->start < rb->start);
+}
+
+/*
+ * Der Kernelspace wird im Kernelkontext verwaltet, da er in allen Kontexten derselbe ist
+ */
+static avl_tree **getRanges(context_t *context, uintptr_t address)
+{
+	return (address >= USERSPACE_START) ? &context->freeRanges : &kernel_context.freeRanges;
+}
+
+/*
+ * Sucht den freien Bereich mit der grössten Startadresse kleiner als address
+ */
+static vmm_range_t *rangeFindBelow(avl_tree *tree, uintptr_t address)
+{
+	vmm_range_t *result = NULL;
+	while(tree != NULL)
+	{
+		vmm_range_t *range = avl_value(tree);
+		if(range->start < address)
+		{
+			result = range;
+			tree = avl_right(tree);
 		}
 		else
 		{
-			if(found_pages == 0)
-			{
-				begin_PTi = 0;
-				begin_PDi = 0;
-				begin_PDPi = 0;
-				begin_PML4i = PML4i;
-			}
-			found_pages += VMM_PAGES_PER_PDP;
+			tree = avl_left(tree);
 		}
+	}
+	return result;
+}
+
+static void rangeInsert(avl_tree **ranges, uintptr_t start, uintptr_t end)
+{
+	vmm_range_t *range = range_alloc(sizeof(vmm_range_t), NULL);
+	//Ohne Speicher geht der Bereich verloren
+	if(range == NULL)
+		return;
+	range->start = start;
+	range->pages = (end - start) / VMM_SIZE_PER_PAGE;
+	range->maxPages = range->pages;
+	avl_add_c(ranges, range, range_cmp, NULL, &range_callbacks);
+}
+
+static void rangeRemove(avl_tree **ranges, vmm_range_t *range)
+{
+	avl_remove_c(ranges, range, range_cmp, NULL, &range_callbacks);
+	range_free(range, NULL);
+}
+
+/*
+ * Entfernt den Bereich [start, end) aus den freien Bereichen
+ */
+static void rangeReserve(avl_tree **ranges, uintptr_t start, uintptr_t end)
+{
+	vmm_range_t *range;
+	while((range = rangeFindBelow(*ranges, end)) != NULL)
+	{
+		const uintptr_t range_start = range->start;
+		const uintptr_t range_end = range->start + range->pages * VMM_SIZE_PER_PAGE;
+		if(range_end <= start)
+			break;
+
+		rangeRemove(ranges, range);
+		if(range_start < start)
+			rangeInsert(ranges, range_start, start);
+		if(range_end > end)
+			rangeInsert(ranges, end, range_end);
+	}
+}
+
+/*
+ * Fügt den Bereich [start, end) zu den freien Bereichen hinzu und verbindet ihn mit den angrenzenden Bereichen
+ */
+static void rangeRelease(avl_tree **ranges, uintptr_t start, uintptr_t end)
+{
+	rangeReserve(ranges, start, end);
+
+	vmm_range_t *prev = rangeFindBelow(*ranges, start);
+	if(prev != NULL && prev->start + prev->pages * VMM_SIZE_PER_PAGE == start)
+	{
+		start = prev->start;
+		rangeRemove(ranges, prev);
+	}
+	vmm_range_t *next = rangeFindBelow(*ranges, end + 1);
+	if(next != NULL && next->start == end)
+	{
+		end += next->pages * VMM_SIZE_PER_PAGE;
+		rangeRemove(ranges, next);
+	}
+	rangeInsert(ranges, start, end);
+}
 
-		if(found_pages >= pages)
-			return VMM_GET_ADDRESS(begin_PML4i, begin_PDPi, begin_PDi, begin_PTi);
+/*
+ * Markiert einen Bereich als belegt
+ */
+static void reserveRange(context_t *context, void *address, size_t pages)
+{
+	rangeReserve(getRanges(context, (uintptr_t)address), (uintptr_t)address, (uintptr_t)address + pages * VMM_SIZE_PER_PAGE);
+}
+
+/*
+ * Gibt einen Bereich wieder frei. Adressen ausserhalb des Kernel- bzw. Userspaces werden ignoriert.
+ */
+static void releaseRange(context_t *context, void *address, size_t pages)
+{
+	uintptr_t start = (uintptr_t)address;
+	uintptr_t end = start + pages * VMM_SIZE_PER_PAGE;
+	if(start >= USERSPACE_START)
+		end = MIN(end, USERSPACE_END + 1);
+	else
+	{
+		start = MAX(start, KERNELSPACE_START);
+		end = MIN(end, KERNELSPACE_END + 1);
 	}
+	if(start < end)
+		rangeRelease(getRanges(context, start), start, end);
+}
 
+/*
+ * Sucht den freien Bereich mit der tiefsten Adresse, der mindestens pages Pages gross ist (O(log n))
+ * Rückgabewert:	Anfangsadresse des Bereichs oder NULL, wenn kein Bereich gross genug ist
+ */
+static void *getFreePages(context_t *context, bool user, size_t pages)
+{
+	avl_tree *tree = *getRanges(context, user ? USERSPACE_START : KERNELSPACE_START);
+	while(tree != NULL)
+	{
+		avl_tree *left = avl_left(tree);
+		avl_tree *right = avl_right(tree);
+		vmm_range_t *range = avl_value(tree);
+		if(left != NULL && ((vmm_range_t*)avl_value(left))->maxPages >= pages)
+			tree = left;
+		else if(range->pages >= pages)
+			return (void*)range->start;
+		else if(right != NULL && ((vmm_range_t*)avl_value(right))->maxPages >= pages)
+			tree = right;
+		else
+			break;
+	}
 	return NULL;
 }
 
-static uint8_t unmap_entry(void *vAddress, PageTable_t table, uint32_t level, struct unmap_result *unmap_res) {
+/*
+ * Trägt alle nicht belegten Pages zwischen start und end in die freien Bereiche ein.
+ * Nicht vorhandene Tabellen werden dabei übersprungen.
+ */
+static void initRanges(context_t *context, uintptr_t start, uintptr_t end)
+{
+	uintptr_t free_start = start;
+	uintptr_t address = start;
+	while(address < end)
+	{
+		PageTable_t table = MAPPED_PHYS_MEM_GET(context->physAddress);
+		bool used = false;
+		uint32_t level;
+		for(level = 0; level < 3; level++)
+		{
+			const PageTableEntry_t entry = table[PAGE_TABLE_INDEX(address, level)];
+			if(!entry.P)
+				break;
+			if(level > 0 && entry.PS_PAT)
+			{
+				used = true;
+				break;
+			}
+			table = MAPPED_PHYS_MEM_GET(entry.Address << 12);
+		}
+		if(level == 3)
+			used = VMM_ALLOCATED(table[PT_INDEX(address)].entry);
+
+		//Grösse des Bereichs, der durch den Eintrag abgedeckt wird
+		const uintptr_t size = (uintptr_t)VMM_SIZE_PER_PAGE << (9 * (3 - level));
+		if(used)
+		{
+			if(free_start < address)
+				rangeRelease(getRanges(context, free_start), free_start, address);
+			free_start = (address & ~(size - 1)) + size;
+		}
+		address = (address & ~(size - 1)) + size;
+	}
+	if(free_start < end)
+		rangeRelease(getRanges(context, free_start), free_start, end);
+}
+
+/*
+ * Entfernt das Mapping einer Page. Wenn large gesetzt ist, wird nur eine 2MiB Page entfernt, ansonsten wird eine
+ * 2MiB Page aufgeteilt und nur die 4KiB Page entfernt.
+ * Die TLB-Einträge werden nicht invalidiert und nicht mehr benötigte Page Tables werden in unmap_res zurückgegeben.
+ */
+static uint8_t unmap_entry(context_t *context, void *vAddress, PageTable_t table, uint32_t level, bool large, struct unmap_result *unmap_res) {
 	const uint8_t FLAG_CLEAR_FULL_FLAG = 1 << 0;
 	const uint8_t FLAG_DELETE_TABLE = 1 << 1;
 
 	uint32_t index = PAGE_TABLE_INDEX(vAddress, level);
+	bool leaf = level == 3;
+
+	if (level == 2 && table[index].P) {
+		if (large != table[index].PS_PAT) {
+			// Without memory for a new page table the page stays mapped
+			if (large || !splitLargePage(context, &table[index].entry, vAddress)) return 0;
+		}
+		leaf = large;
+	}
 
-	if (level < 3) {
+	if (!leaf) {
 		if (!table[index].P) return FLAG_CLEAR_FULL_FLAG;
 
 		PageTable_t next_table = MAPPED_PHYS_MEM_GET(table[index].Address << 12);
-		uint8_t res = unmap_entry(vAddress, next_table, level + 1, unmap_res);
+		uint8_t res = unmap_entry(context, vAddress, next_table, level + 1, large, unmap_res);
 		if (res & FLAG_DELETE_TABLE) {
-			pmm_Free(table[index].Address << 12);
+			unmap_res->tables[unmap_res->tableCount++] = table[index].Address << 12;
 		} else {
 			if (res & FLAG_CLEAR_FULL_FLAG) {
 				// Clear full flag
@@ -327,9 +759,9 @@ static uint8_t unmap_entry(void *vAddress, PageTable_t table, uint32_t level, st
 	}
 
 	table[index].entry = 0;
-	if (level == 3) {
-		InvalidateTLBEntry(vAddress);
-	}
+
+	// Kernel page tables are shared by all contexts so they are never freed
+	if ((uintptr_t)vAddress <= KERNELSPACE_END) return FLAG_CLEAR_FULL_FLAG;
 
 	// Check if we still need this page table
 	if (level > 0) {
@@ -343,13 +775,111 @@ static uint8_t unmap_entry(void *vAddress, PageTable_t table, uint32_t level, st
 	return FLAG_DELETE_TABLE | FLAG_CLEAR_FULL_FLAG;
 }
 
-static struct unmap_result unmap(context_t *context, void *vAddress)
+/*
+ * Entfernt das Mapping einer Page bzw. einer 2MiB Page. Die Page Tables werden freigegeben, nachdem die
+ * TLB-Einträge ungültig gemacht wurden.
+ */
+static struct unmap_result unmap_gather(tlb_gather_t *gather, void *vAddress, bool large)
 {
 	struct unmap_result res = {};
-	unmap_entry(vAddress, MAPPED_PHYS_MEM_GET(context->physAddress), 0, &res);
+	unmap_entry(gather->context, vAddress, MAPPED_PHYS_MEM_GET(gather->context->physAddress), 0, large, &res);
+	if(res.paddr != 0 || res.tableCount > 0)
+		gather_range(gather, vAddress, large ? PAGE_ENTRIES : 1);
+	for(uint8_t i = 0; i < res.tableCount; i++)
+		gather_free(gather, res.tables[i], 1);
+	if(res.tableCount > 0)
+		accountTables(gather->context, vAddress, -(int64_t)res.tableCount);
 	return res;
 }
 
+/*
+ * Entfernt die Mappings eines Bereichs. 2MiB Pages, welche ganz im Bereich liegen, werden als Ganzes entfernt.
+ * Der TLB wird nur einmal pro VMM_GATHER_SIZE freigegebene Einträge invalidiert.
+ */
+static void unmapRange(context_t *context, void *vAddress, size_t pages, bool freePages)
+{
+	tlb_gather_t gather;
+	gather_init(&gather, context);
+	for(size_t i = 0; i < pages;)
+	{
+		void *address = vAddress + i * VMM_SIZE_PER_PAGE;
+		if(VMM_IS_LARGE_ALIGNED(address) && pages - i >= PAGE_ENTRIES)
+		{
+			paddr_t pAddress = unmap_gather(&gather, address, true).paddr;
+			if(pAddress != 0)
+			{
+				if(freePages)
+					gather_free(&gather, pAddress, PAGE_ENTRIES);
+				i += PAGE_ENTRIES;
+				continue;
+			}
+		}
+
+		paddr_t pAddress = unmap_gather(&gather, address, false).paddr;
+		if(freePages && pAddress != 0)
+			gather_free(&gather, pAddress, 1);
+		i++;
+	}
+	gather_flush(&gather);
+	releaseRange(context, vAddress, pages);
+}
+
+#ifdef DEBUGMODE
+static void range_count(const void *value, void *context)
+{
+	size_t *count = context;
+	count[0]++;
+	count[1] += ((const vmm_range_t*)value)->pages;
+}
+
+/*
+ * Belegt und entfernt viele Bereiche im Kernelspace. Danach müssen die freien Bereiche wieder dieselben sein.
+ */
+static void vmm_selfTest()
+{
+	static void *areas[4096];
+	static size_t sizes[4096];
+	size_t before[2] = {0, 0}, after[2] = {0, 0};
+	uint32_t seed = 1;
+
+	avl_visit_s(kernel_context.freeRanges, avl_visiting_in_order, range_count, before);
+
+	for(size_t i = 0; i < 4096; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		sizes[i] = (seed >> 16) % 16 + 1;
+		areas[i] = vmm_Map(&kernel_context, NULL, 0, sizes[i], VMM_FLAGS_WRITE | VMM_FLAGS_NX);
+		assert(areas[i] != NULL);
+	}
+	//Jeden zweiten Bereich entfernen und die Lücken mit neuen Bereichen füllen
+	for(size_t i = 0; i < 4096; i += 2)
+		vmm_UnMap(&kernel_context, areas[i], sizes[i], true);
+	for(size_t i = 0; i < 4096; i += 2)
+	{
+		seed = seed * 1103515245 + 12345;
+		sizes[i] = (seed >> 16) % 16 + 1;
+		areas[i] = vmm_Map(&kernel_context, NULL, 0, sizes[i], VMM_FLAGS_WRITE | VMM_FLAGS_NX);
+		assert(areas[i] != NULL);
+	}
+	for(size_t i = 0; i < 4096; i++)
+	{
+		for(size_t j = 0; j < sizes[i]; j++)
+			assert(!vmm_getPageStatus(&kernel_context, areas[i] + j * VMM_SIZE_PER_PAGE));
+		vmm_UnMap(&kernel_context, areas[i], sizes[i], true);
+	}
+
+	avl_visit_s(kernel_context.freeRanges, avl_visiting_in_order, range_count, after);
+	assert(before[0] == after[0] && before[1] == after[1]);
+	SysLog("VMM", "Selbsttest erfolgreich");
+}
+#endif
+
+//Zählt die beim Booten erstellten Page Tables
+static void countKernelTable(paddr_t table __attribute__((unused)))
+{
+	accountTables(&kernel_context, (void*)KERNELSPACE_START, 1);
+}
+
 /*
  * Initialisiert die virtuelle Speicherverwaltung.
  * Parameter:	Speicher = Grösse des phys. Speichers
@@ -425,10 +955,13 @@ bool vmm_Init()
 
 	// Mark all pages tables as reserved
 	vmm_getPageTables(pmm_markPageReserved);
+	vmm_getPageTables(countKernelTable);
 
 	//Speicher bis 1MB bearbeiten
 	//Addresse 0 ist nicht gemappt
-	unmap(&kernel_context, NULL);
+	tlb_gather_t gather;
+	gather_init(&gather, &kernel_context);
+	unmap_gather(&gather, NULL, false);
 	for(uint8_t *i = (uint8_t*)0x1000; i < (uint8_t*)0x100000; i += 0x1000)
 	{
 		vmm_ChangeMap(&kernel_context, i, (paddr_t)i, VMM_FLAGS_GLOBAL | VMM_FLAGS_NX | VMM_FLAGS_WRITE, 0);
@@ -448,9 +981,17 @@ bool vmm_Init()
 	//Den restlichen virtuellen Speicher freigeben
 	while(!vmm_getPageStatus(&kernel_context, i))
 	{
-		unmap(&kernel_context, i);
+		unmap_gather(&gather, i, false);
 		i += 0x1000;
 	}
+	gather_flush(&gather);
+
+	//Freie Bereiche des Kernelspaces bestimmen
+	initRanges(&kernel_context, KERNELSPACE_START, KERNELSPACE_END + 1);
+
+	#ifdef DEBUGMODE
+	vmm_selfTest();
+	#endif
 
 	SysLog("VMM", "Initialisierung abgeschlossen");
 	return true;
@@ -528,7 +1069,8 @@ void *vmm_AllocDMA(paddr_t maxAddress, size_t Size, paddr_t *Phys)
 static void walkPageTable(PageTable_t table, uint32_t level, void(*callback)(paddr_t)) {
 	const uint32_t end = PAGE_ENTRIES - (level == 0);
 	for (uint32_t i = 0; i < end; i++) {
-		if (table[i].P) {
+		// Large pages are not page tables
+		if (table[i].P && !(level > 0 && table[i].PS_PAT)) {
 			paddr_t page = table[i].Address << 12;
 			callback(page);
 
@@ -547,35 +1089,63 @@ void vmm_getPageTables(void(*callback)(paddr_t)) {
 }
 
 //----------------------Allgemeine Funktionen------------------------
-static void *mapPages(context_t *context, void *vAddress, paddr_t pAddress, size_t pages, uint8_t flags, bool guard) {
+static void *mapPages(context_t *context, void *vAddress, paddr_t pAddress, size_t pages, uint8_t flags, bool guard, uint16_t avl) {
 	bool unused = pAddress == 0;
 	bool allocate = flags & VMM_FLAGS_ALLOCATE;
-	uint16_t avl = (unused && !allocate) ? VMM_UNUSED_PAGE : 0;
+	avl |= (unused && !allocate) ? VMM_UNUSED_PAGE : 0;
 
 	if (pages == 0) return NULL;
 
 	if (guard) pages += MM_GUARD_PAGES * 2;
 
-	return LOCKED_RESULT(vmm_lock, {
+	return VMM_LOCKED_RESULT({
 		if (vAddress == NULL) {
-			void *start = (void*)((flags & VMM_FLAGS_USER) ? USERSPACE_START : KERNELSPACE_START);
-			void *end = (void*)((flags & VMM_FLAGS_USER) ? USERSPACE_END : KERNELSPACE_END);
-			vAddress = getFreePages(context, start, end, pages);
+			bool user = flags & VMM_FLAGS_USER;
+			// Big areas are aligned to 2MiB so that they can be mapped with large pages
+			if (!guard && pages >= PAGE_ENTRIES) {
+				vAddress = getFreePages(context, user, pages + PAGE_ENTRIES - 1);
+				if (vAddress != NULL)
+					vAddress = (void*)(((uintptr_t)vAddress + PG_LARGE_PAGE_SIZE - 1) & ~(PG_LARGE_PAGE_SIZE - 1));
+			} else {
+				vAddress = getFreePages(context, user, pages);
+			}
 		}
 
-		bool error = false;
+		bool error = vAddress == NULL;
 		size_t i;
-		for (i = 0; i < pages; i++) {
+		for (i = 0; !error && i < pages; i++) {
 			paddr_t paddr = 0;
 			uintptr_t currentOffset = i * VMM_SIZE_PER_PAGE;
 			uint16_t actual_avl = avl;
 			uint8_t actual_flags = flags;
 			bool is_guard_page = guard && (i < MM_GUARD_PAGES || i >= pages - MM_GUARD_PAGES);
+
+			// Use a 2MiB page if the physical memory is known and the area covers the whole large page.
+			// Unused pages are mapped with 4KiB pages and promoted once most of them are used (see handlePageFault).
+			if (!guard && (allocate || !unused) && pages - i >= PAGE_ENTRIES && VMM_IS_LARGE_ALIGNED(vAddress + currentOffset)
+					&& (allocate || VMM_IS_LARGE_ALIGNED(pAddress + currentOffset))) {
+				paddr = allocate ? pmm_AllocLarge(PAGE_ENTRIES) : pAddress + currentOffset;
+				if (paddr != 1) {
+					if (mapLarge(context, vAddress + currentOffset, paddr, flags) == 0) {
+						if (allocate) {
+							for (size_t j = 0; j < PAGE_ENTRIES; j++)
+								clearPage(vAddress + currentOffset + j * VMM_SIZE_PER_PAGE);
+						}
+						i += PAGE_ENTRIES - 1;
+						continue;
+					}
+					if (allocate) {
+						for (size_t j = 0; j < PAGE_ENTRIES; j++)
+							pmm_Free(paddr + j * VMM_SIZE_PER_PAGE);
+					}
+				}
+			}
+
 			if (is_guard_page) {
 				actual_avl = VMM_GUARD_PAGE;
 				actual_flags = 0;
 			} else if (allocate) {
-				paddr = pmm_Alloc();
+				paddr = pmm_AllocZeroed();
 				if (paddr == 1) {
 					error = true;
 					break;
@@ -588,38 +1158,315 @@ static void *mapPages(context_t *context, void *vAddress, paddr_t pAddress, size
 				error = true;
 				break;
 			}
-			if (allocate && !is_guard_page) clearPage(vAddress + currentOffset);
 		}
 
 		if (error) {
-			for (size_t j = 0; j < i; j++) {
-				paddr_t paddr = unmap(context, vAddress + j * VMM_SIZE_PER_PAGE).paddr;
-				if (allocate) pmm_Free(paddr);
-			}
+			if (vAddress != NULL) unmapRange(context, vAddress, i, allocate);
+		} else {
+			reserveRange(context, vAddress, pages);
 		}
 		error ? NULL : (vAddress + guard * MM_GUARD_PAGES * VMM_SIZE_PER_PAGE);
 	});
 }
 
 void *vmm_Map(context_t *context, void *vAddress, paddr_t pAddress, size_t pages, uint8_t flags) {
-	return mapPages(context, vAddress, pAddress, pages, flags, false);
+	return mapPages(context, vAddress, pAddress, pages, flags, false, 0);
 }
 
 void *vmm_MapGuarded(context_t *context, void *vAddress, paddr_t pAddress, size_t pages, uint8_t flags) {
-	return mapPages(context, vAddress, pAddress, pages, flags, true);
+	return mapPages(context, vAddress, pAddress, pages, flags, true, 0);
+}
+
+static void pageCacheFree(const void *c) {
+	vmm_page_cache_t *cache = (vmm_page_cache_t*)c;
+	for (size_t i = 0; i < cache->pages; i++) {
+		if (cache->frames[i] != 0) pmm_Free(cache->frames[i]);
+	}
+	free(cache);
+}
+
+vmm_page_cache_t *vmm_createPageCache(size_t pages) {
+	vmm_page_cache_t *cache = calloc(1, sizeof(vmm_page_cache_t) + pages * sizeof(paddr_t));
+	if (cache == NULL) return NULL;
+	cache->pages = pages;
+	REFCOUNT_INIT(cache, pageCacheFree);
+	return cache;
+}
+
+vmm_page_cache_t *vmm_growPageCache(const vmm_page_cache_t *cache, size_t pages) {
+	assert(pages >= cache->pages);
+	vmm_page_cache_t *newCache = vmm_createPageCache(pages);
+	if (newCache == NULL) return NULL;
+	for (size_t i = 0; i < cache->pages; i++) {
+		paddr_t paddr = cache->frames[i];
+		if (paddr != 0 && pmm_Ref(paddr)) newCache->frames[i] = paddr;
+	}
+	return newCache;
+}
+
+void vmm_copyPageCache(vmm_page_cache_t *cache, uint64_t offset, size_t length, void *buffer, bool toCache) {
+	while (length > 0) {
+		const size_t index = offset / VMM_SIZE_PER_PAGE;
+		const size_t pageOffset = offset % VMM_SIZE_PER_PAGE;
+		const size_t size = MIN(length, VMM_SIZE_PER_PAGE - pageOffset);
+		if (index >= cache->pages) break;
+
+		paddr_t paddr = cache->frames[index];
+		if (paddr != 0 && pmm_Ref(paddr)) {
+			void *page = MAPPED_PHYS_MEM_GET(paddr) + pageOffset;
+			//Der Buffer kann selbst eine Page des Caches sein
+			if (page != buffer) {
+				if (toCache)
+					memcpy(page, buffer, size);
+				else
+					memcpy(buffer, page, size);
+			}
+			pmm_Free(paddr);
+		}
+		offset += size;
+		buffer += size;
+		length -= size;
+	}
+}
+
+static bool regionsLock(context_t *context, lock_node_t *node) {
+	bool irq = cpu_disableInterrupts();
+	lock(&context->regionsLock, node);
+	return irq;
+}
+
+static void regionsUnlock(context_t *context, lock_node_t *node, bool irq) {
+	unlock(&context->regionsLock, node);
+	cpu_restoreInterrupts(irq);
+}
+
+static void fileRegionFree(const void *r) {
+	vmm_file_region_t *region = (vmm_file_region_t*)r;
+	vfs_Close(region->stream);
+	if (region->cache != NULL) REFCOUNT_RELEASE(region->cache);
+	free(region);
+}
+
+/*
+ * Sucht den Dateibereich, zu welchem eine Page gehört.
+ * Rückgabewert:	Bereich mit einer zusätzlichen Referenz oder NULL
+ */
+static vmm_file_region_t *getFileRegion(context_t *context, uintptr_t page) {
+	lock_node_t node;
+	bool irq = regionsLock(context, &node);
+	vmm_file_region_t *region = context->fileRegions;
+	while (region != NULL && (page < region->start || page >= region->end))
+		region = region->next;
+	if (region != NULL) REFCOUNT_RETAIN(region);
+	regionsUnlock(context, &node, irq);
+	return region;
+}
+
+/*
+ * Gibt den nächsten Dateibereich zurück und die Referenz auf den übergebenen Bereich frei.
+ * Parameter:		region = aktueller Bereich oder NULL für den ersten Bereich
+ * Rückgabewert:	Bereich mit einer zusätzlichen Referenz oder NULL
+ */
+static vmm_file_region_t *nextFileRegion(context_t *context, vmm_file_region_t *region) {
+	lock_node_t node;
+	bool irq = regionsLock(context, &node);
+	vmm_file_region_t *next = (region != NULL) ? region->next : context->fileRegions;
+	if (next != NULL) REFCOUNT_RETAIN(next);
+	regionsUnlock(context, &node, irq);
+	if (region != NULL) REFCOUNT_RELEASE(region);
+	return next;
+}
+
+/*
+ * Schreibt die veränderten Pages eines geteilten Dateibereichs in die Datei zurück.
+ * Parameter:		start, end = zurückzuschreibende Pages
+ */
+static void syncRegion(context_t *context, vmm_file_region_t *region, uintptr_t start, uintptr_t end) {
+	start = MAX(start, region->start);
+	end = MIN(end, PG_PAGE_ALIGN_ROUND_UP(region->data + region->size));
+	for (uintptr_t page = start; page < end; page += VMM_SIZE_PER_PAGE) {
+		paddr_t paddr = VMM_LOCKED_RESULT({
+			paddr_t res = 0;
+			uint64_t *PDE = getPDEntry(context, (void*)page);
+			if (PDE != NULL && (*PDE & (PG_P | PG_PS)) == PG_P) {
+				uint64_t *PTE = &((PT_t*)MAPPED_PHYS_MEM_GET(*PDE & PG_ADDRESS))->PTE[PT_INDEX(page)];
+				const uint64_t entry = *PTE;
+				if ((entry & (PG_P | PG_D)) == (PG_P | PG_D) && (PG_AVL(entry) & VMM_FILE_PAGE) && pmm_Ref(entry & PG_ADDRESS)) {
+					//Das Dirty-Bit wird vom Prozessor gesetzt, daher darf der Eintrag nur atomar verändert werden
+					__sync_fetch_and_and(PTE, ~PG_D);
+					invalidateRange(context, (void*)page, 1);
+					res = entry & PG_ADDRESS;
+				}
+			}
+			res;
+		});
+		if (paddr == 0) continue;
+
+		//Die Page kann von einem neueren Bereich verdeckt sein
+		vmm_file_region_t *owner = getFileRegion(context, page);
+		if (owner == region) {
+			const uintptr_t from = MAX(page, region->data);
+			const uintptr_t to = MIN(page + VMM_SIZE_PER_PAGE, region->data + region->size);
+			if (from < to)
+				vfs_Write(region->stream, region->offset + (from - region->data), to - from, MAPPED_PHYS_MEM_GET(paddr) + (from - page));
+		}
+		if (owner != NULL) REFCOUNT_RELEASE(owner);
+		pmm_Free(paddr);
+	}
+}
+
+void vmm_SyncFile(context_t *context, void *vAddress, size_t pages) {
+	const uintptr_t start = (uintptr_t)vAddress & ~(VMM_SIZE_PER_PAGE - 1);
+	const uintptr_t end = start + pages * VMM_SIZE_PER_PAGE;
+	for (vmm_file_region_t *region = nextFileRegion(context, NULL); region != NULL; region = nextFileRegion(context, region)) {
+		if (region->shared && region->start < end && start < region->end) syncRegion(context, region, start, end);
+	}
+}
+
+/*
+ * Entfernt die Dateibereiche aus einem Bereich des Adressraums. Teilweise abgedeckte Bereiche werden verkleinert,
+ * Bereiche mit einem Loch in der Mitte werden in zwei Bereiche aufgeteilt.
+ */
+static void removeFileRegions(context_t *context, uintptr_t start, uintptr_t end) {
+	//Der obere Teil eines aufzuteilenden Bereichs wird ohne Lock vorbereitet
+	vmm_file_region_t *copy = NULL, *copyOf = NULL;
+	bool splitFailed = false;
+	while (true) {
+		vmm_file_region_t *removed = NULL, *split = NULL;
+		bool inserted = false;
+		lock_node_t node;
+		bool irq = regionsLock(context, &node);
+		for (vmm_file_region_t **r = &context->fileRegions; *r != NULL;) {
+			vmm_file_region_t *region = *r;
+			if (start <= region->start && region->end <= end) {
+				*r = region->next;
+				region->next = NULL;
+				removed = region;
+				break;
+			}
+			if (region->start < start && end < region->end) {
+				if (region == copyOf && copy != NULL) {
+					vfs_stream_t *stream = copy->stream;
+					*copy = *region;
+					REFCOUNT_INIT(copy, fileRegionFree);
+					copy->stream = stream;
+					if (copy->cache != NULL) REFCOUNT_RETAIN(copy->cache);
+					copy->start = end;
+					region->end = start;
+					region->next = copy;
+					r = &copy->next;
+					copy = NULL;
+					inserted = true;
+					continue;
+				}
+				if (!splitFailed && copy == NULL) {
+					REFCOUNT_RETAIN(region);
+					split = region;
+					break;
+				}
+			}
+			else if (start <= region->start && region->start < end)
+				region->start = end;
+			else if (region->start < start && start < region->end && region->end <= end)
+				region->end = start;
+			r = &region->next;
+		}
+		regionsUnlock(context, &node, irq);
+
+		if (split != NULL) {
+			copy = malloc(sizeof(vmm_file_region_t));
+			if (copy != NULL) {
+				ERROR_TYPE_POINTER(vfs_stream_t) stream_ret = vfs_Reopen(split->stream, vfs_getStreamMode(split->stream));
+				if (ERROR_DETECT(stream_ret)) {
+					free(copy);
+					copy = NULL;
+				} else {
+					copy->stream = ERROR_GET_VALUE(stream_ret);
+				}
+			}
+			//Ohne Speicher bleibt der Bereich bestehen und deckt das Loch weiterhin ab
+			splitFailed = (copy == NULL);
+			if (copyOf != NULL) REFCOUNT_RELEASE(copyOf);
+			copyOf = (copy != NULL) ? split : NULL;
+			if (copyOf == NULL) REFCOUNT_RELEASE(split);
+			continue;
+		}
+		if (removed != NULL)
+			REFCOUNT_RELEASE(removed);
+		else if (!inserted)
+			break;
+	}
+
+	//Der Bereich wurde inzwischen von einem anderen Thread verändert
+	if (copy != NULL) {
+		vfs_Close(copy->stream);
+		free(copy);
+	}
+	if (copyOf != NULL) REFCOUNT_RELEASE(copyOf);
+}
+
+static void *mapFile(context_t *context, void *vAddress, size_t size, uint8_t flags, vfs_stream_t *stream, uint64_t offset, size_t fileSize,
+		vmm_page_cache_t *cache, size_t cacheIndex, bool shared) {
+	if (fileSize > size || size == 0) return NULL;
+
+	vmm_file_region_t *region = malloc(sizeof(vmm_file_region_t));
+	if (region == NULL) return NULL;
+
+	ERROR_TYPE_POINTER(vfs_stream_t) stream_ret = vfs_Reopen(stream, shared ? (VFS_MODE_READ | VFS_MODE_WRITE) : VFS_MODE_READ);
+	if (ERROR_DETECT(stream_ret)) {
+		free(region);
+		return NULL;
+	}
+
+	const size_t pageOffset = (uintptr_t)vAddress & (VMM_SIZE_PER_PAGE - 1);
+	const size_t pages = PG_PAGE_ALIGN_ROUND_UP(pageOffset + size) / VMM_SIZE_PER_PAGE;
+	void *mapping = mapPages(context, (void*)((uintptr_t)vAddress - pageOffset), 0, pages, flags & ~VMM_FLAGS_ALLOCATE, false,
+			VMM_FILE_PAGE | (shared ? VMM_SHARED_PAGE : 0));
+	if (mapping == NULL) {
+		vfs_Close(ERROR_GET_VALUE(stream_ret));
+		free(region);
+		return NULL;
+	}
+
+	REFCOUNT_INIT(region, fileRegionFree);
+	region->start = (uintptr_t)mapping;
+	region->end = region->start + pages * VMM_SIZE_PER_PAGE;
+	region->data = region->start + pageOffset;
+	region->offset = offset;
+	region->size = fileSize;
+	region->stream = ERROR_GET_VALUE(stream_ret);
+	assert(cache == NULL || cache->pages >= cacheIndex + pages);
+	region->cache = (cache != NULL) ? REFCOUNT_RETAIN(cache) : NULL;
+	region->cacheStart = region->start - cacheIndex * VMM_SIZE_PER_PAGE;
+	region->shared = shared;
+
+	//Die Pages sind noch nicht vorhanden, ein Zugriff vor dem Eintragen des Bereichs scheitert also höchstens
+	lock_node_t node;
+	bool irq = regionsLock(context, &node);
+	region->next = context->fileRegions;
+	context->fileRegions = region;
+	regionsUnlock(context, &node, irq);
+	return (void*)region->data;
+}
+
+void *vmm_MapFile(context_t *context, void *vAddress, size_t size, uint8_t flags, vfs_stream_t *stream, uint64_t offset, size_t fileSize,
+		vmm_page_cache_t *cache) {
+	return mapFile(context, vAddress, size, flags, stream, offset, fileSize, cache, 0, false);
+}
+
+void *vmm_MapFileCached(context_t *context, void *vAddress, size_t pages, uint8_t flags, vfs_stream_t *stream, uint64_t offset,
+		size_t fileSize, vmm_page_cache_t *cache, bool shared) {
+	assert(offset % VMM_SIZE_PER_PAGE == 0 && cache != NULL);
+	return mapFile(context, vAddress, pages * VMM_SIZE_PER_PAGE, flags, stream, offset, fileSize, cache, offset / VMM_SIZE_PER_PAGE, shared);
 }
 
 static void unmapPages(context_t *context, void *vAddress, size_t pages, bool freePages, bool guard) {
 	pages += guard * MM_GUARD_PAGES * 2;
 	vAddress -= guard * MM_GUARD_PAGES * VMM_SIZE_PER_PAGE;
-	LOCKED_TASK(vmm_lock, {
-		for(size_t i = 0; i < pages; i++)
-		{
-			paddr_t pAddress = unmap(context, vAddress + i * VMM_SIZE_PER_PAGE).paddr;
-			if(freePages && pAddress != 0)
-				pmm_Free(pAddress);
-		}
-	});
+	const bool user = (uintptr_t)vAddress >= USERSPACE_START;
+	if (user) vmm_SyncFile(context, vAddress, pages);
+	VMM_LOCKED_TASK(unmapRange(context, vAddress, pages, freePages));
+	if (user) removeFileRegions(context, (uintptr_t)vAddress, (uintptr_t)vAddress + pages * VMM_SIZE_PER_PAGE);
 }
 
 void vmm_UnMap(context_t *context, void *vAddress, size_t pages, bool freePages) {
@@ -649,7 +1496,6 @@ uint8_t vmm_ChangeMap(context_t *context, void *vAddress, paddr_t pAddress, uint
 	PML4_t *const PML4 = MAPPED_PHYS_MEM_GET(context->physAddress);
 	PDP_t *const PDP = MAPPED_PHYS_MEM_GET(PML4->PML4E[PML4i] & PG_ADDRESS);
 	PD_t *const PD = MAPPED_PHYS_MEM_GET(PDP->PDPE[PDPi] & PG_ADDRESS);
-	PT_t *const PT = MAPPED_PHYS_MEM_GET(PD->PDE[PDi] & PG_ADDRESS);
 
 	//Flags auslesen
 	bool US = (flags & VMM_FLAGS_USER);
@@ -660,17 +1506,29 @@ uint8_t vmm_ChangeMap(context_t *context, void *vAddress, paddr_t pAddress, uint
 	bool PCD = (flags & VMM_FLAGS_NO_CACHE);
 	bool PWT = (flags & VMM_FLAGS_PWT);
 
-	return LOCKED_RESULT(vmm_lock, {
+	return VMM_LOCKED_RESULT({
 		uint8_t res = 0;
-		if(isPageFree(&PML4->PML4E[PML4i], &PDP->PDPE[PDPi], &PD->PDE[PDi], &PT->PTE[PTi]))
+		//Eine 2MiB Page muss zuerst aufgeteilt werden
+		uint64_t *PDE = getPDEntry(context, vAddress);
+		if(PDE != NULL && (*PDE & (PG_P | PG_PS)) == (PG_P | PG_PS) && !splitLargePage(context, PDE, vAddress))
+		{
+			res = 1;
+		}
+		else if(isPageFree(&PML4->PML4E[PML4i], &PDP->PDPE[PDPi], &PD->PDE[PDi],
+				&((PT_t*)MAPPED_PHYS_MEM_GET(PD->PDE[PDi] & PG_ADDRESS))->PTE[PTi]))
 		{
 			if(map(context, vAddress, pAddress, flags, avl) == 1)
 			{
 				res = 1;
 			}
+			else
+			{
+				reserveRange(context, vAddress, 1);
+			}
 		}
 		else
 		{
+			PT_t *const PT = MAPPED_PHYS_MEM_GET(PD->PDE[PDi] & PG_ADDRESS);
 			setPTEntry(PTi, PT, P, RW, US, PWT, PCD, 0, 0, G, avl, 0, NX, pAddress);
 
 			//Reserved bits zurücksetzen
@@ -678,7 +1536,7 @@ uint8_t vmm_ChangeMap(context_t *context, void *vAddress, paddr_t pAddress, uint
 			PDP->PDPE[PDPi] &= ~0x1C0;
 			PML4->PML4E[PML4i] &= ~0x1C0;
 
-			InvalidateTLBEntry((void*)vAddress);
+			invalidateRange(context, vAddress, 1);
 		}
 		res;
 	});
@@ -698,13 +1556,104 @@ uint8_t vmm_ChangeMap(context_t *context, void *vAddress, paddr_t pAddress, uint
  *///TODO: Bei Fehler alles Rückgängig machen
 uint8_t vmm_ReMap(context_t *src_context, void *src, context_t *dst_context, void *dst, size_t length, uint8_t flags)
 {
-	for (size_t i = 0; i < length; i++) {
-		struct unmap_result res = unmap(src_context, src + i * VMM_SIZE_PER_PAGE);
-		uint8_t r;
-		if ((r = map(dst_context, dst + i * VMM_SIZE_PER_PAGE, res.paddr, flags, res.avl)) != 0)
-			return r;
+	return VMM_LOCKED_RESULT({
+		uint8_t r = 0;
+		size_t i;
+		tlb_gather_t gather;
+		gather_init(&gather, src_context);
+		for (i = 0; i < length; i++) {
+			struct unmap_result res = unmap_gather(&gather, src + i * VMM_SIZE_PER_PAGE, false);
+			if ((r = map(dst_context, dst + i * VMM_SIZE_PER_PAGE, res.paddr, flags, res.avl)) != 0)
+				break;
+		}
+		gather_flush(&gather);
+		//Bei einem Fehler wurde die letzte Page schon entfernt
+		releaseRange(src_context, src, i + (r != 0));
+		reserveRange(dst_context, dst, i);
+		r;
+	});
+}
+
+/*
+ * Prüft, ob alle Pages eines Bereichs gemappt sind. Guard Pages zählen nicht dazu.
+ */
+static bool isRangeMapped(context_t *context, void *vAddress, size_t pages)
+{
+	for(size_t i = 0; i < pages;)
+	{
+		void *address = vAddress + i * VMM_SIZE_PER_PAGE;
+		const uint64_t *PDE = getPDEntry(context, address);
+		if(PDE == NULL || !(*PDE & PG_P))
+			return false;
+		if(*PDE & PG_PS)
+		{
+			i += PAGE_ENTRIES - PT_INDEX(address);
+			continue;
+		}
+		const uint64_t entry = ((PT_t*)MAPPED_PHYS_MEM_GET(*PDE & PG_ADDRESS))->PTE[PT_INDEX(address)];
+		if(!(entry & PG_P) && !(PG_AVL(entry) & VMM_UNUSED_PAGE))
+			return false;
+		i++;
 	}
-	return 0;
+	return true;
+}
+
+/*
+ * Setzt die Zugriffsrechte eines PT-Eintrags bzw. einer 2MiB Page.
+ * Parameter:		shared = Die Page wird noch von anderen Kontexten benutzt und muss beim Schreiben kopiert werden
+ */
+static uint64_t protectEntry(uint64_t entry, uint8_t flags, bool shared)
+{
+	entry &= ~(PG_RW | PG_US | PG_NX | PG_AVL_BITS(VMM_COW_PAGE));
+	if(flags & VMM_FLAGS_WRITE)
+		entry |= shared ? PG_AVL_BITS(VMM_COW_PAGE) : PG_RW;
+	if((flags & VMM_FLAGS_USER) && !(flags & VMM_FLAGS_NO_ACCESS))
+		entry |= PG_US;
+	if((flags & VMM_FLAGS_NX) && cpuInfo.nx)
+		entry |= PG_NX;
+	return entry;
+}
+
+bool vmm_Protect(context_t *context, void *vAddress, size_t pages, uint8_t flags)
+{
+	return VMM_LOCKED_RESULT({
+		bool res = isRangeMapped(context, vAddress, pages);
+		tlb_gather_t gather;
+		gather_init(&gather, context);
+		for(size_t i = 0; res && i < pages;)
+		{
+			void *address = vAddress + i * VMM_SIZE_PER_PAGE;
+			uint64_t *PDE = getPDEntry(context, address);
+			if(*PDE & PG_PS)
+			{
+				//Ganz abgedeckte 2MiB Pages werden nicht aufgeteilt
+				if(VMM_IS_LARGE_ALIGNED(address) && pages - i >= PAGE_ENTRIES)
+				{
+					*PDE = protectEntry(*PDE, flags, false);
+					gather_range(&gather, address, PAGE_ENTRIES);
+					i += PAGE_ENTRIES;
+					continue;
+				}
+				if(!splitLargePage(context, PDE, address))
+				{
+					res = false;
+					break;
+				}
+			}
+
+			uint64_t *PTE = &((PT_t*)MAPPED_PHYS_MEM_GET(*PDE & PG_ADDRESS))->PTE[PT_INDEX(address)];
+			//Pages geteilter Dateibereiche liegen im Cache und werden direkt beschrieben
+			const bool shared = (*PTE & PG_P) && !(PG_AVL(*PTE) & VMM_SHARED_PAGE) && pmm_getRefCount(*PTE & PG_ADDRESS) > 1;
+			*PTE = protectEntry(*PTE, flags, shared);
+			//Nach dem Aufteilen einer reservierten 2MiB Page ist der PD-Eintrag nicht für den Userspace zugänglich
+			if(flags & VMM_FLAGS_USER)
+				*PDE |= PG_US;
+			gather_range(&gather, address, 1);
+			i++;
+		}
+		gather_flush(&gather);
+		res;
+	});
 }
 
 /*
@@ -760,11 +1709,20 @@ paddr_t vmm_getPhysAddress(context_t *context, void *virtualAddress)
 	const PD_t *const PD = MAPPED_PHYS_MEM_GET(PDP->PDPE[PDPi] & PG_ADDRESS);
 	const PT_t *const PT = MAPPED_PHYS_MEM_GET(PD->PDE[PDi] & PG_ADDRESS);
 
-	return isPageFree(&PML4->PML4E[PML4i], &PDP->PDPE[PDPi], &PD->PDE[PDi], &PT->PTE[PTi]) ? 0 : (paddr_t)(PT->PTE[PTi] & PG_ADDRESS);
+	if(isPageFree(&PML4->PML4E[PML4i], &PDP->PDPE[PDPi], &PD->PDE[PDi], &PT->PTE[PTi]))
+		return 0;
+	//1GiB bzw. 2MiB Pages
+	if(PDP->PDPE[PDPi] & PG_PS)
+		return (PDP->PDPE[PDPi] & PG_HUGE_ADDRESS) + ((uintptr_t)virtualAddress & (PG_PD_INDEX | PG_PT_INDEX));
+	if(PD->PDE[PDi] & PG_PS)
+		return (PD->PDE[PDi] & PG_LARGE_ADDRESS) + ((uintptr_t)virtualAddress & PG_PT_INDEX);
+	return (paddr_t)(PT->PTE[PTi] & PG_ADDRESS);
 }
 
-void vmm_unusePages(context_t *context, void *virt, size_t pages)
+static void unusePages(context_t *context, void *virt, size_t pages)
 {
+	tlb_gather_t gather;
+	gather_init(&gather, context);
 	for(void *address = virt; address < virt + pages * VMM_SIZE_PER_PAGE; address += VMM_SIZE_PER_PAGE)
 	{
 		//Einträge in die Page Tabellen
@@ -773,23 +1731,33 @@ void vmm_unusePages(context_t *context, void *virt, size_t pages)
 		const uint16_t PDi = PD_INDEX(address);
 		const uint16_t PTi = PT_INDEX(address);
 
+		//2MiB Pages werden aufgeteilt, damit die einzelnen Pages freigegeben werden können
+		uint64_t *PDE = getPDEntry(context, address);
+		if(PDE != NULL && (*PDE & (PG_P | PG_PS)) == (PG_P | PG_PS) && !splitLargePage(context, PDE, address))
+			continue;
+
 		const PML4_t *const PML4 = MAPPED_PHYS_MEM_GET(context->physAddress);
 		const PDP_t *const PDP = MAPPED_PHYS_MEM_GET(PML4->PML4E[PML4i] & PG_ADDRESS);
 		const PD_t *const PD = MAPPED_PHYS_MEM_GET(PDP->PDPE[PDPi] & PG_ADDRESS);
 		PT_t *const PT = MAPPED_PHYS_MEM_GET(PD->PDE[PDi] & PG_ADDRESS);
 
-		if(!isPageFree(&PML4->PML4E[PML4i], &PDP->PDPE[PDPi], &PD->PDE[PDi], &PT->PTE[PTi]) && (PG_AVL(PT->PTE[PTi]) & VMM_UNUSED_PAGE) == 0)
+		//Pages geteilter Dateibereiche bleiben gemappt, sonst gingen Änderungen ohne Zurückschreiben verloren
+		if(!isPageFree(&PML4->PML4E[PML4i], &PDP->PDPE[PDPi], &PD->PDE[PDi], &PT->PTE[PTi]) && (PG_AVL(PT->PTE[PTi]) & VMM_UNUSED_PAGE) == 0
+				&& (PG_AVL(PT->PTE[PTi]) & (VMM_FILE_PAGE | VMM_SHARED_PAGE)) != (VMM_FILE_PAGE | VMM_SHARED_PAGE))
 		{
 			paddr_t entry = PT->PTE[PTi];
-			pmm_Free(entry & PG_ADDRESS);
-			setPTEntry(PTi, PT, 0, !!(entry & PG_RW), !!(entry & PG_US), !!(entry & PG_PWT), !!(entry & PG_PCD), !!(entry & PG_A),
-					!!(entry & PG_D), !!(entry & PG_G), PG_AVL(entry) | VMM_UNUSED_PAGE, !!(entry & PG_PAT), !!(entry & PG_NX), 0);
-			InvalidateTLBEntry(address);
+			//Eine copy-on-write Page bekommt beim nächsten Zugriff eine eigene Page
+			const bool RW = (entry & PG_RW) || (PG_AVL(entry) & VMM_COW_PAGE);
+			setPTEntry(PTi, PT, 0, RW, !!(entry & PG_US), !!(entry & PG_PWT), !!(entry & PG_PCD), !!(entry & PG_A),
+					!!(entry & PG_D), !!(entry & PG_G), (PG_AVL(entry) & ~VMM_COW_PAGE) | VMM_UNUSED_PAGE, !!(entry & PG_PAT), !!(entry & PG_NX), 0);
+			gather_range(&gather, address, 1);
+			gather_free(&gather, entry & PG_ADDRESS, 1);
 		}
 	}
+	gather_flush(&gather);
 }
 
-void vmm_usePages(context_t *context, void *virt, size_t pages)
+static void usePages(context_t *context, void *virt, size_t pages)
 {
 	void *address = (void*)((uintptr_t)virt & ~0xFFF);
 
@@ -807,20 +1775,39 @@ void vmm_usePages(context_t *context, void *virt, size_t pages)
 		PT_t *const PT = MAPPED_PHYS_MEM_GET(PD->PDE[PDi] & PG_ADDRESS);
 
 		uint64_t entry = PT->PTE[PTi];
-		paddr_t pAddr = pmm_Alloc();
+		paddr_t pAddr = pmm_AllocZeroed();
 		if(pAddr == 1)
 			Panic("VMM", "Out of memory!");
 
 		setPTEntry(PTi, PT, 1, !!(entry & PG_RW), !!(entry & PG_US), !!(entry & PG_PWT), !!(entry & PG_PCD), !!(entry & PG_A),
 				!!(entry & PG_D), !!(entry & PG_G), PG_AVL(entry) & ~VMM_UNUSED_PAGE, !!(entry & PG_PAT), !!(entry & PG_NX), pAddr);
-		InvalidateTLBEntry(address);
-		clearPage(address);
+		//Nicht vorhandene Pages werden nicht im TLB gespeichert, daher muss nichts invalidiert werden
 	}
 }
 
+void vmm_unusePages(context_t *context, void *virt, size_t pages)
+{
+	VMM_LOCKED_TASK(unusePages(context, virt, pages));
+}
+
+void vmm_usePages(context_t *context, void *virt, size_t pages)
+{
+	VMM_LOCKED_TASK(usePages(context, virt, pages));
+}
+
 
 //Prozesse
 
+size_t vmm_getPageTablePages(const context_t *context)
+{
+	return context->tablePages;
+}
+
+size_t vmm_getTotalPageTablePages(void)
+{
+	return totalTablePages;
+}
+
 /*
  * Überprüft, ob ein Pointer in den Userspace bereich zeigt,
  * Parameter:	Den zu überprüfenden Pointer
@@ -828,7 +1815,8 @@ void vmm_usePages(context_t *context, void *virt, size_t pages)
  */
 bool vmm_userspacePointerValid(const void *ptr, const size_t size)
 {
-	return (USERSPACE_START <= (uintptr_t)ptr && (uintptr_t)ptr + size <= USERSPACE_END);
+	//ptr + size könnte überlaufen, deshalb wird die verbleibende Grösse verglichen
+	return (USERSPACE_START <= (uintptr_t)ptr && (uintptr_t)ptr <= USERSPACE_END && size <= USERSPACE_END - (uintptr_t)ptr);
 }
 
 /*
@@ -837,8 +1825,33 @@ bool vmm_userspacePointerValid(const void *ptr, const size_t size)
 context_t *createContext()
 {
 	context_t *context = malloc(sizeof(context_t));
-	context->physAddress = pmm_Alloc();
-	PML4_t *newPML4 = memset(MAPPED_PHYS_MEM_GET(context->physAddress), 0, MM_BLOCK_SIZE);
+	context->physAddress = pmm_AllocZeroed();
+	context->freeRanges = NULL;
+	context->fileRegions = NULL;
+	context->regionsLock = LOCK_INIT;
+	//Die PML4 gehört zu den Page Tables des Kontextes
+	context->tablePages = 0;
+	accountTables(context, (void*)USERSPACE_START, 1);
+	context->pcid = 0;
+	//Die PCID könnte auf allen CPUs noch Einträge des vorherigen Besitzers enthalten
+	context->staleCpus = -1ul;
+	VMM_LOCKED_TASK({
+		rangeInsert(&context->freeRanges, USERSPACE_START, USERSPACE_END + 1);
+		if(cpuInfo.pcid)
+		{
+			for(uint16_t i = 0; i < VMM_PCID_COUNT / 64; i++)
+			{
+				if(~pcid_map[i])
+				{
+					uint16_t bit = __builtin_ctzl(~pcid_map[i]);
+					pcid_map[i] |= 1ul << bit;
+					context->pcid = i * 64 + bit;
+					break;
+				}
+			}
+		}
+	});
+	PML4_t *newPML4 = MAPPED_PHYS_MEM_GET(context->physAddress);
 
 	//Kernel in den Adressraum einbinden
 	PML4_t *const PML4 = MAPPED_PHYS_MEM_GET(kernel_context.physAddress);
@@ -852,11 +1865,250 @@ context_t *createContext()
 	return context;
 }
 
+/*
+ * Kopiert eine Page Table des Userspaces rekursiv in eine leere Page Table. Beschreibbare Pages werden in beiden
+ * Kontexten schreibgeschützt und als copy-on-write markiert, alle anderen Pages werden geteilt.
+ * Kann eine Page nicht geteilt werden, wird sie sofort kopiert.
+ * Rückgabewert:	false = zu wenig phys. Speicher vorhanden
+ */
+static bool clone_table(context_t *context, context_t *newContext, PageTable_t src, PageTable_t dst, uint32_t level, uintptr_t address)
+{
+	const uintptr_t size = (uintptr_t)VMM_SIZE_PER_PAGE << (9 * (3 - level));
+	const uint16_t start = (level == 0) ? PML4e : 0;
+	const uint16_t end = (level == 0) ? PAGE_ENTRIES - 1 : PAGE_ENTRIES;
+
+	for(uint16_t i = start; i < end; i++)
+	{
+		const uintptr_t entry_address = address + i * size;
+		uint64_t entry = src[i].entry;
+		if(level < 3)
+		{
+			if(!(entry & PG_P))
+				continue;
+			//2MiB Pages werden aufgeteilt, damit die einzelnen Pages kopiert werden können
+			if(level == 2 && (entry & PG_PS))
+			{
+				if(!splitLargePage(context, &src[i].entry, (void*)VMM_EXTEND(entry_address)))
+					return false;
+				entry = src[i].entry;
+			}
+			//1GiB Pages werden im Userspace nicht verwendet
+			else if(level == 1 && (entry & PG_PS))
+			{
+				continue;
+			}
+
+			paddr_t table = pmm_AllocZeroed();
+			if(table == 1)
+				return false;
+			accountTables(newContext, (void*)VMM_EXTEND(entry_address), 1);
+			dst[i].entry = (entry & ~PG_ADDRESS) | table;
+			if(!clone_table(context, newContext, MAPPED_PHYS_MEM_GET(entry & PG_ADDRESS), MAPPED_PHYS_MEM_GET(table), level + 1, entry_address))
+				return false;
+		}
+		else if(entry & PG_P)
+		{
+			const paddr_t paddr = entry & PG_ADDRESS;
+			if(pmm_Ref(paddr))
+			{
+				//Pages geteilter Dateibereiche werden weiterhin von beiden Kontexten beschrieben
+				if(((entry & PG_RW) || (PG_AVL(entry) & VMM_COW_PAGE)) && !(PG_AVL(entry) & VMM_SHARED_PAGE))
+				{
+					entry = (entry & ~PG_RW) | PG_AVL_BITS(VMM_COW_PAGE);
+					src[i].entry = entry;
+				}
+				dst[i].entry = entry;
+			}
+			else
+			{
+				paddr_t copy = pmm_Alloc();
+				if(copy == 1)
+					return false;
+				memcpy(MAPPED_PHYS_MEM_GET(copy), MAPPED_PHYS_MEM_GET(paddr), VMM_SIZE_PER_PAGE);
+				dst[i].entry = (entry & ~PG_ADDRESS) | copy;
+			}
+		}
+		else
+		{
+			//Nicht benutzte Pages und Guard Pages
+			dst[i].entry = entry;
+		}
+	}
+	return true;
+}
+
+/*
+ * Erstellt eine Kopie des Userspaces eines Kontextes. Die Pages werden erst beim ersten Schreibzugriff kopiert.
+ * Rückgabewert:	NULL = zu wenig Speicher vorhanden
+ */
+context_t *cloneContext(context_t *context)
+{
+	context_t *newContext = createContext();
+	if(newContext == NULL)
+		return NULL;
+
+	//Noch nicht geladene Pages werden im neuen Kontext aus denselben Dateien geladen
+	vmm_file_region_t **next = &newContext->fileRegions;
+	for(vmm_file_region_t *region = nextFileRegion(context, NULL); region != NULL; region = nextFileRegion(context, region))
+	{
+		vmm_file_region_t *copy = malloc(sizeof(vmm_file_region_t));
+		if(copy == NULL)
+		{
+			REFCOUNT_RELEASE(region);
+			deleteContext(newContext);
+			return NULL;
+		}
+		*copy = *region;
+		copy->next = NULL;
+		ERROR_TYPE_POINTER(vfs_stream_t) stream_ret = vfs_Reopen(region->stream,
+				region->shared ? (VFS_MODE_READ | VFS_MODE_WRITE) : VFS_MODE_READ);
+		if(ERROR_DETECT(stream_ret))
+		{
+			free(copy);
+			REFCOUNT_RELEASE(region);
+			deleteContext(newContext);
+			return NULL;
+		}
+		REFCOUNT_INIT(copy, fileRegionFree);
+		copy->stream = ERROR_GET_VALUE(stream_ret);
+		if(copy->cache != NULL)
+			REFCOUNT_RETAIN(copy->cache);
+		*next = copy;
+		next = &copy->next;
+	}
+
+	bool success = VMM_LOCKED_RESULT({
+		bool res = clone_table(context, newContext, MAPPED_PHYS_MEM_GET(context->physAddress), MAPPED_PHYS_MEM_GET(newContext->physAddress), 0, 0);
+
+		//Die Pages des ursprünglichen Kontextes sind nun schreibgeschützt
+		invalidateRange(context, (void*)USERSPACE_START, (USERSPACE_END - USERSPACE_START + 1) / VMM_SIZE_PER_PAGE);
+
+		avl_free_c(newContext->freeRanges, range_destroy, &range_callbacks);
+		newContext->freeRanges = NULL;
+		initRanges(newContext, USERSPACE_START, USERSPACE_END + 1);
+		res;
+	});
+
+	if(!success)
+	{
+		deleteContext(newContext);
+		return NULL;
+	}
+	return newContext;
+}
+
+/*
+ * Behandelt einen Schreibzugriff auf eine copy-on-write Page. Ist der Kontext der einzige Besitzer der Page,
+ * wird sie wieder beschreibbar gemacht, ansonsten wird sie kopiert.
+ * Rückgabewert:	false = zu wenig phys. Speicher vorhanden
+ */
+static bool resolveCopyOnWrite(context_t *context, uint64_t *PTE, void *address)
+{
+	const uint64_t entry = *PTE;
+	paddr_t paddr = entry & PG_ADDRESS;
+	if(pmm_getRefCount(paddr) > 1)
+	{
+		paddr_t copy = pmm_Alloc();
+		if(copy == 1)
+			return false;
+		memcpy(MAPPED_PHYS_MEM_GET(copy), MAPPED_PHYS_MEM_GET(paddr), VMM_SIZE_PER_PAGE);
+		pmm_Free(paddr);
+		paddr = copy;
+	}
+	*PTE = (entry & ~(PG_ADDRESS | PG_AVL_BITS(VMM_COW_PAGE))) | paddr | PG_RW;
+	invalidateRange(context, (void*)((uintptr_t)address & ~(VMM_SIZE_PER_PAGE - 1)), 1);
+	return true;
+}
+
+/*
+ * Lädt den Inhalt einer Page aus der Datei, mit welcher der Bereich gemappt wurde.
+ * Parameter:		region = Dateibereich, zu welchem die Page gehört
+ * 					address = virtuelle Adresse, auf welche zugegriffen wurde
+ * 					interrupts = Interrupts dürfen während dem Lesen aktiviert werden
+ * Rückgabewert:	false = Die Page konnte nicht geladen werden
+ */
+static bool loadRegionPage(context_t *context, const vmm_file_region_t *region, void *address, bool interrupts)
+{
+	const uintptr_t page = (uintptr_t)address & ~(VMM_SIZE_PER_PAGE - 1);
+
+	//Wurde die Page schon von einem anderen Kontext geladen, wird sie mitbenutzt
+	const size_t index = (page - region->cacheStart) / VMM_SIZE_PER_PAGE;
+	paddr_t paddr = (region->cache != NULL) ? region->cache->frames[index] : 0;
+	if(paddr == 0 || !pmm_Ref(paddr))
+	{
+		paddr = pmm_AllocZeroed();
+		if(paddr == 1)
+			return false;
+		void *buffer = MAPPED_PHYS_MEM_GET(paddr);
+
+		const uintptr_t from = MAX(page, region->data);
+		const uintptr_t to = MIN(page + VMM_SIZE_PER_PAGE, region->data + region->size);
+		if(from < to)
+		{
+			if(interrupts)
+				CPU_ENABLE_INTERRUPTS();
+			size_t read = vfs_Read(region->stream, region->offset + (from - region->data), to - from, buffer + (from - page));
+			CPU_DISABLE_INTERRUPTS();
+			if(read < to - from)
+			{
+				pmm_Free(paddr);
+				return false;
+			}
+		}
+
+		//Der Cache bekommt eine eigene Referenz auf die Page
+		if(region->cache != NULL && pmm_Ref(paddr) && !__sync_bool_compare_and_swap(&region->cache->frames[index], 0, paddr))
+			pmm_Free(paddr);
+	}
+
+	//Während dem Lesen kann sich das Mapping geändert haben, deshalb wird der Eintrag erneut gesucht
+	bool mapped = VMM_LOCKED_RESULT({
+		bool res = false;
+		uint64_t *PDE = getPDEntry(context, address);
+		if(PDE != NULL && (*PDE & (PG_P | PG_PS)) == PG_P)
+		{
+			uint64_t *PTE = &((PT_t*)MAPPED_PHYS_MEM_GET(*PDE & PG_ADDRESS))->PTE[PT_INDEX(address)];
+			const uint64_t entry = *PTE;
+			if(!(entry & PG_P) && (PG_AVL(entry) & VMM_UNUSED_PAGE))
+			{
+				//Nicht vorhandene Pages werden nicht im TLB gespeichert, daher muss nichts invalidiert werden
+				*PTE = (entry & ~(PG_ADDRESS | PG_AVL_BITS(VMM_UNUSED_PAGE))) | paddr | PG_P;
+				//Beschreibbare Pages eines privaten Bereichs werden erst beim Schreiben aus dem Cache kopiert
+				if(region->cache != NULL && !region->shared && (entry & PG_RW))
+					*PTE = (*PTE & ~PG_RW) | PG_AVL_BITS(VMM_COW_PAGE);
+				res = true;
+			}
+		}
+		res;
+	});
+	//Ein anderer Thread hat die Page bereits geladen oder der Bereich wurde entfernt
+	if(!mapped)
+		pmm_Free(paddr);
+	return true;
+}
+
+static bool loadFilePage(context_t *context, void *address, bool interrupts)
+{
+	vmm_file_region_t *region = getFileRegion(context, (uintptr_t)address);
+	if(region == NULL)
+		return false;
+	bool res = loadRegionPage(context, region, address, interrupts);
+	//Beim Freigeben der letzten Referenz wird der Stream geschlossen
+	if(interrupts)
+		CPU_ENABLE_INTERRUPTS();
+	REFCOUNT_RELEASE(region);
+	CPU_DISABLE_INTERRUPTS();
+	return res;
+}
+
 /*
  * Löscht einen virtuellen Adressraum
  */
 void deleteContext(context_t *context)
 {
+	//Veränderte Pages geteilter Dateibereiche zurückschreiben
+	vmm_SyncFile(context, (void*)USERSPACE_START, (USERSPACE_END - USERSPACE_START + 1) / VMM_SIZE_PER_PAGE);
+
 	//Erst alle Pages des Kontextes freigeben
 	PML4_t *PML4 = MAPPED_PHYS_MEM_GET(context->physAddress);
 	for(uint16_t PML4i = PML4e; PML4i < PAGE_ENTRIES - 1; PML4i++)
@@ -877,8 +2129,16 @@ void deleteContext(context_t *context)
 					PD_t *PD = MAPPED_PHYS_MEM_GET(PD_phys);
 					for(uint16_t PDi = 0; PDi < PAGE_ENTRIES; PDi++)
 					{
+						//2MiB Page
+						if((PD->PDE[PDi] & (PG_P | PG_PS)) == (PG_P | PG_PS))
+						{
+							paddr_t Page_phys = PD->PDE[PDi] & PG_LARGE_ADDRESS;
+							for(uint16_t PTi = 0; PTi < PAGE_ENTRIES; PTi++)
+								pmm_Free(Page_phys + PTi * VMM_SIZE_PER_PAGE);
+							PD->PDE[PDi] = 0;
+						}
 						//Ist der Eintrag gültig
-						if(PD->PDE[PDi] & PG_P)
+						else if(PD->PDE[PDi] & PG_P)
 						{
 							//PT mappen
 							paddr_t PT_phys = PD->PDE[PDi] & PG_ADDRESS;
@@ -906,18 +2166,53 @@ void deleteContext(context_t *context)
 	}
 
 	//Restliche Datenstrukturen freigeben
+	VMM_LOCKED_TASK({
+		avl_free_c(context->freeRanges, range_destroy, &range_callbacks);
+		//Der nächste Besitzer der PCID leert deren Einträge auf jeder CPU beim ersten Aktivieren
+		if(context->pcid != 0)
+			pcid_map[context->pcid / 64] &= ~(1ul << (context->pcid % 64));
+	});
 	pmm_Free(context->physAddress);
+	__sync_fetch_and_sub(&totalTablePages, context->tablePages);
+
+	while(context->fileRegions != NULL)
+	{
+		vmm_file_region_t *region = context->fileRegions;
+		context->fileRegions = region->next;
+		REFCOUNT_RELEASE(region);
+	}
 	free(context);
 }
 
 /*
- * Aktiviert einen virtuellen Adressraum
+ * Aktiviert einen virtuellen Adressraum. Mit PCIDs bleiben die TLB-Einträge des Kontextes erhalten.
  */
-void activateContext(const context_t *context) {
-	cpu_writeControlRegister(CPU_CR3, context->physAddress);
+void activateContext(context_t *context) {
+	const uint64_t self = 1ul << cpu_getIndex();
+	uint64_t cr3 = context->physAddress;
+	if(cpuInfo.pcid)
+	{
+		cr3 |= context->pcid;
+		if(context->pcid != 0 && !(__sync_fetch_and_and(&context->staleCpus, ~self) & self))
+			cr3 |= PG_CR3_NOFLUSH;
+	}
+	cpu_writeControlRegister(CPU_CR3, cr3);
+
+	//Ab jetzt bekommt diese CPU die Invalidierungen des Kontextes. Wurde dazwischen etwas ungültig gemacht, ohne dass
+	//diese CPU unterbrochen wurde, ist das Bit wieder gesetzt.
+	CPU_LOCAL_SET(context, context);
+	if(context->pcid != 0 && (__sync_fetch_and_and(&context->staleCpus, ~self) & self))
+		FlushTLB();
 }
 
-int vmm_handlePageFault(context_t *context, void *page, uint64_t errorcode)
+//Die Page muss ohne gehaltenen Lock aus einer Datei geladen werden
+#define VMM_FAULT_FILE_PAGE	3
+
+/*
+ * Behandelt einen Page Fault. Muss mit gehaltenem vmm_lock aufgerufen werden.
+ * Rückgabewert:	0 = behoben, 1 = ungültiger Zugriff, 2 = Zugriff auf eine Guard Page, VMM_FAULT_FILE_PAGE
+ */
+static int handlePageFault(context_t *context, void *page, uint64_t errorcode)
 {
 	uint16_t PML4i = PML4_INDEX(page);
 	uint16_t PDPi = PDP_INDEX(page);
@@ -927,12 +2222,45 @@ int vmm_handlePageFault(context_t *context, void *page, uint64_t errorcode)
 	const PML4_t *const PML4 = MAPPED_PHYS_MEM_GET(context->physAddress);
 	const PDP_t *const PDP = MAPPED_PHYS_MEM_GET(PML4->PML4E[PML4i] & PG_ADDRESS);
 	const PD_t *const PD = MAPPED_PHYS_MEM_GET(PDP->PDPE[PDPi] & PG_ADDRESS);
-	const PT_t *const PT = MAPPED_PHYS_MEM_GET(PD->PDE[PDi] & PG_ADDRESS);
+	PT_t *const PT = MAPPED_PHYS_MEM_GET(PD->PDE[PDi] & PG_ADDRESS);
+
+	if(isPageFree(&PML4->PML4E[PML4i], &PDP->PDPE[PDPi], &PD->PDE[PDi], &PT->PTE[PTi]))
+		return 1;
+	//Eine andere CPU hat die Page inzwischen gemappt, z.B. weil sie durch eine 2MiB Page ersetzt wurde
+	const uint64_t entry = (PDP->PDPE[PDPi] & PG_PS) ? PDP->PDPE[PDPi] : (PD->PDE[PDi] & PG_PS) ? PD->PDE[PDi] : PT->PTE[PTi];
+	if((entry & PG_P) && (!(errorcode & 0x2) || (entry & PG_RW)) && (!(errorcode & 0x4) || (entry & PG_US))
+			&& (!(errorcode & 0x10) || !(entry & PG_NX)))
+		return 0;
+	//Zugriffsverletzung in einer grossen Page
+	if((PDP->PDPE[PDPi] & PG_PS) || (PD->PDE[PDi] & PG_PS))
+		return 1;
+	//Reservierte Pages des Userspaces dürfen erst nach einer Änderung der Zugriffsrechte benutzt werden
+	if((uintptr_t)page >= USERSPACE_START && !(PT->PTE[PTi] & PG_US))
+		return 1;
+
+	//Schreibzugriff auf eine vorhandene copy-on-write Page
+	if((errorcode & 0x3) == 0x3 && (PG_AVL(PT->PTE[PTi]) & VMM_COW_PAGE))
+	{
+		__sync_fetch_and_add(&fault_stats.copyOnWrite, 1);
+		return resolveCopyOnWrite(context, &PT->PTE[PTi], page) ? 0 : 1;
+	}
+
+	//Pages, welche aus einer Datei geladen werden, werden ohne Lock geladen (siehe vmm_handlePageFault)
+	if((PG_AVL(PT->PTE[PTi]) & (VMM_UNUSED_PAGE | VMM_FILE_PAGE)) == (VMM_UNUSED_PAGE | VMM_FILE_PAGE))
+	{
+		__sync_fetch_and_add(&fault_stats.file, 1);
+		return VMM_FAULT_FILE_PAGE;
+	}
 
 	//Activate unused pages
-	if(!isPageFree(&PML4->PML4E[PML4i], &PDP->PDPE[PDPi], &PD->PDE[PDi], &PT->PTE[PTi]) && (PG_AVL(PT->PTE[PTi]) & VMM_UNUSED_PAGE))
+	if(PG_AVL(PT->PTE[PTi]) & VMM_UNUSED_PAGE)
 	{
-		vmm_usePages(context, page, 1);
+		usePages(context, page, 1);
+		__sync_fetch_and_add(&fault_stats.demand, 1);
+		//Wird die Page Table grösstenteils benutzt, wird sie durch eine 2MiB Page ersetzt. Die Einträge werden nur ab
+		//und zu geprüft, damit nicht jeder Page Fault die ganze Page Table durchsucht.
+		if(PTi % VMM_PROMOTE_INTERVAL == VMM_PROMOTE_INTERVAL - 1 && promoteLargePage(context, page))
+			__sync_fetch_and_add(&fault_stats.largePages, 1);
 		return 0;
 	}
 	if (PG_AVL(PT->PTE[PTi]) & VMM_GUARD_PAGE) {
@@ -940,3 +2268,22 @@ int vmm_handlePageFault(context_t *context, void *page, uint64_t errorcode)
 	}
 	return 1;
 }
+
+int vmm_handlePageFault(context_t *context, void *page, uint64_t errorcode, bool interrupts)
+{
+	__sync_fetch_and_add(&fault_stats.total, 1);
+	//Die Einträge werden unter dem Lock gelesen, damit z.B. zwei CPUs dieselbe copy-on-write Page nicht beide
+	//kopieren oder munmap nicht gleichzeitig die Page Table freigibt
+	int res = VMM_LOCKED_RESULT(handlePageFault(context, page, errorcode));
+	//Beim Lesen aus der Datei kann unterbrochen werden, wenn der unterbrochene Code Interrupts zugelassen hat
+	if(res == VMM_FAULT_FILE_PAGE)
+		res = loadFilePage(context, page, interrupts) ? 0 : 1;
+	if(res != 0)
+		__sync_fetch_and_add(&fault_stats.unresolved, 1);
+	return res;
+}
+
+void vmm_getFaultStatistics(vmm_fault_stats_t *stats)
+{
+	*stats = fault_stats;
+}
@@ -13,6 +13,7 @@
 #include "pmm.h"
 #include "stdbool.h"
 #include "stddef.h"
+#include <refcount.h>
 
 #define VMM_FLAGS_WRITE		(1 << 0)	//Wenn gesetzt, dann kann auf die Page auch geschrieben werden ansonsten nur lesen
 #define VMM_FLAGS_GLOBAL	(1 << 1)	//Bestimmt, ob die Page global ist
@@ -21,10 +22,23 @@
 #define VMM_FLAGS_PWT		(1 << 4)	//Bestimmt, ob die Page mit write-through policy gecacht werden soll
 #define VMM_FLAGS_NO_CACHE	(1 << 5)	//Bestimmt, ob die Page nicht gecacht werden soll
 #define VMM_FLAGS_ALLOCATE	(1 << 6)	//Bestimmt, ob der physikalische Speicher schon alloziiert sein soll
+#define VMM_FLAGS_NO_ACCESS	(1 << 7)	//Userspace-Pages sind nur reserviert, jeder Zugriff ist ein Fehler
 
 #define VMM_UNUSED_PAGE		0x4		//Marks page as unused by process
 
 typedef struct vmm_context context_t;
+struct vfs_stream;
+
+/**
+ * \brief Physical pages of a file mapping which are shared between contexts
+ *
+ * The pages are loaded by the first context which accesses them. The cache holds a reference to every loaded page.
+ */
+typedef struct vmm_page_cache{
+	REFCOUNT_FIELD;
+	size_t pages;
+	paddr_t frames[];		//0 if the page was not loaded yet
+}vmm_page_cache_t;
 
 extern context_t kernel_context;
 
@@ -72,9 +86,96 @@ void *vmm_Map(context_t *context, void *vAddress, paddr_t pAddress, size_t pages
  */
 void *vmm_MapGuarded(context_t *context, void *vAddress, paddr_t pAddress, size_t pages, uint8_t flags);
 
+/**
+ * \brief Maps a memory area whose content is loaded from a file on the first access of each page.
+ *
+ * The first fileSize bytes at vAddress are read from the stream starting at offset, the rest of the area is zero.
+ * vAddress does not have to be page aligned, the surrounding pages are mapped.
+ * The stream is reopened so the caller may close it afterwards.
+ *
+ * This function locks the vmm_lock lock.
+ *
+ * @param context The context of the virtual memory
+ * @param vAddress Virtual address of the content
+ * @param size Size of the memory area in bytes
+ * @param flags Flags with access rights
+ * @param stream Stream to load the content from
+ * @param offset Offset of the content in the file
+ * @param fileSize Number of bytes which are loaded from the file
+ * @param cache Cache with the pages shared with other contexts or NULL. Writable pages are copied on the first write.
+ * @return NULL on failure otherwise vAddress
+ */
+void *vmm_MapFile(context_t *context, void *vAddress, size_t size, uint8_t flags, struct vfs_stream *stream, uint64_t offset, size_t fileSize,
+		vmm_page_cache_t *cache);
+
+/**
+ * \brief Maps pages of a file which are kept in the page cache of the file.
+ *
+ * Page i of the file is kept in cache->frames[i] and is loaded on the first access. Changes of a shared mapping are
+ * written back to the file by vmm_SyncFile and when the mapping is removed, pages of a private mapping are copied on
+ * the first write access.
+ * If vAddress is NULL then it allocates a virtual memory area big enough to hold pages pages.
+ *
+ * This function locks the vmm_lock lock.
+ *
+ * @param context The context of the virtual memory
+ * @param vAddress Page aligned virtual address of the mapping or NULL
+ * @param pages Number of pages of the mapping
+ * @param flags Flags with access rights
+ * @param stream Stream of the file
+ * @param offset Page aligned offset of the mapping in the file
+ * @param fileSize Number of bytes which are loaded from the file, the rest of the mapping is zero
+ * @param cache Page cache of the file
+ * @param shared Indicates if changes are written back to the file
+ * @return NULL on failure otherwise the address of the mapping
+ */
+void *vmm_MapFileCached(context_t *context, void *vAddress, size_t pages, uint8_t flags, struct vfs_stream *stream, uint64_t offset,
+		size_t fileSize, vmm_page_cache_t *cache, bool shared);
+
+/**
+ * \brief Writes the changed pages of shared file mappings in a memory area back to the files.
+ *
+ * @param context The context of the virtual memory
+ * @param vAddress Virtual address of the start of the memory area
+ * @param pages Number of pages the memory area spans
+ */
+void vmm_SyncFile(context_t *context, void *vAddress, size_t pages);
+
+/**
+ * \brief Creates a cache for the pages of a read-only file mapping.
+ *
+ * @param pages Number of pages of the mapping
+ * @return NULL on failure otherwise the cache with a reference count of 1
+ */
+vmm_page_cache_t *vmm_createPageCache(size_t pages);
+
+/**
+ * \brief Creates a bigger cache which references the pages loaded into another cache.
+ *
+ * @param cache The cache to copy
+ * @param pages Number of pages of the new cache
+ * @return NULL on failure otherwise the cache with a reference count of 1
+ */
+vmm_page_cache_t *vmm_growPageCache(const vmm_page_cache_t *cache, size_t pages);
+
+/**
+ * \brief Copies data between a buffer and the loaded pages of a page cache.
+ *
+ * Pages which were not loaded yet are skipped.
+ *
+ * @param cache Page cache of a file
+ * @param offset Offset in the file
+ * @param length Number of bytes
+ * @param buffer The buffer
+ * @param toCache true to copy from the buffer into the cache, false to copy from the cache into the buffer
+ */
+void vmm_copyPageCache(vmm_page_cache_t *cache, uint64_t offset, size_t length, void *buffer, bool toCache);
+
 /**
  * \brief Unmaps a memory area.
  *
+ * Changed pages of shared file mappings in the area are written back to the files first.
+ *
  * This function locks the vmm_lock lock.
  *
  * @param context The context of the virtual memory
@@ -96,6 +197,22 @@ void vmm_UnMap(context_t *context, void *vAddress, size_t pages, bool freePages)
  */
 void vmm_UnMapGuarded(context_t *context, void *vAddress, size_t pages, bool freePages);
 
+/**
+ * \brief Changes the access rights of a memory area.
+ *
+ * Pages which were not used yet stay unused and are allocated on the first access. Shared pages which become
+ * writable are copied on the first write access.
+ *
+ * This function locks the vmm_lock lock.
+ *
+ * @param context The context of the virtual memory
+ * @param vAddress Virtual address of the start of the memory area
+ * @param pages Number of pages the memory area spans
+ * @param flags New flags with access rights
+ * @return false if not all pages of the area are mapped or if there is not enough memory
+ */
+bool vmm_Protect(context_t *context, void *vAddress, size_t pages, uint8_t flags);
+
 paddr_t vmm_getPhysAddress(context_t *context, void *virtualAddress);
 uint8_t vmm_ReMap(context_t *src_context, void *src, context_t *dst_context, void *dst, size_t length, uint8_t flags);
 
@@ -104,13 +221,45 @@ bool vmm_getPageStatus(context_t *context, void *Address);
 void vmm_unusePages(context_t *context, void *virt, size_t pages);
 void vmm_usePages(context_t *context, void *virt, size_t pages);
 
+/**
+ * \brief Returns the number of pages used by the page tables of a context.
+ *
+ * The page tables of the kernel space are shared by all contexts and are only counted for the kernel context.
+ *
+ * @param context The context of the virtual memory
+ * @return Number of pages including the PML4
+ */
+size_t vmm_getPageTablePages(const context_t *context);
+
+/**
+ * \brief Returns the number of pages used by the page tables of all contexts.
+ *
+ * @return Number of pages
+ */
+size_t vmm_getTotalPageTablePages(void);
+
 bool vmm_userspacePointerValid(const void *ptr, const size_t size);
 
 context_t *createContext(void);
+context_t *cloneContext(context_t *context);
 void deleteContext(context_t *context);
-void activateContext(const context_t *context);
+void activateContext(context_t *context);
+
+/**
+ * \brief Counters of the page fault handler
+ */
+typedef struct{
+	uint64_t total;			//All page faults
+	uint64_t copyOnWrite;	//Writes to copy-on-write pages
+	uint64_t file;			//Pages loaded from a file
+	uint64_t demand;		//Pages allocated on the first access
+	uint64_t largePages;	//Demand faults which mapped a whole 2MiB page
+	uint64_t unresolved;	//Faults which were not handled (access violations, guard pages)
+}vmm_fault_stats_t;
+
+void vmm_getFaultStatistics(vmm_fault_stats_t *stats);
 
 //Interrupt handler
-int vmm_handlePageFault(context_t *context, void *page, uint64_t errorcode);
+int vmm_handlePageFault(context_t *context, void *page, uint64_t errorcode, bool interrupts);
 
 #endif /* VMM_H_ */
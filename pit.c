@@ -7,10 +7,18 @@
 
 #include "pit.h"
 #include "util.h"
-#include "list.h"
 #include "stdlib.h"
 #include "scheduler.h"
 #include "lock.h"
+#include "assert.h"
+#include "apic.h"
+#include "pic.h"
+#include "smp.h"
+#include "cpu.h"
+#include "display.h"
+#ifdef DEBUGMODE
+#include "stdio.h"
+#endif
 
 #define CH0		0x40
 #define CH1		0x41
@@ -20,20 +28,95 @@
 
 #define FRQB	1193182
 
+#define TSC_CALIBRATION	10		//Dauer der Kalibrierung des TSC in ms
+
+#define PIT_BENCHMARK_TIMERS	10000	//Registrierte Timer in pit_benchmark
+#define PIT_BENCHMARK_SLEEPERS	32		//Threads, welche in pit_benchmark wiederholt schlafen
+#define PIT_BENCHMARK_TIME		1000	//Dauer einer Messung von pit_benchmark in ms
+
+//Hierarchisches Timerrad: Stufe 0 hat einen Slot pro Millisekunde, jede weitere Stufe fasst 64 Slots der darunter
+//liegenden Stufe zusammen. Ein Slot einer höheren Stufe wird auf die tieferen Stufen verteilt, sobald seine Zeit erreicht
+//ist. Timer, die weiter als die höchste Stufe in der Zukunft liegen, werden dabei wieder in die höchste Stufe eingereiht.
+#define WHEEL_LEVELS		4
+#define WHEEL_SLOT_BITS		6
+#define WHEEL_SLOTS			(1 << WHEEL_SLOT_BITS)
+#define WHEEL_PENDING		(WHEEL_LEVELS * WHEEL_SLOTS)	//Bucket der abgelaufenen Timer, die noch nicht geweckt wurden
+#define WHEEL_SPAN(level)	(1ul << ((level) * WHEEL_SLOT_BITS))	//Millisekunden pro Slot der Stufe
+
 typedef struct{
-	thread_t *thread;
-	uint64_t timeout;
-}timer_t;
+	thread_timer_t *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+	uint64_t bitmap[WHEEL_LEVELS];		//Bit i ist gesetzt, wenn slots[level][i] nicht leer ist
+	thread_timer_t *pending;
+	uint64_t time;						//Zeit, bis zu welcher die Timer abgearbeitet sind
+	size_t count;
+}timer_wheel_t;
 
-static list_t Timerlist;
-static lock_t Timerlist_lock = LOCK_INIT;
+static timer_wheel_t wheel;
+static lock_t wheel_lock = LOCK_INIT;
+static volatile uint64_t nextTimeout;	//Zeit des nächsten Ereignisses im Timerrad oder 0, wird ohne Lock gelesen
+
+//Solange der PIT periodisch läuft, zählt er die Millisekunden. Ohne periodischen Interrupt wird die Zeit aus dem TSC
+//berechnet.
+static volatile uint64_t ticks;
+static bool tickless;
+static uint64_t tscBase, tscPerMs, uptimeBase;
 
 void pit_Init(uint32_t freq)
 {
 	pit_InitChannel(0, 2, (uint64_t)(FRQB / freq));
 
-	Timerlist = NULL;
-	Uptime = 0;
+	ticks = 0;
+}
+
+/*
+ * Schaltet den periodischen Interrupt des PITs ab. Danach wird die Zeit mit dem TSC gemessen und der BSP benutzt wie die
+ * APs den One-Shot-Timer des Local APICs, welcher auf den nächsten Timer oder Scheduler-Tick gestellt wird.
+ * Muss nach smp_Init auf dem BSP mit aktivierten Interrupts aufgerufen werden. Ohne Local APIC oder ohne TSC mit
+ * konstanter Frequenz läuft der PIT weiter.
+ */
+void pit_enableTickless(void)
+{
+	if(!apic_available() || !cpuInfo.invariantTSC)
+		return;
+
+	//TSC mit dem PIT kalibrieren
+	uint64_t start = ticks;
+	while(ticks == start) CPU_HALT();
+	uint64_t tsc = cpu_readTSC();
+	start = ticks;
+	while(ticks < start + TSC_CALIBRATION) CPU_HALT();
+	tscPerMs = (cpu_readTSC() - tsc) / TSC_CALIBRATION;
+
+	bool enabled = cpu_disableInterrupts();
+	uptimeBase = ticks;
+	tscBase = cpu_readTSC();
+	tickless = true;
+	pic_MaskIRQ(0x1);
+
+	apic_initTimer();
+	CPU_LOCAL_SET(nextTick, pit_getUptime() + SCHEDULER_TICK);
+	pit_armLocalTimer();
+	cpu_restoreInterrupts(enabled);
+
+	SysLog("PIT", "Periodischer Interrupt deaktiviert");
+}
+
+/*
+ * Gibt die Zeit in Millisekunden seit dem Starten des Computers zurück
+ */
+uint64_t pit_getUptime(void)
+{
+	if(tickless)
+		return uptimeBase + (cpu_readTSC() - tscBase) / tscPerMs;
+	return ticks;
+}
+
+/*
+ * Gibt zurück, ob der periodische Interrupt des PITs abgeschaltet ist
+ */
+bool pit_isTickless(void)
+{
+	return tickless;
 }
 
 void pit_InitChannel(uint8_t channel, uint8_t mode, uint16_t data)
@@ -44,35 +127,232 @@ void pit_InitChannel(uint8_t channel, uint8_t mode, uint16_t data)
 	outb(CH_BASE + channel, data >> 8);
 }
 
-//Registriert einen Timer
-void pit_RegisterTimer(thread_t *thread, uint64_t msec)
+static thread_t *timerThread(thread_timer_t *timer)
 {
-	if(msec != 0)
+	return (thread_t*)((uintptr_t)timer - offsetof(thread_t, timer));
+}
+
+/*
+ * Hängt einen Timer in einen Bucket des Rades bzw. entfernt ihn daraus. Der Lock muss gehalten werden.
+ */
+static void bucketAdd(uint16_t bucket, thread_timer_t *timer)
+{
+	thread_timer_t **head = (bucket == WHEEL_PENDING) ? &wheel.pending
+			: &wheel.slots[bucket / WHEEL_SLOTS][bucket % WHEEL_SLOTS];
+	timer->bucket = bucket;
+	timer->next = *head;
+	if(timer->next != NULL)
+		timer->next->pprev = &timer->next;
+	timer->pprev = head;
+	*head = timer;
+	if(bucket != WHEEL_PENDING)
+		wheel.bitmap[bucket / WHEEL_SLOTS] |= 1ul << (bucket % WHEEL_SLOTS);
+}
+
+static void bucketRemove(thread_timer_t *timer)
+{
+	*timer->pprev = timer->next;
+	if(timer->next != NULL)
+		timer->next->pprev = timer->pprev;
+	timer->pprev = NULL;
+	uint16_t bucket = timer->bucket;
+	if(bucket != WHEEL_PENDING && wheel.slots[bucket / WHEEL_SLOTS][bucket % WHEEL_SLOTS] == NULL)
+		wheel.bitmap[bucket / WHEEL_SLOTS] &= ~(1ul << (bucket % WHEEL_SLOTS));
+}
+
+/*
+ * Reiht einen Timer in die Stufe ein, deren Bereich seine Ablaufzeit enthält. Der Lock muss gehalten werden.
+ */
+static void wheelInsert(thread_timer_t *timer)
+{
+	uint64_t delta = (timer->timeout > wheel.time) ? timer->timeout - wheel.time : 0;
+	uint64_t timeout = timer->timeout;
+	uint8_t level = 0;
+	while(level < WHEEL_LEVELS - 1 && delta >= WHEEL_SPAN(level + 1))
+		level++;
+	//Zu weit entfernte Timer kommen in den letzten Slot der höchsten Stufe
+	if(delta >= WHEEL_SPAN(WHEEL_LEVELS))
+		timeout = wheel.time + WHEEL_SPAN(WHEEL_LEVELS) - 1;
+	uint16_t slot = (timeout >> (level * WHEEL_SLOT_BITS)) & (WHEEL_SLOTS - 1);
+	bucketAdd(level * WHEEL_SLOTS + slot, timer);
+}
+
+/*
+ * Gibt den ersten Slot ab start zurück, welcher Timer enthält. Die Slots werden ringförmig durchsucht.
+ */
+static uint8_t firstSlot(uint64_t bitmap, uint8_t start)
+{
+	uint64_t rotated = (start == 0) ? bitmap : (bitmap >> start) | (bitmap << (WHEEL_SLOTS - start));
+	return (start + __builtin_ctzl(rotated)) & (WHEEL_SLOTS - 1);
+}
+
+/*
+ * Berechnet, wann das Rad das nächste Mal weitergedreht werden muss. Das ist der nächste belegte Slot der Stufe 0 oder,
+ * wenn diese leer ist, der Zeitpunkt, an dem der nächste belegte Slot der tiefsten belegten Stufe verteilt wird.
+ * Der Lock muss gehalten werden.
+ *
+ * Rückgabe:	Zeitpunkt oder 0, wenn keine Timer registriert sind
+ */
+static uint64_t wheelNextEvent(void)
+{
+	if(wheel.pending != NULL)
+		return wheel.time + 1;
+	for(uint8_t level = 0; level < WHEEL_LEVELS; level++)
 	{
-		timer_t *Timer;
-		size_t i;
-		uint64_t t;
+		if(wheel.bitmap[level] == 0)
+			continue;
+		uint8_t shift = level * WHEEL_SLOT_BITS;
+		uint64_t block = (wheel.time >> shift) + 1;
+		uint8_t start = block & (WHEEL_SLOTS - 1);
+		uint8_t distance = (firstSlot(wheel.bitmap[level], start) - start) & (WHEEL_SLOTS - 1);
+		return (block + distance) << shift;
+	}
+	return 0;
+}
+
+/*
+ * Weckt die Threads in einer Liste. Threads, die ihren Timer zwar registriert, sich aber noch nicht schlafen gelegt
+ * haben, und Threads, welche wegen eines besetzten Locks nicht geweckt werden konnten, kommen in die Liste der
+ * ausstehenden Timer. Der Lock muss gehalten werden.
+ */
+static void wakeTimers(thread_timer_t *timer)
+{
+	while(timer != NULL)
+	{
+		thread_timer_t *next = timer->next;
+		thread_t *thread = timerThread(timer);
+		thread_status_t status = thread->Status;
+		bucketRemove(timer);
+		if(status.status == THREAD_RUNNING
+				|| (status.block_reason == THREAD_BLOCKED_WAIT_TIMER && !thread_try_unblock(thread)))
+			bucketAdd(WHEEL_PENDING, timer);
+		else
+			wheel.count--;
+		timer = next;
+	}
+}
 
-		Timer = malloc(sizeof(timer_t));
+/*
+ * Dreht das Rad bis zur angegebenen Zeit weiter und weckt die abgelaufenen Timer. Bereiche, in denen keine Stufe einen
+ * Slot wechselt, werden übersprungen. Der Lock muss gehalten werden.
+ */
+static void wheelAdvance(uint64_t now)
+{
+	//Die Liste wird abgenommen, damit erneut nicht weckbare Threads nicht sofort wieder bearbeitet werden
+	thread_timer_t *pending = wheel.pending;
+	if(pending != NULL)
+	{
+		pending->pprev = &pending;
+		wheel.pending = NULL;
+		wakeTimers(pending);
+	}
 
-		Timer->thread = thread;
-		Timer->timeout = ((t = Uptime + msec) < Uptime) ? -1ul : t;
+	while(wheel.time < now)
+	{
+		if(wheel.count == 0)
+		{
+			wheel.time = now;
+			break;
+		}
 
-		LOCKED_TASK(Timerlist_lock, {
-			if(Timerlist == NULL)
-				Timerlist = list_create();
+		//Bis zur nächsten Grenze der tiefsten belegten Stufe passiert nichts
+		uint8_t lowest = 0;
+		while(lowest < WHEEL_LEVELS - 1 && wheel.bitmap[lowest] == 0)
+			lowest++;
+		uint64_t t = (lowest == 0) ? wheel.time + 1
+				: ((wheel.time >> (lowest * WHEEL_SLOT_BITS)) + 1) << (lowest * WHEEL_SLOT_BITS);
+		if(t > now)
+		{
+			wheel.time = now;
+			break;
+		}
+		wheel.time = t;
 
-			//Timerliste sortiere, sodass das Element vorne immer das Element ist, welches
-			//zuerst abläuft
-			timer_t *item;
-			for(i = 0; (item = list_get(Timerlist, i)); i++)
+		//Slots der höheren Stufen verteilen, deren Zeit erreicht ist
+		for(uint8_t level = WHEEL_LEVELS - 1; level > 0; level--)
+		{
+			uint8_t shift = level * WHEEL_SLOT_BITS;
+			if((t & (WHEEL_SPAN(level) - 1)) == 0)
 			{
-				if(item->timeout > Timer->timeout)
-					break;
+				thread_timer_t *timer = wheel.slots[level][(t >> shift) & (WHEEL_SLOTS - 1)];
+				while(timer != NULL)
+				{
+					thread_timer_t *next = timer->next;
+					bucketRemove(timer);
+					wheelInsert(timer);
+					timer = next;
+				}
 			}
+		}
+
+		wakeTimers(wheel.slots[0][t & (WHEEL_SLOTS - 1)]);
+	}
+}
+
+/*
+ * Trägt einen Timer in das Rad ein
+ *
+ * Parameter:	timer = Timer, welcher eingetragen wird
+ * 				msec = Dauer in Millisekunden
+ */
+static void timerAdd(thread_timer_t *timer, uint64_t msec)
+{
+	uint64_t now = pit_getUptime();
+	uint64_t t;
+	timer->timeout = ((t = now + msec) < now) ? -1ul : t;
+
+	//Die Interrupts bleiben deaktiviert, damit der BSP den Lock nicht lange vergeblich versucht zu holen
+	bool enabled = cpu_disableInterrupts();
+	uint64_t oldNext = nextTimeout;
+	LOCKED_TASK(wheel_lock, {
+		//Ein leeres Rad muss nicht erst bis zur aktuellen Zeit gedreht werden
+		if(wheel.count == 0)
+			wheel.time = now;
+		wheelInsert(timer);
+		wheel.count++;
+		nextTimeout = wheelNextEvent();
+	});
+
+	//Der BSP muss seinen Timer neu stellen, wenn das Rad früher als bisher weitergedreht werden muss
+	if(tickless && (oldNext == 0 || nextTimeout < oldNext))
+	{
+		if(cpu_getIndex() == 0)
+			pit_armLocalTimer();
+		else
+			smp_reschedule(0);
+	}
+	cpu_restoreInterrupts(enabled);
+}
 
-			list_insert(Timerlist, i, Timer);
-		});
+/*
+ * Entfernt einen Timer aus dem Rad, falls er noch eingetragen ist
+ */
+static void timerCancel(thread_timer_t *timer)
+{
+	bool enabled = cpu_disableInterrupts();
+	LOCKED_TASK(wheel_lock, {
+		if(timer->pprev != NULL)
+		{
+			bucketRemove(timer);
+			wheel.count--;
+			nextTimeout = wheelNextEvent();
+		}
+	});
+	cpu_restoreInterrupts(enabled);
+}
+
+/*
+ * Legt den aktuellen Thread für die angegebene Zeit schlafen. Der Timer ist im Thread eingebettet, deshalb wird kein
+ * Speicher angefordert.
+ *
+ * Parameter:	thread = Thread, welcher schlafen soll (der aktuelle Thread)
+ * 				msec = Dauer in Millisekunden, bei 0 wird nur der Thread gewechselt
+ */
+void pit_RegisterTimer(thread_t *thread, uint64_t msec)
+{
+	if(msec != 0)
+	{
+		timerAdd(&thread->timer, msec);
 
 		//Entsprechenden Thread schlafen legen
 		thread_block_self(NULL, NULL, THREAD_BLOCKED_WAIT_TIMER);
@@ -84,24 +364,193 @@ void pit_RegisterTimer(thread_t *thread, uint64_t msec)
 	}
 }
 
+/*
+ * Entfernt den Timer eines Threads, falls dieser noch registriert ist
+ *
+ * Parameter:	thread = Thread, dessen Timer entfernt wird
+ */
+void pit_CancelTimer(thread_t *thread)
+{
+	timerCancel(&thread->timer);
+}
+
+/*
+ * Weckt die Threads auf, deren Timer abgelaufen sind. Wird nur auf dem BSP aufgerufen.
+ */
+static void expireTimers(void)
+{
+	uint64_t now = pit_getUptime();
+	if(nextTimeout == 0 || nextTimeout > now)
+		return;
+
+	LOCKED_TRY_TASK(wheel_lock, {
+		wheelAdvance(now);
+		nextTimeout = wheelNextEvent();
+	});
+}
+
+/*
+ * IRQ 0, solange der PIT periodisch läuft
+ */
 void pit_Handler(void)
 {
-	timer_t *Timer;
-	size_t i = 0;
-	Uptime++;
-	if(Timerlist)
+	ticks++;
+	expireTimers();
+}
+
+/*
+ * Stellt den One-Shot-Timer des Local APICs der aktuellen CPU auf das nächste Ereignis. Das ist der nächste Tick des
+ * Schedulers und auf dem BSP zusätzlich das nächste Ereignis im Timerrad. Der Timer wird nur neu gestellt, wenn sich die
+ * Zeit geändert hat. Die Interrupts müssen deaktiviert sein.
+ */
+void pit_armLocalTimer(void)
+{
+	bool bsp = (cpu_getIndex() == 0);
+	if(bsp && !tickless)
+		return;
+
+	uint64_t deadline = CPU_LOCAL_GET(nextTick);
+	uint64_t timeout = nextTimeout;
+	if(bsp && timeout != 0 && (deadline == 0 || timeout < deadline))
+		deadline = timeout;
+
+	if(deadline != CPU_LOCAL_GET(timerDeadline))
 	{
-		LOCKED_TRY_TASK(Timerlist_lock,	{
-			while((Timer = list_get(Timerlist, i)))
-			{
-				if(Timer->timeout > Uptime)
-					break;
-				if(thread_try_unblock(Timer->thread))
-					free(list_remove(Timerlist, i));
-				else
-					break;
-				i++;
-			}
-		});
+		CPU_LOCAL_SET(timerDeadline, deadline);
+		uint64_t now = pit_getUptime();
+		//Ein bereits verpasstes Ereignis wird so schnell wie möglich nachgeholt
+		apic_armTimer((deadline == 0) ? 0 : ((deadline > now) ? deadline - now : 1));
+	}
+}
+
+/*
+ * Interrupt des One-Shot-Timers des Local APICs
+ *
+ * Parameter:	ihs = Zustand des unterbrochenen Threads
+ * Rückgabe:	Zustand des Threads, welcher weiterläuft
+ */
+ihs_t *pit_apicTimerHandler(ihs_t *ihs)
+{
+	CPU_LOCAL_SET(timerDeadline, 0);
+	if(tickless && cpu_getIndex() == 0)
+		expireTimers();
+
+	//Der Idle-Thread wird ersetzt, falls ein abgelaufener Timer einen Thread auf dieser CPU aufgeweckt hat
+	uint64_t tick = CPU_LOCAL_GET(nextTick);
+	if(currentThread == CPU_LOCAL_GET(idleThread) || (tick != 0 && pit_getUptime() >= tick))
+		ihs = scheduler_tick(ihs);
+
+	pit_armLocalTimer();
+	return ihs;
+}
+
+#ifdef DEBUGMODE
+static volatile bool benchmarkRunning;
+static uint64_t benchmarkSeed;
+static uint64_t benchmarkWakeups, benchmarkLateness, benchmarkMaxLateness;
+
+static uint64_t benchmarkRandom(uint64_t *seed)
+{
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 7;
+	*seed ^= *seed << 17;
+	return *seed;
+}
+
+/*
+ * Schläft wiederholt zwischen 1 und 64ms und misst, wie spät der Thread geweckt wird
+ */
+static void __attribute__((noreturn)) benchmarkSleeper()
+{
+	uint64_t seed = __sync_add_and_fetch(&benchmarkSeed, 0x9E3779B97F4A7C15ul) | 1;
+	while(benchmarkRunning)
+	{
+		uint64_t msec = benchmarkRandom(&seed) % 64 + 1;
+		uint64_t timeout = pit_getUptime() + msec;
+		pit_RegisterTimer(currentThread, msec);
+		uint64_t now = pit_getUptime();
+		uint64_t lateness = (now > timeout) ? now - timeout : 0;
+		__sync_fetch_and_add(&benchmarkWakeups, 1);
+		__sync_fetch_and_add(&benchmarkLateness, lateness);
+		uint64_t max;
+		while(lateness > (max = benchmarkMaxLateness) && !__sync_bool_compare_and_swap(&benchmarkMaxLateness, max, lateness));
+	}
+
+	//Kernelthreads können nicht beendet werden
+	while(1) thread_block_self(NULL, NULL, THREAD_BLOCKED_WAIT);
+}
+
+/*
+ * Misst das Eintragen und Entfernen von PIT_BENCHMARK_TIMERS Timern mit zufälligen Zeiten und danach, wie genau
+ * PIT_BENCHMARK_SLEEPERS Threads geweckt werden, während diese Timer im Rad eingetragen sind. Die Timer laufen erst nach
+ * mindestens einer Minute ab und werden vorher wieder entfernt, deshalb gehören sie zu keinem Thread.
+ */
+void pit_benchmark()
+{
+	thread_timer_t *timers = malloc(PIT_BENCHMARK_TIMERS * sizeof(*timers));
+	uint64_t *timeouts = malloc(PIT_BENCHMARK_TIMERS * sizeof(*timeouts));
+	thread_t *sleepers[PIT_BENCHMARK_SLEEPERS];
+	uint64_t seed = 0x2545F4914F6CDD1Dul;
+	char msg[80];
+
+	if(timers == NULL || timeouts == NULL)
+	{
+		free(timers);
+		free(timeouts);
+		SysLogError("PIT", "Benchmark abgebrochen, zu wenig Speicher");
+		return;
 	}
+
+	//Die Zeiten verteilen sich über alle Stufen des Rades
+	for(size_t i = 0; i < PIT_BENCHMARK_TIMERS; i++)
+		timeouts[i] = 60000 + benchmarkRandom(&seed) % WHEEL_SPAN(WHEEL_LEVELS);
+
+	uint64_t operations = 0;
+	uint64_t start = pit_getUptime(), elapsed = 0;
+	while(elapsed < PIT_BENCHMARK_TIME)
+	{
+		for(size_t i = 0; i < PIT_BENCHMARK_TIMERS; i++)
+			timerAdd(&timers[i], timeouts[i]);
+		for(size_t i = 0; i < PIT_BENCHMARK_TIMERS; i++)
+			timerCancel(&timers[i]);
+		operations += PIT_BENCHMARK_TIMERS;
+		elapsed = pit_getUptime() - start;
+	}
+	sprintf(msg, "%u Timer: %lu Eintragen+Entfernen/s", PIT_BENCHMARK_TIMERS, operations * 1000 / elapsed);
+	SysLog("PIT", msg);
+
+	for(size_t i = 0; i < PIT_BENCHMARK_TIMERS; i++)
+		timerAdd(&timers[i], timeouts[i]);
+	benchmarkRunning = true;
+	size_t count;
+	for(count = 0; count < PIT_BENCHMARK_SLEEPERS; count++)
+	{
+		ERROR_TYPE_POINTER(thread_t) thread = thread_create(&kernel_process, benchmarkSleeper, 0, NULL, true);
+		if(ERROR_DETECT(thread))
+			break;
+		sleepers[count] = ERROR_GET_VALUE(thread);
+		thread_unblock(sleepers[count]);
+	}
+	pit_RegisterTimer(currentThread, PIT_BENCHMARK_TIME);
+	benchmarkRunning = false;
+
+	//Die Threads sind fertig, sobald sie endgültig blockiert und aus der Liste entfernt sind
+	for(size_t i = 0; i < count; i++)
+	{
+		while(sleepers[i]->Status.status != THREAD_BLOCKED || sleepers[i]->Status.block_reason != THREAD_BLOCKED_WAIT
+				|| sleepers[i]->queued)
+			yield();
+		thread_destroy(sleepers[i], true);
+	}
+	for(size_t i = 0; i < PIT_BENCHMARK_TIMERS; i++)
+		timerCancel(&timers[i]);
+
+	sprintf(msg, "%lu Threads: %lu Weckungen, %lu us mittlere und %lu ms maximale Verspaetung", count,
+			benchmarkWakeups, (benchmarkWakeups > 0) ? benchmarkLateness * 1000 / benchmarkWakeups : 0,
+			benchmarkMaxLateness);
+	SysLog("PIT", msg);
+
+	free(timers);
+	free(timeouts);
 }
+#endif
@@ -10,11 +10,21 @@
 
 #include "stdint.h"
 #include "thread.h"
-
-volatile uint64_t Uptime;						//Zeit in Milisekunden seit dem Starten des Computers
+#include "isr.h"
 
 void pit_Init(uint32_t freq);
+void pit_enableTickless(void);
+uint64_t pit_getUptime(void);
+bool pit_isTickless(void);
+void pit_Handler(void);
+void pit_armLocalTimer(void);
+ihs_t *pit_apicTimerHandler(ihs_t *ihs);
 void pit_RegisterTimer(thread_t *thread, uint64_t msec);
+void pit_CancelTimer(thread_t *thread);
 void pit_InitChannel(uint8_t channel, uint8_t mode, uint16_t data);
 
+#ifdef DEBUGMODE
+void pit_benchmark();
+#endif
+
 #endif /* PIT_H_ */
@@ -0,0 +1,240 @@
+/*
+ * smp.c
+ *
+ *  Created on: 18.10.2026
+ *      Author: pascal
+ */
+
+#include "smp.h"
+#include "cpu.h"
+#include "apic.h"
+#include "gdt.h"
+#include "idt.h"
+#include "tss.h"
+#include "syscalls.h"
+#include "scheduler.h"
+#include "vmm.h"
+#include "pmm.h"
+#include "paging.h"
+#include "memory.h"
+#include "display.h"
+#include "util.h"
+#include "pit.h"
+#include "lock.h"
+#include "string.h"
+#include "stdio.h"
+
+#define SMP_STARTUP_WAIT		20		//Zeit in ms, welche die APs nach dem SIPI zum Starten haben
+#define SMP_ONLINE_TIMEOUT		1000	//Zeit in ms, bis ein AP den Scheduler gestartet haben muss
+#define SMP_STACK_PAGES			4
+#define SMP_FLUSH_NMI_SPINS		10000	//So lange wird auf die Antwort einer CPU gewartet, bevor sie einen NMI bekommt
+
+#define EFER_MSR				0xC0000080
+#define EFER_LMA				(1ul << 10)
+
+//Interrupt Command Register: INIT und SIPI an alle anderen CPUs, NMI an eine bestimmte CPU
+#define ICR_INIT				0xC4500
+#define ICR_STARTUP				0xC4600
+#define ICR_NMI					0x4400
+#define ICR_FIXED				0x4000
+
+//Symbole aus trampoline.S
+extern uint8_t smp_trampoline_start, smp_trampoline_end;
+extern uint64_t smp_trampoline_cr3, smp_trampoline_efer, smp_trampoline_stack, smp_trampoline_local, smp_trampoline_entry;
+extern uint32_t smp_trampoline_arrived, smp_trampoline_lock;
+
+//Zugriff auf eine Variable in der Kopie des Trampolins
+#define TRAMPOLINE_VAR(type, symbol)	\
+	(*(volatile type*)(trampoline + ((uintptr_t)&symbol - (uintptr_t)&smp_trampoline_start)))
+
+static volatile uint32_t cpuCount = 1;
+
+static lock_t flush_lock = LOCK_INIT;
+static volatile uint32_t flushPending;
+
+//Aktuelle Anfrage von smp_invalidateTLB, wird durch flush_lock geschützt
+static struct {
+	struct vmm_context *context;
+	void *address;
+	size_t pages;
+} flushRequest;
+
+/*
+ * Einsprungspunkt der APs nach dem Trampolin. Läuft auf dem Stack, welcher der BSP bereitgestellt hat.
+ * Parameter:	local = Daten dieser CPU
+ */
+static void __attribute__((noreturn)) apMain(cpu_local_t *local)
+{
+	cpu_init(false);
+	GDT_Init(local);
+	TSS_Init();
+	IDT_Load();
+	syscall_Init();
+	apic_InitCpu();
+	local->apicId = apic_getId();
+
+	scheduler_initCpu();
+	local->online = true;
+
+	apic_initTimer();
+	CPU_LOCAL_SET(nextTick, pit_getUptime() + SCHEDULER_TICK);
+	pit_armLocalTimer();
+	CPU_ENABLE_INTERRUPTS();
+
+	//Beim ersten Timerinterrupt wechselt der Scheduler zu einem Thread, dieser Stack wird danach nicht mehr benutzt
+	while(1) CPU_HALT();
+}
+
+void smp_Init()
+{
+	if(!apic_available())
+		return;
+
+	apic_calibrateTimer();
+	cpuLocal[0].apicId = apic_getId();
+	cpuLocal[0].online = true;
+
+	//Die APs benutzen die Page Tables des Kernelkontextes, welcher beim Starten noch aktiv ist.
+	//Im Protected Mode können nur die unteren 4GiB adressiert werden.
+	paddr_t pml4 = cpu_readControlRegister(CPU_CR3) & PG_ADDRESS;
+	if(pml4 > UINT32_MAX)
+	{
+		SysLogError("SMP", "PML4 des Kernels liegt über 4GiB, es werden keine APs gestartet");
+		return;
+	}
+
+	//Die APs beginnen im Real Mode, deshalb muss das Trampolin unter 1MB liegen. Da Speicher unter 1MB nicht
+	//freigegeben wird, hält pmm_Init dafür eine Page zurück. Sie bleibt reserviert, da überzählige APs darin angehalten werden.
+	paddr_t page = pmm_AllocLowPage();
+	if(page == 1)
+	{
+		SysLogError("SMP", "Kein Speicher unter 1MB für das Trampolin");
+		return;
+	}
+	//Der untere 1MB ist identisch gemappt, aber nicht ausführbar
+	vmm_Protect(&kernel_context, (void*)page, 1, VMM_FLAGS_WRITE | VMM_FLAGS_GLOBAL);
+
+	uint8_t *trampoline = MAPPED_PHYS_MEM_GET(page);
+	memcpy(trampoline, &smp_trampoline_start, &smp_trampoline_end - &smp_trampoline_start);
+	TRAMPOLINE_VAR(uint64_t, smp_trampoline_cr3) = pml4;
+	TRAMPOLINE_VAR(uint64_t, smp_trampoline_efer) = cpu_MSRread(EFER_MSR) & ~EFER_LMA;
+
+	//INIT-SIPI-SIPI an alle anderen CPUs
+	apic_sendIPI(0, ICR_INIT);
+	Sleep(10);
+	apic_sendIPI(0, ICR_STARTUP | (page >> 12));
+	Sleep(1);
+	apic_sendIPI(0, ICR_STARTUP | (page >> 12));
+	Sleep(SMP_STARTUP_WAIT);
+
+	//Die angekommenen APs warten auf den Lock im Trampolin und werden einzeln gestartet
+	uint32_t arrived = TRAMPOLINE_VAR(uint32_t, smp_trampoline_arrived);
+	for(uint32_t i = 0; i < arrived && cpuCount < CPU_MAX_COUNT; i++)
+	{
+		void *stack = vmm_Map(&kernel_context, NULL, 0, SMP_STACK_PAGES,
+				VMM_FLAGS_ALLOCATE | VMM_FLAGS_NX | VMM_FLAGS_WRITE | VMM_FLAGS_GLOBAL);
+		if(stack == NULL)
+			break;
+
+		cpu_local_t *local = &cpuLocal[cpuCount];
+		local->self = local;
+		local->index = cpuCount;
+
+		TRAMPOLINE_VAR(uint64_t, smp_trampoline_stack) = (uintptr_t)stack + SMP_STACK_PAGES * MM_BLOCK_SIZE;
+		TRAMPOLINE_VAR(uint64_t, smp_trampoline_local) = (uintptr_t)local;
+		TRAMPOLINE_VAR(uint64_t, smp_trampoline_entry) = (uintptr_t)apMain;
+		__sync_synchronize();
+		TRAMPOLINE_VAR(uint32_t, smp_trampoline_lock) = 0;
+
+		uint64_t timeout = pit_getUptime() + SMP_ONLINE_TIMEOUT;
+		while(!local->online && pit_getUptime() < timeout) CPU_HALT();
+		if(!local->online)
+		{
+			//Der AP kann den Stack noch benutzen, deshalb wird er nicht freigegeben
+			SysLogError("SMP", "Ein AP konnte nicht gestartet werden");
+			break;
+		}
+		cpuCount++;
+	}
+
+	//Alle übrigen APs halten im Trampolin an
+	TRAMPOLINE_VAR(uint64_t, smp_trampoline_stack) = 0;
+	__sync_synchronize();
+	TRAMPOLINE_VAR(uint32_t, smp_trampoline_lock) = 0;
+
+	char msg[50];
+	sprintf(msg, "%u CPUs aktiv", cpuCount);
+	SysLog("SMP", msg);
+}
+
+uint32_t smp_getCpuCount()
+{
+	return cpuCount;
+}
+
+void smp_invalidateTLB(struct vmm_context *context, void *address, size_t pages)
+{
+	if(cpuCount < 2)
+		return;
+
+	//Die Interrupts bleiben deaktiviert, damit der Lock nicht von einem unterbrochenen Thread gehalten wird
+	bool enabled = cpu_disableInterrupts();
+	LOCKED_TASK(flush_lock, {
+		flushRequest.context = context;
+		flushRequest.address = address;
+		flushRequest.pages = pages;
+
+		uint32_t self = cpu_getIndex();
+		uint32_t targets = 0;
+		for(uint32_t i = 0; i < cpuCount; i++)
+		{
+			//Pages des Userspaces sind nur im TLB der CPUs, welche den Kontext geladen haben
+			if(i == self || !cpuLocal[i].online || (context != NULL && cpuLocal[i].context != context))
+				continue;
+			targets |= 1u << i;
+			__sync_fetch_and_add(&flushPending, 1);
+			cpuLocal[i].tlbFlush = true;
+			apic_sendIPI(cpuLocal[i].apicId, ICR_FIXED | APIC_TLB_VECTOR);
+		}
+
+		//Eine CPU, welche mit deaktivierten Interrupts wartet, antwortet erst auf einen NMI
+		for(uint32_t spins = 0; flushPending > 0; spins++)
+		{
+			if(spins == SMP_FLUSH_NMI_SPINS)
+			{
+				for(uint32_t i = 0; i < cpuCount; i++)
+				{
+					if((targets & (1u << i)) && cpuLocal[i].tlbFlush)
+						apic_sendIPI(cpuLocal[i].apicId, ICR_NMI);
+				}
+			}
+			CPU_PAUSE();
+		}
+	});
+	cpu_restoreInterrupts(enabled);
+}
+
+void smp_reschedule(uint32_t cpu)
+{
+	if(cpuLocal[cpu].online)
+		apic_sendIPI(cpuLocal[cpu].apicId, ICR_FIXED | APIC_RESCHEDULE_VECTOR);
+}
+
+void smp_handleTLBRequest()
+{
+	cpu_local_t *local = cpu_getLocal();
+	//Die Anfrage kann sowohl vom IPI als auch vom NMI bearbeitet werden, aber nur einmal
+	if(!__atomic_exchange_n(&local->tlbFlush, false, __ATOMIC_ACQ_REL))
+		return;
+	if(flushRequest.context == NULL)
+		InvalidateTLBRange(flushRequest.address, flushRequest.pages, true);
+	//Hat die CPU inzwischen den Kontext gewechselt, werden die Einträge beim nächsten Aktivieren geleert
+	else if(local->context == flushRequest.context)
+		InvalidateTLBRange(flushRequest.address, flushRequest.pages, false);
+	__sync_fetch_and_sub(&flushPending, 1);
+}
+
+void smp_handleNMI()
+{
+	smp_handleTLBRequest();
+}
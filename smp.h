@@ -0,0 +1,71 @@
+/*
+ * smp.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: pascal
+ */
+
+/**
+ * \file
+ * Startup of the application processors and communication between the cpus.
+ */
+
+#ifndef SMP_H_
+#define SMP_H_
+
+#include "stdint.h"
+#include "stddef.h"
+
+/**
+ * \brief Starts all application processors.
+ *
+ * The application processors are woken up with a broadcast INIT-SIPI-SIPI sequence and started one after another.
+ * Every started cpu gets its own GDT, TSS, idle thread and local APIC timer and then takes part in the scheduling.
+ * Interrupts have to be enabled on the bootstrap processor because the PIT is used for the delays.
+ */
+void smp_Init(void);
+
+/**
+ * \brief Returns the number of cpus which are running the scheduler.
+ *
+ * @return number of online cpus (at least 1)
+ */
+uint32_t smp_getCpuCount(void);
+
+struct vmm_context;
+
+/**
+ * \brief Invalidates a range of TLB entries on the other cpus.
+ *
+ * Has to be called after the local TLB entries were invalidated. Only the cpus which have the context loaded are
+ * interrupted, the caller has to make sure that the other cpus do not use stale entries when they load the context
+ * (see activateContext). A cpu which does not respond to the IPI because it waits with interrupts disabled (e.g. for a
+ * lock) is interrupted with a NMI. Returns after all cpus invalidated the entries.
+ *
+ * @param context Address space of the range or NULL for the kernel space, which is invalidated on all cpus
+ * @param address Start of the range
+ * @param pages Number of pages of the range. If it is larger than PG_TLB_FLUSH_THRESHOLD the whole TLB is flushed.
+ */
+void smp_invalidateTLB(struct vmm_context *context, void *address, size_t pages);
+
+/**
+ * \brief Asks a cpu to run its scheduler.
+ *
+ * Wakes up a halted cpu when there is new work for it. The cpu also rearms its local timer, so the function is used as
+ * well when the deadline of the first sleep timer changed.
+ *
+ * @param cpu Index of the cpu
+ */
+void smp_reschedule(uint32_t cpu);
+
+/**
+ * \brief Handles a TLB invalidation requested by another cpu with an IPI.
+ */
+void smp_handleTLBRequest(void);
+
+/**
+ * \brief Handles a NMI on the current cpu.
+ */
+void smp_handleNMI(void);
+
+#endif /* SMP_H_ */
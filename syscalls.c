@@ -38,13 +38,21 @@ typedef uint64_t(*syscall)(uint64_t arg, ...);
 static syscall syscalls[_SYSCALL_NUM] = {
 [SYSCALL_ALLOC_PAGES]		(syscall)&mm_Alloc,
 [SYSCALL_FREE_PAGES]		(syscall)&mm_Free,
-[SYSCALL_UNUSE_PAGES]		(syscall)&vmm_unusePages,
+[SYSCALL_UNUSE_PAGES]		(syscall)&mm_Unuse,
+[SYSCALL_MMAP]				(syscall)&mm_syscall_mmap,
+[SYSCALL_MUNMAP]			(syscall)&mm_syscall_munmap,
+[SYSCALL_MPROTECT]			(syscall)&mm_syscall_mprotect,
+[SYSCALL_MSYNC]				(syscall)&mm_syscall_msync,
 
 [SYSCALL_EXEC]				(syscall)&loader_syscall_load,
 [SYSCALL_EXIT]				(syscall)&pm_syscall_exit,
 [SYSCALL_WAIT]				(syscall)&pm_syscall_wait,
 [SYSCALL_THREAD_CREATE]		(syscall)&createThreadHandler,
 [SYSCALL_THREAD_EXIT]		(syscall)&exitThreadHandler,
+[SYSCALL_FORK]				(syscall)&pm_syscall_fork,
+[SYSCALL_NICE]				(syscall)&pm_syscall_nice,
+[SYSCALL_GET_PRIORITY]		(syscall)&pm_syscall_getpriority,
+[SYSCALL_SET_PRIORITY]		(syscall)&pm_syscall_setpriority,
 
 [SYSCALL_GET_TIMESTAMP]		(syscall)&cmos_syscall_timestamp,
 [SYSCALL_SLEEP]				(syscall)&sleepHandler,
@@ -8,6 +8,17 @@
 #ifndef SYSCALLS_H_
 #define SYSCALLS_H_
 
+#include "stdint.h"
+
+/**
+ * \brief Userspace state saved by isr_syscall at the top of the kernel stack
+ */
+typedef struct{
+	uint64_t r15, r14, r13, r12, rbp, rbx;
+	uint64_t gs;
+	uint64_t rflags, rsp, rip;
+}syscall_frame_t;
+
 void syscall_Init();
 
 #endif /* SYSCALLS_H_ */
@@ -9,10 +9,12 @@
 #include "stack.h"
 #include "stdlib.h"
 #include "scheduler.h"
+#include "slab.h"
 
 extern thread_t *cleanerThread;
 
 static stack_t *cleanStack;
+static slab_cache_t entry_cache = SLAB_CACHE_INIT("clean_entry_t", sizeof(clean_entry_t), NULL);
 
 void __attribute__((noreturn)) cleaner()
 {
@@ -30,7 +32,7 @@ void __attribute__((noreturn)) cleaner()
 					while(((thread_t*)entry->data)->Status.status != THREAD_BLOCKED) yield();
 					thread_destroy(entry->data, true);
 			}
-			free(entry);
+			slab_free(&entry_cache, entry);
 		}
 		thread_block_self(NULL, NULL, THREAD_BLOCKED_WAIT);
 	}
@@ -44,7 +46,7 @@ void cleaner_Init()
 //FIXME
 void cleaner_cleanProcess(process_t *process)
 {
-	clean_entry_t *entry = malloc(sizeof(clean_entry_t));
+	clean_entry_t *entry = slab_alloc(&entry_cache);
 
 	entry->type = CL_PROCESS;
 	entry->data = process;
@@ -55,7 +57,7 @@ void cleaner_cleanProcess(process_t *process)
 
 void cleaner_cleanThread(thread_t *thread)
 {
-	clean_entry_t *entry = malloc(sizeof(clean_entry_t));
+	clean_entry_t *entry = slab_alloc(&entry_cache);
 
 	entry->type = CL_THREAD;
 	entry->data = thread;
@@ -11,6 +11,8 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <gdt.h>
+#include <cpu.h>
 
 typedef struct{
 	dispatcher_task_handler_t func;
@@ -59,7 +61,7 @@ ihs_t *dispatcher_dispatch(ihs_t *state)
 			.ss = 0x10,
 			.es = 0x10,
 			.ds = 0x10,
-			.gs = 0x10,
+			.gs = GDT_CPU_LOCAL_SELECTOR,
 			.fs = 0x10,
 
 			//IRQs einschalten (IF = 1)
@@ -68,7 +70,9 @@ ihs_t *dispatcher_dispatch(ihs_t *state)
 			//Interrupt ist beim Schedulen 32
 			.interrupt = 32
 	};
-	static ihs_t new_state;
+	//Jede CPU braucht einen eigenen Zustand, da er erst beim Rücksprung aus dem Interrupt geladen wird
+	static ihs_t new_states[CPU_MAX_COUNT];
+	ihs_t *new_state = &new_states[cpu_getIndex()];
 
 	LOCKED_TRY_TASK(dispatcher_lock, {
 		if(queue_start != queue_end)
@@ -78,15 +82,15 @@ ihs_t *dispatcher_dispatch(ihs_t *state)
 			if(queue_start == queue_size)
 				queue_start = 0;
 
-			memcpy(&new_state, &init_state, sizeof(ihs_t));
-			new_state.rip = (uintptr_t)dispatch_wrapper;
-			new_state.rsp = (uintptr_t)state - 8;
+			memcpy(new_state, &init_state, sizeof(ihs_t));
+			new_state->rip = (uintptr_t)dispatch_wrapper;
+			new_state->rsp = (uintptr_t)state - 8;
 
-			new_state.rdi = (uintptr_t)state;
-			new_state.rsi = *((uintptr_t*)state - 1);
-			new_state.rdx = (uintptr_t)task->func;
-			new_state.rcx = (uintptr_t)task->opaque;
-			state = &new_state;
+			new_state->rdi = (uintptr_t)state;
+			new_state->rsi = *((uintptr_t*)state - 1);
+			new_state->rdx = (uintptr_t)task->func;
+			new_state->rcx = (uintptr_t)task->opaque;
+			state = new_state;
 		}
 	});
 
@@ -21,12 +21,17 @@
 #include "assert.h"
 #include "vfs.h"
 #include "userlib.h"
+#include "syscalls.h"
+#include "slab.h"
+#include <sys/resource.h>
 
 typedef struct{
 	thread_t *thread;
 	pid_t waiting_pid;
 }pm_wait_entry_t;
 
+static slab_cache_t process_cache = SLAB_CACHE_INIT("process_t", sizeof(process_t), NULL);
+
 typedef struct{
 	thread_t *thread;
 	thread_block_reason_t reason;
@@ -34,22 +39,12 @@ typedef struct{
 
 static pid_t nextPID = 1;
 static uint64_t numTasks = 0;
-extern process_t kernel_process;				//Handler für idle-Task
-extern thread_t* idleThread;				//Handler für idle-Task
+extern process_t kernel_process;
 thread_t* cleanerThread;				//Handler für cleaner-Task
 
 static avl_tree *process_list = NULL;	//Liste aller Prozesse
 static lock_t pm_lock = LOCK_INIT;
 
-/*
- * Idle-Task
- * Wird ausgeführt, wenn kein anderer Task ausgeführt wird
- */
-static void idle(void)
-{
-	while(1) CPU_HALT();
-}
-
 static int pid_cmp(const void *a, const void *b, void *c)
 {
 	const process_t *const p1 = a;
@@ -85,6 +80,13 @@ static void thread_unblock_visitor(const void *a)
 	thread_unblock(t);
 }
 
+static void thread_priority_visitor(const void *a, void *b)
+{
+	thread_t *const t = (thread_t*)a;
+	assert(t != NULL);
+	scheduler_setPriority(t, *(uint8_t*)b);
+}
+
 static void thread_destroy_action(void *a)
 {
 	thread_t *thread = a;
@@ -132,7 +134,7 @@ void pm_Init()
 	scheduler_Init();
 	cleaner_Init();
 
-	idleThread = ERROR_GET_VALUE(thread_create(&kernel_process, idle, 0, NULL, true));
+	scheduler_initCpu();
 	cleanerThread = ERROR_GET_VALUE(thread_create(&kernel_process, cleaner, 0, NULL, true));
 	kernel_process.Status = PM_RUNNING;
 }
@@ -145,7 +147,7 @@ void pm_Init()
 
 ERROR_TYPE_POINTER(process_t) pm_InitTask(process_t *parent, void *entry, char* cmd, const char **env, const char *stdin, const char *stdout, const char *stderr)
 {
-	process_t *newProcess = malloc(sizeof(process_t));
+	process_t *newProcess = slab_alloc(&process_cache);
 	if(newProcess == NULL)
 		return ERROR_RETURN_POINTER_ERROR(process_t, E_NO_MEMORY);
 
@@ -153,7 +155,7 @@ ERROR_TYPE_POINTER(process_t) pm_InitTask(process_t *parent, void *entry, char*
 	newProcess->cmd = strdup(cmd);
 	if(newProcess->cmd == NULL)
 	{
-		free(newProcess);
+		slab_free(&process_cache, newProcess);
 		return ERROR_RETURN_POINTER_ERROR(process_t, E_NO_MEMORY);
 	}
 
@@ -169,6 +171,8 @@ ERROR_TYPE_POINTER(process_t) pm_InitTask(process_t *parent, void *entry, char*
 	newProcess->terminated_childs = list_create();
 	newProcess->waiting_threads = list_create();
 	newProcess->waiting_threads_pid = list_create();
+	newProcess->lock = LOCK_INIT;
+	newProcess->nice = (parent != NULL) ? parent->nice : 0;
 
 	if(!vfs_initUserspace(parent, newProcess, stdin, stdout, stderr))
 	{
@@ -178,7 +182,7 @@ ERROR_TYPE_POINTER(process_t) pm_InitTask(process_t *parent, void *entry, char*
 		list_destroy(newProcess->waiting_threads_pid, free);
 		deleteContext(newProcess->Context);
 		free(newProcess->cmd);
-		free(newProcess);
+		slab_free(&process_cache, newProcess);
 		return ERROR_RETURN_POINTER_ERROR(process_t, E_CANCELED);	//TODO: better errorcode
 	}
 
@@ -212,7 +216,7 @@ ERROR_TYPE_POINTER(process_t) pm_InitTask(process_t *parent, void *entry, char*
 		list_destroy(newProcess->waiting_threads_pid, free);
 		deleteContext(newProcess->Context);
 		free(newProcess->cmd);
-		free(newProcess);
+		slab_free(&process_cache, newProcess);
 		return ERROR_RETURN_POINTER_ERROR(process_t, ERROR_GET_ERROR(thread_ret));
 	}
 
@@ -221,7 +225,80 @@ ERROR_TYPE_POINTER(process_t) pm_InitTask(process_t *parent, void *entry, char*
 	assert(res && "Es gibt schon einen Task mit dieser PID!");
 
 	__sync_fetch_and_add(&numTasks, 1);
+
+	return ERROR_RETURN_POINTER_VALUE(process_t, newProcess);
+}
+
+/*
+ * Erstellt eine Kopie des aktuellen Prozesses. Der Adressraum wird mit copy-on-write geteilt und
+ * die Standardstreams werden übernommen. Im neuen Prozess läuft nur eine Kopie des aktuellen Threads.
+ * Parameter:	state = Zustand, mit welchem der Thread im neuen Prozess weiterläuft
+ */
+ERROR_TYPE_POINTER(process_t) pm_ForkTask(const ihs_t *state)
+{
+	process_t *parent = currentProcess;
+	assert(parent != NULL && parent->parent != NULL);
+
+	process_t *newProcess = slab_alloc(&process_cache);
+	if(newProcess == NULL)
+		return ERROR_RETURN_POINTER_ERROR(process_t, E_NO_MEMORY);
+
+	newProcess->cmd = strdup(parent->cmd);
+	if(newProcess->cmd == NULL)
+	{
+		slab_free(&process_cache, newProcess);
+		return ERROR_RETURN_POINTER_ERROR(process_t, E_NO_MEMORY);
+	}
+
+	newProcess->Context = cloneContext(parent->Context);
+	if(newProcess->Context == NULL)
+	{
+		free(newProcess->cmd);
+		slab_free(&process_cache, newProcess);
+		return ERROR_RETURN_POINTER_ERROR(process_t, E_NO_MEMORY);
+	}
+
+	newProcess->PID = __sync_fetch_and_add(&nextPID, 1);
+	newProcess->next_tid = 1;
+	newProcess->parent = parent;
+	newProcess->Status = PM_BLOCKED;
+	newProcess->nextThreadStack = parent->nextThreadStack;
 	newProcess->lock = LOCK_INIT;
+	newProcess->nice = parent->nice;
+
+	newProcess->threads = NULL;
+	newProcess->terminated_childs = list_create();
+	newProcess->waiting_threads = list_create();
+	newProcess->waiting_threads_pid = list_create();
+
+	if(!vfs_initUserspace(parent, newProcess, NULL, NULL, NULL))
+	{
+		list_destroy(newProcess->terminated_childs, terminated_child_free);
+		list_destroy(newProcess->waiting_threads, NULL);
+		list_destroy(newProcess->waiting_threads_pid, free);
+		deleteContext(newProcess->Context);
+		free(newProcess->cmd);
+		slab_free(&process_cache, newProcess);
+		return ERROR_RETURN_POINTER_ERROR(process_t, E_CANCELED);
+	}
+
+	ERROR_TYPE_POINTER(thread_t) thread_ret = thread_fork(newProcess, state);
+	if(ERROR_DETECT(thread_ret))
+	{
+		vfs_deinitUserspace(newProcess);
+		list_destroy(newProcess->terminated_childs, terminated_child_free);
+		list_destroy(newProcess->waiting_threads, NULL);
+		list_destroy(newProcess->waiting_threads_pid, free);
+		deleteContext(newProcess->Context);
+		free(newProcess->cmd);
+		slab_free(&process_cache, newProcess);
+		return ERROR_RETURN_POINTER_ERROR(process_t, ERROR_GET_ERROR(thread_ret));
+	}
+
+	bool res = LOCKED_RESULT(pm_lock, avl_add_s(&process_list, newProcess, pid_cmp, NULL));
+	assert(res && "Es gibt schon einen Task mit dieser PID!");
+
+	__sync_fetch_and_add(&numTasks, 1);
 
 	return ERROR_RETURN_POINTER_VALUE(process_t, newProcess);
 }
@@ -242,7 +319,7 @@ void pm_DestroyTask(process_t *process)
 		list_destroy(process->waiting_threads_pid, free);
 		deleteContext(process->Context);
 		free(process->cmd);
-		free(process);
+		slab_free(&process_cache, process);
 		__sync_fetch_and_add(&numTasks, -1);
 	}
 	assert(!LOCKED_RESULT(pm_lock, avl_search_s(process_list, process, pid_cmp, NULL)));
@@ -326,6 +403,25 @@ process_t *pm_getTask(pid_t PID)
 	return Process;
 }
 
+/*
+ * Setzt den nice-Wert eines Prozesses und passt die Priorität aller seiner Threads an
+ * Parameter:	process = Prozess, dessen nice-Wert gesetzt wird
+ * 				nice = Neuer Wert, wird auf SCHEDULER_NICE_MIN bis SCHEDULER_NICE_MAX begrenzt
+ */
+void pm_setNice(process_t *process, int nice)
+{
+	if(nice < SCHEDULER_NICE_MIN)
+		nice = SCHEDULER_NICE_MIN;
+	else if(nice > SCHEDULER_NICE_MAX)
+		nice = SCHEDULER_NICE_MAX;
+
+	uint8_t priority = SCHEDULER_NICE_PRIORITY(nice);
+	LOCKED_TASK(process->lock, {
+		process->nice = nice;
+		avl_visit_s(process->threads, avl_visiting_in_order, thread_priority_visitor, &priority);
+	});
+}
+
 pid_t pm_WaitChild(pid_t pid, int *status)
 {
 	assert(currentProcess != NULL);
@@ -416,3 +512,90 @@ pid_t pm_syscall_wait(pid_t pid, int *status)
 		return 0;
 	return pm_WaitChild(pid, status);
 }
+
+pid_t pm_syscall_fork(void)
+{
+	assert(currentThread != NULL);
+
+	//Der Userspace-Zustand wurde von isr_syscall zuoberst auf dem Kernelstack gesichert
+	const syscall_frame_t *frame = currentThread->kernelStack - sizeof(syscall_frame_t);
+	const ihs_t state = {
+		.cs = 0x20 + 3,
+		.ss = 0x18 + 3,
+		.es = 0x10,
+		.ds = 0x10,
+		.gs = frame->gs,
+		.fs = 0x10,
+
+		.rip = frame->rip,
+		.rsp = frame->rsp,
+		.rflags = frame->rflags,
+
+		.rbx = frame->rbx,
+		.rbp = frame->rbp,
+		.r12 = frame->r12,
+		.r13 = frame->r13,
+		.r14 = frame->r14,
+		.r15 = frame->r15,
+
+		//Im neuen Prozess gibt fork 0 zurück
+		.rax = 0,
+
+		.interrupt = 32
+	};
+
+	ERROR_TYPE_POINTER(process_t) process_ret = pm_ForkTask(&state);
+	if(ERROR_DETECT(process_ret))
+		return -1;
+	process_t *process = ERROR_GET_VALUE(process_ret);
+	pm_ActivateTask(process);
+	return process->PID;
+}
+
+int pm_syscall_nice(int incr)
+{
+	assert(currentProcess != NULL);
+	//Grössere Schritte haben keine Wirkung mehr, würden aber beim Addieren überlaufen
+	if(incr < SCHEDULER_NICE_MIN - SCHEDULER_NICE_MAX)
+		incr = SCHEDULER_NICE_MIN - SCHEDULER_NICE_MAX;
+	else if(incr > SCHEDULER_NICE_MAX - SCHEDULER_NICE_MIN)
+		incr = SCHEDULER_NICE_MAX - SCHEDULER_NICE_MIN;
+	pm_setNice(currentProcess, currentProcess->nice + incr);
+	return currentProcess->nice;
+}
+
+/*
+ * Gibt den nice-Wert eines Prozesses zurück. Es wird nur PRIO_PROCESS unterstützt.
+ * Parameter:	which = PRIO_PROCESS
+ * 				who = PID des Prozesses oder 0 für den aktuellen Prozess
+ * 				value = Speicher für den nice-Wert
+ * Rückgabe:	0 bei Erfolg, -1 wenn der Prozess nicht existiert oder die Parameter ungültig sind
+ */
+int pm_syscall_getpriority(int which, pid_t who, int *value)
+{
+	if(which != PRIO_PROCESS || !vmm_userspacePointerValid(value, sizeof(*value)))
+		return -1;
+	process_t *process = (who == 0) ? currentProcess : pm_getTask(who);
+	if(process == NULL)
+		return -1;
+	*value = process->nice;
+	return 0;
+}
+
+/*
+ * Setzt den nice-Wert eines Prozesses. Es wird nur PRIO_PROCESS unterstützt.
+ * Parameter:	which = PRIO_PROCESS
+ * 				who = PID des Prozesses oder 0 für den aktuellen Prozess
+ * 				value = Neuer nice-Wert
+ * Rückgabe:	0 bei Erfolg, -1 wenn der Prozess nicht existiert oder die Parameter ungültig sind
+ */
+int pm_syscall_setpriority(int which, pid_t who, int value)
+{
+	if(which != PRIO_PROCESS)
+		return -1;
+	process_t *process = (who == 0) ? currentProcess : pm_getTask(who);
+	if(process == NULL)
+		return -1;
+	pm_setNice(process, value);
+	return 0;
+}
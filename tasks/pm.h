@@ -15,6 +15,7 @@
 #include "hashmap.h"
 #include "avl.h"
 #include "lock.h"
+#include "cpu.h"
 #include <bits/types.h>
 #include <bits/error.h>
 
@@ -39,22 +40,29 @@ typedef struct process_t{
 		void *nextThreadStack;
 		lock_t lock;
 		int exit_status;
+		int nice;			//Wird für die Priorität neuer Threads benutzt
 }process_t;
 ERROR_TYPEDEF_POINTER(process_t);
 
-extern process_t *currentProcess;			//Aktueller Prozess
+#define currentProcess	CPU_LOCAL_GET(process)		//Aktueller Prozess der CPU
 
 void pm_Init(void);
 ERROR_TYPE_POINTER(process_t) pm_InitTask(process_t *parent, void *entry, char* cmd, const char **env, const char *stdin, const char *stdout, const char *stderr);
+ERROR_TYPE_POINTER(process_t) pm_ForkTask(const ihs_t *state);
 void pm_DestroyTask(process_t *process);
 void pm_ExitTask(int code);
 void pm_BlockTask(process_t *process);
 void pm_ActivateTask(process_t *process);
 process_t *pm_getTask(pid_t PID);
 pid_t pm_WaitChild(pid_t pid, int *status);
+void pm_setNice(process_t *process, int nice);
 
 //syscalls
 void pm_syscall_exit(int status);
 pid_t pm_syscall_wait(pid_t pid, int *status);
+pid_t pm_syscall_fork(void);
+int pm_syscall_nice(int incr);
+int pm_syscall_getpriority(int which, pid_t who, int *value);
+int pm_syscall_setpriority(int which, pid_t who, int value);
 
 #endif /* PM_H_ */
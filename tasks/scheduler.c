@@ -9,28 +9,82 @@
 #include "ring.h"
 #include "lock.h"
 #include "stdbool.h"
+#include "pmm.h"
+#include "smp.h"
+#include "assert.h"
+#include "pit.h"
+#ifdef DEBUGMODE
+#include "display.h"
+#include "stdio.h"
+#endif
 
-extern thread_t *fpuThread;
+#define SCHEDULER_BENCHMARK_TIME		500		//Dauer einer Messung von scheduler_benchmark in ms
+#define SCHEDULER_BENCHMARK_THREADS	32		//Höchste Anzahl Threads in scheduler_benchmark
 
 process_t kernel_process = {
 		.Context = &kernel_context,
 		.cmd = "kernel",
 		.next_tid = 1
 };
-thread_t* idleThread;
 
-static ring_t* scheduleList;
-static lock_t schedule_lock = LOCK_INIT;
+//Jede CPU hat eine eigene Liste mit den Threads, die auf ihr laufen sollen. Für jede Priorität gibt es einen Ring, in
+//der Bitmap ist für jeden nicht leeren Ring ein Bit gesetzt. Damit wird der Ring mit der höchsten Priorität in O(1) gefunden.
+typedef struct{
+	ring_t *threads[SCHEDULER_PRIORITIES];
+	volatile uint64_t bitmap;
+	lock_t lock;
+	volatile size_t count;		//Anzahl Threads in der Liste, wird ohne Lock für die Suche nach Arbeit gelesen
+	volatile bool idle;			//Die CPU führt den Idle-Thread aus und muss geweckt werden, wenn es Arbeit gibt
+}run_queue_t;
+
+_Static_assert(SCHEDULER_PRIORITIES <= 64, "Priority bitmap too small");
+
+static run_queue_t runQueues[CPU_MAX_COUNT];
 static bool active = false;
-thread_t *currentThread;
-process_t *currentProcess;
+
+#ifdef DEBUGMODE
+//Zähler für scheduler_benchmark, jede CPU schreibt nur in ihren eigenen Eintrag
+static struct{
+	volatile uint64_t switches;		//Wechsel zu einem anderen Thread
+	volatile uint64_t locks;		//Gesperrte Listen
+	volatile uint64_t contended;	//Davon Listen, deren Lock bereits besetzt war
+}benchmarkStats[CPU_MAX_COUNT];
+#endif
+
+/*
+ * Idle-Task
+ * Wird ausgeführt, wenn kein anderer Task ausgeführt wird. Jede CPU hat einen eigenen Idle-Task.
+ */
+static void idle(void)
+{
+	while(1)
+	{
+		//Die freie Zeit wird genutzt, um Pages für pmm_AllocZeroed vorab zu löschen
+		if(!pmm_zeroIdlePage())
+			CPU_HALT();
+	}
+}
 
 /*
  * Initialisiert den Scheduler
  */
 void scheduler_Init()
 {
-	scheduleList = ring_create();
+	for(uint32_t i = 0; i < CPU_MAX_COUNT; i++)
+	{
+		for(uint32_t j = 0; j < SCHEDULER_PRIORITIES; j++)
+			runQueues[i].threads[j] = ring_create();
+		runQueues[i].lock = LOCK_INIT;
+	}
+}
+
+/*
+ * Erstellt den Idle-Task der aktuellen CPU. Muss auf jeder CPU aufgerufen werden, bevor sie Threads ausführt.
+ */
+void scheduler_initCpu()
+{
+	thread_t *idleThread = ERROR_GET_VALUE(thread_create(&kernel_process, idle, 0, NULL, true));
+	CPU_LOCAL_SET(idleThread, idleThread);
 }
 
 /*
@@ -42,28 +96,157 @@ void scheduler_activate()
 }
 
 /*
- * Fügt einen Thread der Schedulingliste hinzu
+ * Berechnet die Stufe, auf welcher ein Thread eingereiht wird. Die Erhöhung nach einer Eingabe wird von der
+ * Priorität abgezogen.
+ */
+static uint8_t threadLevel(const thread_t *thread)
+{
+	return (thread->priority > thread->boost) ? thread->priority - thread->boost : 0;
+}
+
+/*
+ * Länge der Zeitscheibe in Ticks. Threads mit höherer Priorität laufen länger, bei nice 0 sind es 5 Ticks (50ms).
+ */
+static uint32_t timeSliceLength(uint8_t priority)
+{
+	return 1 + (SCHEDULER_PRIORITIES - 1 - priority) / 4;
+}
+
+/*
+ * Fügt einen Thread in eine Liste ein bzw. entfernt ihn daraus. Der Lock der Liste muss gehalten werden.
+ */
+static void queueAdd(run_queue_t *queue, thread_t *thread)
+{
+	if(!thread->queued)
+	{
+		thread->level = threadLevel(thread);
+		ring_add(queue->threads[thread->level], &thread->ring_entry);
+		queue->bitmap |= 1ul << thread->level;
+		queue->count++;
+		thread->queued = true;
+	}
+}
+
+static void queueRemove(run_queue_t *queue, thread_t *thread)
+{
+	if(thread->queued)
+	{
+		ring_remove(queue->threads[thread->level], &thread->ring_entry);
+		if(ring_entries(queue->threads[thread->level]) == 0)
+			queue->bitmap &= ~(1ul << thread->level);
+		queue->count--;
+		thread->queued = false;
+	}
+}
+
+/*
+ * Sperrt eine Liste. Die Interrupts müssen deaktiviert sein.
+ */
+static void queueLock(run_queue_t *queue, lock_node_t *node)
+{
+#ifdef DEBUGMODE
+	benchmarkStats[cpu_getIndex()].locks++;
+	if(try_lock(&queue->lock, node))
+		return;
+	benchmarkStats[cpu_getIndex()].contended++;
+#endif
+	lock(&queue->lock, node);
+}
+
+/*
+ * Holt den Lock der Liste, in welcher sich der Thread befindet. Da der Thread in der Zwischenzeit von einer anderen
+ * CPU übernommen werden kann, wird nach dem Holen geprüft, ob es noch die richtige Liste ist.
+ * Die Interrupts müssen deaktiviert sein, da der Scheduler die Locks im Interrupt holt.
+ *
+ * Parameter:	thread = Thread, dessen Liste gesperrt werden soll
+ * 				node = Knoten für den Lock
+ * 				wait = Auf den Lock warten
+ * Rückgabe:	Gesperrte Liste oder NULL, wenn nicht gewartet werden soll und der Lock besetzt ist
+ */
+static run_queue_t *lockThreadQueue(thread_t *thread, lock_node_t *node, bool wait)
+{
+	while(true)
+	{
+		uint32_t cpu = thread->cpu;
+		run_queue_t *queue = &runQueues[cpu];
+		if(wait)
+			queueLock(queue, node);
+		else if(!try_lock(&queue->lock, node))
+			return NULL;
+		if(thread->cpu == cpu)
+			return queue;
+		unlock(&queue->lock, node);
+	}
+}
+
+/*
+ * Weckt eine CPU, nachdem ein Thread in ihre Liste eingefügt wurde. Führt sie gerade den Idle-Thread aus, wird sie selbst
+ * geweckt, ansonsten eine untätige CPU, welche den wartenden Thread übernehmen kann.
+ *
+ * Parameter:	cpu = Index der CPU, in deren Liste der Thread eingefügt wurde
+ * 				idle = Die CPU führte beim Einfügen den Idle-Thread aus
+ */
+static void wakeCpu(uint32_t cpu, bool idle)
+{
+	//Auch die eigene CPU muss sich selbst unterbrechen, da sie danach sonst wieder im Idle-Thread anhält
+	if(idle)
+	{
+		smp_reschedule(cpu);
+		return;
+	}
+
+	if(runQueues[cpu].count > 1)
+	{
+		for(uint32_t i = 0; i < smp_getCpuCount(); i++)
+		{
+			if(i != cpu && runQueues[i].idle)
+			{
+				smp_reschedule(i);
+				break;
+			}
+		}
+	}
+}
+
+/*
+ * Fügt einen Thread der Liste der CPU hinzu, auf welcher er zuletzt lief
  *
  * Parameter:	thread = Thread, der hinzugefügt werden soll
+ * Rückgabe:	false, wenn der Lock besetzt war
  */
 bool scheduler_try_add(thread_t *thread)
 {
-	bool res = false;
-	LOCKED_TRY_TASK(schedule_lock, {
-		ring_add(scheduleList, &thread->ring_entry);
-		res = true;
-	});
-	return res;
+	bool enabled = cpu_disableInterrupts();
+	lock_node_t node;
+	run_queue_t *queue = lockThreadQueue(thread, &node, false);
+	if(queue != NULL)
+	{
+		queueAdd(queue, thread);
+		uint32_t cpu = thread->cpu;
+		bool idle = queue->idle;
+		unlock(&queue->lock, &node);
+		wakeCpu(cpu, idle);
+	}
+	cpu_restoreInterrupts(enabled);
+	return queue != NULL;
 }
 
 /*
- * Fügt einen Thread der Schedulingliste hinzu
+ * Fügt einen Thread der Liste der CPU hinzu, auf welcher er zuletzt lief
  *
  * Parameter:	thread = Thread, der hinzugefügt werden soll
  */
 void scheduler_add(thread_t *thread)
 {
-	while(!scheduler_try_add(thread)) CPU_PAUSE();
+	bool enabled = cpu_disableInterrupts();
+	lock_node_t node;
+	run_queue_t *queue = lockThreadQueue(thread, &node, true);
+	queueAdd(queue, thread);
+	uint32_t cpu = thread->cpu;
+	bool idle = queue->idle;
+	unlock(&queue->lock, &node);
+	wakeCpu(cpu, idle);
+	cpu_restoreInterrupts(enabled);
 }
 
 /*
@@ -73,10 +256,144 @@ void scheduler_add(thread_t *thread)
  */
 void scheduler_remove(thread_t *thread)
 {
-	LOCKED_TASK(schedule_lock, {
-		if(ring_contains(scheduleList, &thread->ring_entry))
-			ring_remove(scheduleList, &thread->ring_entry);
-	});
+	bool enabled = cpu_disableInterrupts();
+	lock_node_t node;
+	run_queue_t *queue = lockThreadQueue(thread, &node, true);
+	queueRemove(queue, thread);
+	unlock(&queue->lock, &node);
+	cpu_restoreInterrupts(enabled);
+}
+
+/*
+ * Sucht den nächsten Thread mit der höchsten Priorität, welcher nicht auf einer anderen CPU läuft. Innerhalb einer
+ * Stufe werden die Threads der Reihe nach ausgewählt. Der Lock muss gehalten werden.
+ *
+ * Parameter:	queue = Liste, welche durchsucht wird
+ * 				current = Thread, welcher auf dieser CPU läuft (darf gewählt werden)
+ * Rückgabe:	Gefundener Thread oder NULL
+ */
+static thread_t *queuePick(run_queue_t *queue, thread_t *current)
+{
+	for(uint64_t levels = queue->bitmap; levels != 0; levels &= levels - 1)
+	{
+		ring_t *ring = queue->threads[__builtin_ctzl(levels)];
+		for(size_t i = ring_entries(ring); i > 0; i--)
+		{
+			thread_t *thread = (thread_t*)ring_getNext(ring);
+			if(thread == current || !thread->onCpu)
+				return thread;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Übernimmt einen Thread von der CPU mit den meisten wartenden Threads. Wird aufgerufen, wenn die eigene Liste
+ * keinen Thread zum Ausführen hat.
+ *
+ * Parameter:	cpu = Index der aktuellen CPU
+ * Rückgabe:	Übernommener Thread (bereits als laufend markiert) oder NULL
+ */
+static thread_t *steal(uint32_t cpu)
+{
+	//Der laufende Thread zählt mit, deshalb muss die Liste mindestens zwei Threads haben
+	uint32_t victim = cpu;
+	size_t max = 1;
+	for(uint32_t i = 0; i < smp_getCpuCount(); i++)
+	{
+		if(i != cpu && runQueues[i].count > max)
+		{
+			max = runQueues[i].count;
+			victim = i;
+		}
+	}
+	if(victim == cpu)
+		return NULL;
+
+	//Die Locks werden immer in derselben Reihenfolge geholt
+	run_queue_t *own = &runQueues[cpu], *other = &runQueues[victim];
+	run_queue_t *first = (cpu < victim) ? own : other, *second = (cpu < victim) ? other : own;
+	lock_node_t firstNode, secondNode;
+	queueLock(first, &firstNode);
+	queueLock(second, &secondNode);
+
+	thread_t *thread = queuePick(other, NULL);
+	if(thread != NULL)
+	{
+		queueRemove(other, thread);
+		thread->cpu = cpu;
+		queueAdd(own, thread);
+		thread->onCpu = true;
+		own->idle = false;
+	}
+
+	unlock(&second->lock, &secondNode);
+	unlock(&first->lock, &firstNode);
+	return thread;
+}
+
+/*
+ * Ändert die Priorität eines Threads. Ist der Thread eingereiht, wird er auf die neue Stufe verschoben.
+ *
+ * Parameter:	thread = Thread, dessen Priorität geändert wird
+ * 				priority = Neue Priorität (0 bis SCHEDULER_PRIORITIES - 1)
+ */
+void scheduler_setPriority(thread_t *thread, uint8_t priority)
+{
+	assert(priority < SCHEDULER_PRIORITIES);
+	bool enabled = cpu_disableInterrupts();
+	lock_node_t node;
+	run_queue_t *queue = lockThreadQueue(thread, &node, true);
+	thread->priority = priority;
+	if(thread->queued)
+	{
+		queueRemove(queue, thread);
+		queueAdd(queue, thread);
+	}
+	unlock(&queue->lock, &node);
+	cpu_restoreInterrupts(enabled);
+}
+
+/*
+ * Wird vom Timer jeder CPU alle SCHEDULER_TICK ms aufgerufen. Der Thread wird gewechselt, wenn seine Zeitscheibe
+ * abgelaufen ist oder ein Thread mit höherer Priorität wartet.
+ *
+ * Parameter:	state = Zustand des unterbrochenen Threads
+ * Rückgabe:	Zustand des Threads, welcher weiterläuft
+ */
+ihs_t *scheduler_tick(ihs_t *state)
+{
+	thread_t *thread = currentThread;
+	if(!active || thread == NULL || thread == CPU_LOCAL_GET(idleThread))
+		return scheduler_schedule(state);
+
+	run_queue_t *queue = &runQueues[cpu_getIndex()];
+	CPU_LOCAL_SET(nextTick, pit_getUptime() + SCHEDULER_TICK);
+	if(thread->timeSlice <= 1)
+	{
+		thread->timeSlice = 0;
+		//Die Erhöhung nach einer Eingabe baut sich mit jeder verbrauchten Zeitscheibe ab
+		if(thread->boost > 0)
+		{
+			lock_node_t node;
+			queueLock(queue, &node);
+			if(thread->queued)
+			{
+				queueRemove(queue, thread);
+				thread->boost--;
+				queueAdd(queue, thread);
+			}
+			unlock(&queue->lock, &node);
+		}
+		return scheduler_schedule(state);
+	}
+	thread->timeSlice--;
+
+	//Wartet ein Thread mit höherer Priorität, wird er sofort ausgeführt
+	if(queue->bitmap & ((1ul << thread->level) - 1))
+		return scheduler_schedule(state);
+
+	return state;
 }
 
 /*
@@ -86,46 +403,85 @@ void scheduler_remove(thread_t *thread)
  */
 ihs_t *scheduler_schedule(ihs_t *state)
 {
-	thread_t *newThread;
+	thread_t *oldThread = currentThread;
+	thread_t *newThread = NULL;
 
 	if(!active)
 		return state;
 
-	if(currentThread != NULL)
+	if(oldThread != NULL)
 	{
-		currentThread->State = state;
+		oldThread->State = state;
 	}
 
-	lock_node_t lock_node;
-	if(try_lock(&schedule_lock, &lock_node))
+	uint32_t cpu = cpu_getIndex();
+	run_queue_t *queue = &runQueues[cpu];
+	lock_node_t node;
+	queueLock(queue, &node);
+	//Threads, welche gerade noch auf einer anderen CPU laufen, werden übersprungen
+	newThread = queuePick(queue, oldThread);
+	if(newThread != NULL)
+	{
+		newThread->onCpu = true;
+		queue->idle = false;
+	}
+	unlock(&queue->lock, &node);
+	if(newThread == NULL)
+		newThread = steal(cpu);
+	if(newThread == NULL)
 	{
-		newThread = (thread_t*)ring_getNext(scheduleList);
+		//Ein Thread, welcher seit der Suche eingefügt wurde, hat diese CPU nicht geweckt
+		queueLock(queue, &node);
+		newThread = queuePick(queue, oldThread);
+		if(newThread != NULL)
+			newThread->onCpu = true;
+		queue->idle = (newThread == NULL);
+		unlock(&queue->lock, &node);
 		if(newThread == NULL)
-			newThread = idleThread;
-		unlock(&schedule_lock, &lock_node);
-
-		if(newThread != currentThread)
 		{
-			if(currentProcess != newThread->process)
-				activateContext(newThread->process->Context);
-			thread_prepare(newThread);
-
-			currentProcess = newThread->process;
-			currentThread = newThread;
+			newThread = CPU_LOCAL_GET(idleThread);
+			newThread->onCpu = true;
+		}
+	}
+	if(newThread->timeSlice == 0)
+		newThread->timeSlice = timeSliceLength(newThread->priority);
 
-			if(fpuThread == currentThread)
-			{
-				asm volatile("clts");
-			}
-			else
+	if(newThread != oldThread)
+	{
+#ifdef DEBUGMODE
+		benchmarkStats[cpu].switches++;
+#endif
+		if(oldThread != NULL)
+		{
+			//Der FPU-Zustand wird gesichert, damit der Thread auf einer anderen CPU weiterlaufen kann
+			if(CPU_LOCAL_GET(fpuThread) == oldThread)
 			{
-				//TS-Bit setzen
-				uint64_t cr0 = cpu_readControlRegister(CPU_CR0);							
-				cpu_writeControlRegister(CPU_CR0, cr0 | (1 << 3));
+				cpu_saveXState(oldThread->fpuState);
+				CPU_LOCAL_SET(fpuThread, NULL);
 			}
+			//Der Thread wird freigegeben, sobald sein Stack beim Rücksprung nicht mehr benutzt wird
+			CPU_LOCAL_SET(releaseFlag, &oldThread->onCpu);
 		}
+
+		if(currentProcess != newThread->process)
+			activateContext(newThread->process->Context);
+		thread_prepare(newThread);
+
+		CPU_LOCAL_SET(process, newThread->process);
+		CPU_LOCAL_SET(thread, newThread);
+
+		//TS-Bit setzen, damit der FPU-Zustand erst bei der ersten Benutzung geladen wird
+		uint64_t cr0 = cpu_readControlRegister(CPU_CR0);
+		cpu_writeControlRegister(CPU_CR0, cr0 | (1 << 3));
 	}
 
+	//Der Idle-Thread braucht keinen Tick, die CPU wird geweckt, sobald es Arbeit für sie gibt
+	if(newThread == CPU_LOCAL_GET(idleThread))
+		CPU_LOCAL_SET(nextTick, 0);
+	else if(CPU_LOCAL_GET(nextTick) == 0)
+		CPU_LOCAL_SET(nextTick, pit_getUptime() + SCHEDULER_TICK);
+	pit_armLocalTimer();
+
 	return currentThread->State;
 }
 
@@ -137,3 +493,86 @@ void yield()
 {
 	asm volatile("int $0xFF");
 }
+
+#ifdef DEBUGMODE
+static volatile bool benchmarkRunning;
+
+/*
+ * Wechselt den Thread, solange eine Messung läuft, und wartet danach auf die nächste Messung
+ */
+static void __attribute__((noreturn)) benchmarkWorker()
+{
+	while(1)
+	{
+		while(benchmarkRunning) yield();
+		thread_block_self(NULL, NULL, THREAD_BLOCKED_WAIT);
+	}
+}
+
+/*
+ * Zählt die Threadwechsel und gesperrten Listen aller CPUs zusammen
+ */
+static void benchmarkSum(uint64_t *switches, uint64_t *locks, uint64_t *contended)
+{
+	*switches = *locks = *contended = 0;
+	for(uint32_t i = 0; i < smp_getCpuCount(); i++)
+	{
+		*switches += benchmarkStats[i].switches;
+		*locks += benchmarkStats[i].locks;
+		*contended += benchmarkStats[i].contended;
+	}
+}
+
+/*
+ * Misst die Threadwechsel pro Sekunde und wie oft ein Lock einer Liste besetzt war, während 1 bis
+ * SCHEDULER_BENCHMARK_THREADS Threads ständig yield() aufrufen. Der aufrufende Thread schläft während der Messung.
+ */
+void scheduler_benchmark()
+{
+	thread_t *threads[SCHEDULER_BENCHMARK_THREADS];
+	size_t created = 0;
+	char msg[80];
+
+	for(size_t count = 1; count <= SCHEDULER_BENCHMARK_THREADS; count *= 2)
+	{
+		for(; created < count; created++)
+		{
+			ERROR_TYPE_POINTER(thread_t) thread = thread_create(&kernel_process, benchmarkWorker, 0, NULL, true);
+			if(ERROR_DETECT(thread))
+				break;
+			threads[created] = ERROR_GET_VALUE(thread);
+		}
+		if(created < count)
+		{
+			SysLogError("SCHEDULER", "Benchmark abgebrochen, zu wenig Speicher");
+			break;
+		}
+
+		uint64_t switches, locks, contended;
+		benchmarkSum(&switches, &locks, &contended);
+		uint64_t start = pit_getUptime();
+		benchmarkRunning = true;
+		for(size_t i = 0; i < count; i++)
+			thread_unblock(threads[i]);
+		pit_RegisterTimer(currentThread, SCHEDULER_BENCHMARK_TIME);
+		benchmarkRunning = false;
+		uint64_t elapsed = pit_getUptime() - start;
+
+		uint64_t switchesEnd, locksEnd, contendedEnd;
+		benchmarkSum(&switchesEnd, &locksEnd, &contendedEnd);
+		sprintf(msg, "%lu Threads: %lu Wechsel/s, %lu von %lu Locks besetzt", count,
+				(elapsed > 0) ? (switchesEnd - switches) * 1000 / elapsed : 0, contendedEnd - contended, locksEnd - locks);
+		SysLog("SCHEDULER", msg);
+
+		//Ein Thread kann erst wieder geweckt werden, wenn er vollständig aus der Liste entfernt wurde
+		for(size_t i = 0; i < count; i++)
+		{
+			while(threads[i]->Status.status != THREAD_BLOCKED || threads[i]->queued)
+				yield();
+		}
+	}
+
+	for(size_t i = 0; i < created; i++)
+		thread_destroy(threads[i], true);
+}
+#endif
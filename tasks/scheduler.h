@@ -15,17 +15,34 @@
 #include "isr.h"
 
 extern process_t kernel_process;
-extern thread_t *currentThread;
-extern process_t *currentProcess;
+
+//Aktueller Thread der CPU
+#define currentThread	CPU_LOCAL_GET(thread)
+
+#define SCHEDULER_TICK			10		//Abstand der Timerinterrupts für das Scheduling in ms
+#define SCHEDULER_PRIORITIES	40		//Anzahl Prioritätsstufen, 0 ist die höchste
+#define SCHEDULER_NICE_MIN		-20
+#define SCHEDULER_NICE_MAX		19
+#define SCHEDULER_IO_BOOST		5		//Erhöhung der Priorität nach dem Warten auf eine Eingabe
+
+//Priorität der Threads eines Prozesses mit dem angegebenen nice-Wert
+#define SCHEDULER_NICE_PRIORITY(nice)	((uint8_t)((nice) - SCHEDULER_NICE_MIN))
 
 void scheduler_Init();
+void scheduler_initCpu();
 void scheduler_activate();
 void scheduler_add(thread_t *thread);
 bool scheduler_try_add(thread_t *thread);
 void scheduler_remove(thread_t *thread);
+void scheduler_setPriority(thread_t *thread, uint8_t priority);
 
+ihs_t *scheduler_tick(ihs_t *state);
 ihs_t *scheduler_schedule(ihs_t *state);
 
 void yield();
 
+#ifdef DEBUGMODE
+void scheduler_benchmark();
+#endif
+
 #endif /* SCHEDULER_H_ */
@@ -14,6 +14,29 @@
 #include "scheduler.h"
 #include "pmm.h"
 #include "assert.h"
+#include "slab.h"
+#include "gdt.h"
+#include "pit.h"
+#ifdef DEBUGMODE
+#include "display.h"
+#include "stdio.h"
+#endif
+
+#define THREAD_POOL_MAX		32		//Maximum number of kernel stacks and FPU areas kept for new threads
+#define THREAD_BENCHMARK_TIME	200		//Dauer einer Messung von thread_benchmark in ms
+#define THREAD_BENCHMARK_BATCH	16		//Threads pro Durchlauf, kleiner als THREAD_POOL_MAX
+
+//Freigegebene Kernelstacks und FPU-Bereiche bleiben gemappt und werden für neue Threads wiederverwendet.
+//Ein Element im Pool enthält an seinem Anfang den Zeiger auf das nächste Element.
+typedef struct{
+	void *head;
+	size_t count;
+	lock_t lock;
+}thread_pool_t;
+
+static slab_cache_t thread_cache = SLAB_CACHE_INIT("thread_t", sizeof(thread_t), NULL);
+static thread_pool_t stack_pool = {.lock = LOCK_INIT};
+static thread_pool_t fpu_pool = {.lock = LOCK_INIT};
 
 static int tid_cmp(const void *a, const void *b)
 {
@@ -26,28 +49,135 @@ void thread_Init()
 {
 }
 
-ERROR_TYPE_POINTER(thread_t) thread_create(process_t *process, void *entry, size_t data_length, void *data, bool kernel)
+static void *poolGet(thread_pool_t *pool)
 {
-	if (data_length >= MM_USER_STACK_SIZE) return ERROR_RETURN_POINTER_ERROR(thread_t, E_NO_MEMORY);
+	return LOCKED_RESULT(pool->lock, {
+		void *element = pool->head;
+		if(element != NULL)
+		{
+			pool->head = *(void**)element;
+			pool->count--;
+		}
+		element;
+	});
+}
 
-	thread_t *thread = (thread_t*)malloc(sizeof(thread_t));
-	if (thread == NULL) return ERROR_RETURN_POINTER_ERROR(thread_t, E_NO_MEMORY);
+/*
+ * Legt ein Element in den Pool. Ist der Pool voll, wird false zurückgegeben und der Aufrufer muss das Element freigeben.
+ */
+static bool poolPut(thread_pool_t *pool, void *element)
+{
+	return LOCKED_RESULT(pool->lock, {
+		bool kept = pool->count < THREAD_POOL_MAX;
+		if(kept)
+		{
+			*(void**)element = pool->head;
+			pool->head = element;
+			pool->count++;
+		}
+		kept;
+	});
+}
+
+static size_t fpuPages(void)
+{
+	return (cpuInfo.xsave_area_size + MM_BLOCK_SIZE - 1) / MM_BLOCK_SIZE;
+}
+
+static void *kernelStackAlloc(void)
+{
+	void *stack = poolGet(&stack_pool);
+	if(stack == NULL)
+	{
+		assert(MM_KERN_STACK_SIZE % MM_BLOCK_SIZE == 0);
+		stack = vmm_MapGuarded(&kernel_context, NULL, 0, MM_KERN_STACK_SIZE / MM_BLOCK_SIZE, VMM_FLAGS_NX | VMM_FLAGS_GLOBAL | VMM_FLAGS_WRITE | VMM_FLAGS_ALLOCATE);
+	}
+	return stack;
+}
+
+static void kernelStackFree(void *stack)
+{
+	if(!poolPut(&stack_pool, stack))
+		vmm_UnMapGuarded(&kernel_context, stack, MM_KERN_STACK_SIZE / MM_BLOCK_SIZE, true);
+}
+
+static void *fpuStateAlloc(void)
+{
+	void *fpuState = poolGet(&fpu_pool);
+	//Der alte Zustand darf nicht an den neuen Thread weitergegeben werden
+	if(fpuState != NULL)
+		memset(fpuState, 0, fpuPages() * MM_BLOCK_SIZE);
+	else
+		fpuState = vmm_Map(&kernel_context, NULL, 0, fpuPages(), VMM_FLAGS_ALLOCATE | VMM_FLAGS_NX | VMM_FLAGS_WRITE);
+	return fpuState;
+}
+
+static void fpuStateFree(void *fpuState)
+{
+	if(!poolPut(&fpu_pool, fpuState))
+		vmm_UnMap(&kernel_context, fpuState, fpuPages(), true);
+}
+
+/*
+ * Erstellt die Threadstruktur mit Kernelstack und FPU-Bereich. Der Thread wird noch nicht in den Prozess eingetragen.
+ * Parameter:	process = Prozess des Threads
+ * 				state = Anfänglicher CPU-Zustand
+ * Rückgabe:	NULL = zu wenig Speicher vorhanden
+ */
+static thread_t *thread_alloc(process_t *process, const ihs_t *state)
+{
+	thread_t *thread = slab_alloc(&thread_cache);
+	if (thread == NULL) return NULL;
 
 	thread->isMainThread = (process != currentProcess);
 
 	thread->tid = __sync_fetch_and_add(&process->next_tid, 1);
 
 	thread->process = process;
+	thread->userStackBottom = NULL;
 
 	thread->Status.block_reason = THREAD_BLOCKED;
 	thread->Status.status = THREAD_BLOCKED_NOT_BLOCKED;
+
+	//Kernelstack vorbereiten
+	thread->kernelStackBottom = kernelStackAlloc();
+	if (thread->kernelStackBottom == NULL) {
+		slab_free(&thread_cache, thread);
+		return NULL;
+	}
+	thread->kernelStack = thread->kernelStackBottom + MM_KERN_STACK_SIZE;
+	thread->State = (ihs_t*)(thread->kernelStack - sizeof(ihs_t));
+	memcpy(thread->State, state, sizeof(ihs_t));
+
+	thread->fpuState = fpuStateAlloc();
+	if (thread->fpuState == NULL) {
+		kernelStackFree(thread->kernelStackBottom);
+		slab_free(&thread_cache, thread);
+		return NULL;
+	}
+	thread->fpuInitialised = false;
+	thread->onCpu = false;
+	thread->cpu = cpu_getIndex();
+	thread->queued = false;
+	thread->priority = SCHEDULER_NICE_PRIORITY(process->nice);
+	thread->boost = 0;
+	thread->timeSlice = 0;
+	thread->timer.pprev = NULL;
+
+	return thread;
+}
+
+ERROR_TYPE_POINTER(thread_t) thread_create(process_t *process, void *entry, size_t data_length, void *data, bool kernel)
+{
+	if (data_length >= MM_USER_STACK_SIZE) return ERROR_RETURN_POINTER_ERROR(thread_t, E_NO_MEMORY);
+
 	// CPU-Zustand für den neuen Task festlegen
 	ihs_t new_state = {
 			.cs = (kernel) ? 0x8 : 0x20 + 3,	//Kernel- oder Userspace
 			.ss = (kernel) ? 0x10 : 0x18 + 3,	//Kernel- oder Userspace
 			.es = 0x10,
 			.ds = 0x10,
-			.gs = 0x10,
+			.gs = (kernel) ? GDT_CPU_LOCAL_SELECTOR : 0x10,
 			.fs = 0x10,
 
 			.rip = (uint64_t)entry,	//Einsprungspunkt des Programms
@@ -60,21 +190,10 @@ ERROR_TYPE_POINTER(thread_t) thread_create(process_t *process, void *entry, size
 			//Interrupt ist beim Schedulen 32
 			.interrupt = 32
 	};
-	
-	//Kernelstack vorbereiten
-	assert(MM_KERN_STACK_SIZE % MM_BLOCK_SIZE == 0);
-	thread->kernelStackBottom = vmm_MapGuarded(&kernel_context, NULL, 0, MM_KERN_STACK_SIZE / MM_BLOCK_SIZE, VMM_FLAGS_NX | VMM_FLAGS_GLOBAL | VMM_FLAGS_WRITE | VMM_FLAGS_ALLOCATE);
-	if (thread->kernelStackBottom == NULL) {
-		free(thread);
-		return ERROR_RETURN_POINTER_ERROR(thread_t, E_NO_MEMORY);
-	}
-	thread->kernelStack = thread->kernelStackBottom + MM_KERN_STACK_SIZE;
-	thread->State = (ihs_t*)(thread->kernelStack - sizeof(ihs_t));
-	if (kernel) new_state.rsp = (uintptr_t)thread->kernelStackBottom + MM_KERN_STACK_SIZE;
-	memcpy(thread->State, &new_state, sizeof(ihs_t));
 
-	thread->fpuState = vmm_Map(&kernel_context, NULL, 0, (cpuInfo.xsave_area_size + MM_BLOCK_SIZE - 1) / MM_BLOCK_SIZE, VMM_FLAGS_ALLOCATE | VMM_FLAGS_NX | VMM_FLAGS_WRITE);
-	thread->fpuInitialised = false;
+	thread_t *thread = thread_alloc(process, &new_state);
+	if (thread == NULL) return ERROR_RETURN_POINTER_ERROR(thread_t, E_NO_MEMORY);
+	if (kernel) thread->State->rsp = (uintptr_t)thread->kernelStack;
 
 	//Stack mappen
 	if(!kernel)
@@ -88,28 +207,58 @@ ERROR_TYPE_POINTER(thread_t) thread_create(process_t *process, void *entry, size
 		process->nextThreadStack -= MM_USER_STACK_SIZE + MM_BLOCK_SIZE;
 	}
 
-	avl_add(&process->threads, thread, tid_cmp);
+	LOCKED_TASK(process->lock, avl_add(&process->threads, thread, tid_cmp));
+
+	return ERROR_RETURN_POINTER_VALUE(thread_t, thread);
+}
+
+/*
+ * Erstellt eine Kopie des aktuellen Threads in einem geklonten Prozess. Der Userstack wurde bereits mit dem
+ * Adressraum kopiert, deshalb wird dieselbe Adresse weiterverwendet.
+ * Parameter:	process = Prozess, welcher durch das Klonen des aktuellen Prozesses entstanden ist
+ * 				state = Userspace-Zustand, bei welchem der neue Thread weiterläuft
+ */
+ERROR_TYPE_POINTER(thread_t) thread_fork(process_t *process, const ihs_t *state)
+{
+	thread_t *thread = thread_alloc(process, state);
+	if (thread == NULL) return ERROR_RETURN_POINTER_ERROR(thread_t, E_NO_MEMORY);
+	thread->userStackBottom = currentThread->userStackBottom;
+
+	//FPU-Zustand übernehmen. Besitzt der Thread gerade die FPU, ist der gespeicherte Zustand nicht aktuell.
+	if(currentThread->fpuInitialised)
+	{
+		if(CPU_LOCAL_GET(fpuThread) == currentThread)
+			cpu_saveXState(currentThread->fpuState);
+		memcpy(thread->fpuState, currentThread->fpuState, cpuInfo.xsave_area_size);
+		thread->fpuInitialised = true;
+	}
+
+	LOCKED_TASK(process->lock, avl_add(&process->threads, thread, tid_cmp));
 
 	return ERROR_RETURN_POINTER_VALUE(thread_t, thread);
 }
 
 void thread_destroy(thread_t *thread, bool remove_from_process)
 {
-	vmm_UnMapGuarded(&kernel_context, thread->kernelStackBottom, MM_KERN_STACK_SIZE / MM_BLOCK_SIZE, true);
+	//Eine andere CPU kann noch auf dem Kernelstack des Threads sein
+	while(thread->onCpu) yield();
+
+	pit_CancelTimer(thread);
+
+	kernelStackFree(thread->kernelStackBottom);
 
 	if (remove_from_process) {
 		//Thread aus Liste entfernen
 		LOCKED_TASK(thread->process->lock, avl_remove(&thread->process->threads, thread, tid_cmp));
 	}
 
-	//Userstack freigeben
-	vmm_UnMap(thread->process->Context, thread->userStackBottom, MM_USER_STACK_SIZE / MM_BLOCK_SIZE, true);
+	//Userstack freigeben, Kernelthreads haben keinen
+	if(thread->userStackBottom != NULL)
+		vmm_UnMap(thread->process->Context, thread->userStackBottom, MM_USER_STACK_SIZE / MM_BLOCK_SIZE, true);
 
-	extern thread_t *fpuThread;
-	if(fpuThread == thread)
-		fpuThread = NULL;
-	vmm_UnMap(&kernel_context, thread->fpuState, 1, true);
-	free(thread);
+	//Der FPU-Zustand wurde beim letzten Wechsel gesichert, keine CPU benutzt ihn mehr
+	fpuStateFree(thread->fpuState);
+	slab_free(&thread_cache, thread);
 }
 
 void thread_prepare(thread_t *thread)
@@ -157,6 +306,8 @@ bool thread_try_unblock(thread_t *thread)
 	const thread_status_t newStatus = {{THREAD_RUNNING, THREAD_BLOCKED_NOT_BLOCKED}};
 	if(__sync_bool_compare_and_swap(&thread->Status.full_status, expected.full_status, newStatus.full_status))
 	{
+		if(expected.block_reason == THREAD_BLOCKED_USER_IO)
+			thread->boost = SCHEDULER_IO_BOOST;
 		if(!scheduler_try_add(thread))
 		{
 			thread->Status.block_reason = expected.block_reason;
@@ -180,9 +331,106 @@ void thread_unblock(thread_t *thread)
 	{
 		assert(++try_count > 1000 && "Thread could not been unblocked");
 	}
+	//Interaktive Threads sollen schnell auf Eingaben reagieren
+	if(expected.block_reason == THREAD_BLOCKED_USER_IO)
+		thread->boost = SCHEDULER_IO_BOOST;
 	scheduler_add(thread);
 }
 
+#ifdef DEBUGMODE
+static void __attribute__((noreturn)) benchmarkEntry()
+{
+	while(1) thread_block_self(NULL, NULL, THREAD_BLOCKED_WAIT);
+}
+
+/*
+ * Erstellt und zerstört Kernelthreads für THREAD_BENCHMARK_TIME ms. Die Threads werden nie gestartet.
+ * Rückgabe:	Threads pro Sekunde
+ */
+static uint64_t benchmarkSpawn(void)
+{
+	thread_t *threads[THREAD_BENCHMARK_BATCH];
+	uint64_t spawned = 0;
+	uint64_t start = pit_getUptime(), elapsed = 0;
+
+	while(elapsed < THREAD_BENCHMARK_TIME)
+	{
+		size_t count;
+		for(count = 0; count < THREAD_BENCHMARK_BATCH; count++)
+		{
+			ERROR_TYPE_POINTER(thread_t) thread = thread_create(&kernel_process, benchmarkEntry, 0, NULL, true);
+			if(ERROR_DETECT(thread))
+				break;
+			threads[count] = ERROR_GET_VALUE(thread);
+		}
+		for(size_t i = 0; i < count; i++)
+			thread_destroy(threads[i], true);
+		spawned += count;
+		if(count == 0)
+			break;
+		elapsed = pit_getUptime() - start;
+	}
+
+	return (elapsed > 0) ? spawned * 1000 / elapsed : 0;
+}
+
+/*
+ * Mappt und entfernt Kernelstacks und FPU-Bereiche für THREAD_BENCHMARK_TIME ms, wie es ohne die Pools bei jedem
+ * Thread nötig wäre.
+ * Rückgabe:	Stacks mit FPU-Bereich pro Sekunde
+ */
+static uint64_t benchmarkMap(void)
+{
+	void *stacks[THREAD_BENCHMARK_BATCH];
+	void *fpuStates[THREAD_BENCHMARK_BATCH];
+	uint64_t mapped = 0;
+	uint64_t start = pit_getUptime(), elapsed = 0;
+
+	while(elapsed < THREAD_BENCHMARK_TIME)
+	{
+		size_t count;
+		for(count = 0; count < THREAD_BENCHMARK_BATCH; count++)
+		{
+			stacks[count] = vmm_MapGuarded(&kernel_context, NULL, 0, MM_KERN_STACK_SIZE / MM_BLOCK_SIZE,
+					VMM_FLAGS_NX | VMM_FLAGS_GLOBAL | VMM_FLAGS_WRITE | VMM_FLAGS_ALLOCATE);
+			if(stacks[count] == NULL)
+				break;
+			fpuStates[count] = vmm_Map(&kernel_context, NULL, 0, fpuPages(), VMM_FLAGS_ALLOCATE | VMM_FLAGS_NX | VMM_FLAGS_WRITE);
+			if(fpuStates[count] == NULL)
+			{
+				vmm_UnMapGuarded(&kernel_context, stacks[count], MM_KERN_STACK_SIZE / MM_BLOCK_SIZE, true);
+				break;
+			}
+		}
+		for(size_t i = 0; i < count; i++)
+		{
+			vmm_UnMapGuarded(&kernel_context, stacks[i], MM_KERN_STACK_SIZE / MM_BLOCK_SIZE, true);
+			vmm_UnMap(&kernel_context, fpuStates[i], fpuPages(), true);
+		}
+		mapped += count;
+		if(count == 0)
+			break;
+		elapsed = pit_getUptime() - start;
+	}
+
+	return (elapsed > 0) ? mapped * 1000 / elapsed : 0;
+}
+
+/*
+ * Misst, wie viele Threads pro Sekunde erstellt und beendet werden können, und vergleicht das mit dem Mappen der
+ * Kernelstacks und FPU-Bereiche, welches die Pools einsparen
+ */
+void thread_benchmark()
+{
+	char msg[80];
+
+	sprintf(msg, "Threads erstellen/beenden: %lu/s", benchmarkSpawn());
+	SysLog("THREAD", msg);
+	sprintf(msg, "Stack und FPU-Bereich mappen/entfernen: %lu/s", benchmarkMap());
+	SysLog("THREAD", msg);
+}
+#endif
+
 void thread_waitUserIO()
 {
 	thread_block_self(NULL, NULL, THREAD_BLOCKED_USER_IO);
@@ -97,10 +97,35 @@ typedef union{
 	uint64_t full_status;
 }thread_status_t __attribute__((aligned(16)));
 
+/**
+ * \brief Entry of a sleeping thread in the timer wheel.
+ */
+typedef struct thread_timer{
+	/**
+	 * Next timer in the same slot of the wheel.
+	 */
+	struct thread_timer *next;
+
+	/**
+	 * Pointer to the pointer which points to this timer. NULL if the timer is not registered.
+	 */
+	struct thread_timer **pprev;
+
+	/**
+	 * Uptime at which the thread is woken up.
+	 */
+	uint64_t timeout;
+
+	/**
+	 * Slot of the wheel which contains the timer.
+	 */
+	uint16_t bucket;
+}thread_timer_t;
+
 /**
  * \brief Structure describing a thread.
  */
-typedef struct{
+typedef struct thread{
 	/**
 	 * The ring entry structure used for inserting the thread into the scheduler list.
 	 */
@@ -150,6 +175,49 @@ typedef struct{
 	 * Determines if the fpu is initialised
 	 */
 	bool fpuInitialised;
+
+	/**
+	 * Set while a cpu runs the thread or still uses its kernel stack. Such a thread is skipped by the scheduler of
+	 * the other cpus.
+	 */
+	volatile bool onCpu;
+
+	/**
+	 * Index of the cpu whose run queue holds the thread or on which it ran last. Only changed while the lock of that
+	 * run queue is held.
+	 */
+	uint32_t cpu;
+
+	/**
+	 * Set while the thread is in the run queue of #cpu.
+	 */
+	bool queued;
+
+	/**
+	 * Base priority derived from the nice value of the process. 0 is the highest priority.
+	 */
+	uint8_t priority;
+
+	/**
+	 * Temporary raise of the priority after the thread waited for user input. Decreases with every used up time
+	 * slice. Only written by the waking thread while the thread is blocked or with the lock of its run queue held.
+	 */
+	uint8_t boost;
+
+	/**
+	 * Priority level in the run queue, i.e. #priority lowered by #boost.
+	 */
+	uint8_t level;
+
+	/**
+	 * Remaining scheduler ticks of the current time slice.
+	 */
+	uint32_t timeSlice;
+
+	/**
+	 * Timer used by pit_RegisterTimer. Embedded so sleeping needs no allocation.
+	 */
+	thread_timer_t timer;
 }thread_t;
 ERROR_TYPEDEF_POINTER(thread_t);
 
@@ -157,6 +225,7 @@ typedef void(*thread_bail_out_t)(void*);
 
 void thread_Init();
 ERROR_TYPE_POINTER(thread_t) thread_create(process_t *process, void *entry, size_t data_length, void *data, bool kernel);
+ERROR_TYPE_POINTER(thread_t) thread_fork(process_t *process, const ihs_t *state);
 void thread_destroy(thread_t *thread, bool remove_from_process);
 void thread_prepare(thread_t *thread);
 bool thread_block(thread_t *thread, thread_block_reason_t reason);
@@ -165,4 +234,8 @@ bool thread_try_unblock(thread_t *thread);
 void thread_unblock(thread_t *thread);
 void thread_waitUserIO();
 
+#ifdef DEBUGMODE
+void thread_benchmark();
+#endif
+
 #endif /* THREAD_H_ */
@@ -8,6 +8,7 @@
 #include "tss.h"
 #include "gdt.h"
 #include "string.h"
+#include "cpu.h"
 #include <assert.h>
 
 #define SELECTOR	5
@@ -29,20 +30,26 @@ typedef struct{
 		uint8_t IOPD[8192];
 }__attribute__((packed)) tss_entry_t;
 
-tss_entry_t tss;
+//Jede CPU hat eine eigene TSS
+static tss_entry_t tss[CPU_MAX_COUNT];
 
+/*
+ * Initialisiert die TSS der aktuellen CPU und trägt sie in deren GDT ein
+ */
 void TSS_Init()
 {
+	tss_entry_t *entry = &tss[cpu_getIndex()];
+
 	//GDT-Eintrag erstellen
-	GDT_SetSystemDescriptor(SELECTOR, (uintptr_t)&tss, sizeof(tss), 0x89, 0x0);
+	GDT_SetSystemDescriptor(SELECTOR, (uintptr_t)entry, sizeof(*entry), 0x89, 0x0);
 
 	//Task-Segment Selector
 	tr_t tr;
 	tr.Selector = SELECTOR << 3;
 
 	//TSS initialisieren
-	tss.MapBaseAddress = 0x96;
-	memset(tss.IOPD, 0, 8192);
+	entry->MapBaseAddress = 0x96;
+	memset(entry->IOPD, 0, 8192);
 
 	//Taskergister laden
 	asm volatile("ltr %0" : : "m"(tr));
@@ -50,11 +57,13 @@ void TSS_Init()
 
 void TSS_setStack(void *stack)
 {
-	tss.rsp0 = (uint64_t)stack;
+	tss[cpu_getIndex()].rsp0 = (uint64_t)stack;
+	//Der Syscall-Einsprungspunkt liest den Stack aus den Daten der CPU
+	CPU_LOCAL_SET(kernelStack, stack);
 }
 
 void TSS_setIST(uint32_t ist, void *ist_stack) {
 	ist--;
 	assert(ist < 7);
-	tss.ist[ist] = (uint64_t)ist_stack;
+	tss[cpu_getIndex()].ist[ist] = (uint64_t)ist_stack;
 }
@@ -46,16 +46,35 @@ static avl_tree* _avl_parent(avl_tree* tree) {
 	return (avl_tree*)((uintptr_t)tree->parent & ~7);
 }
 
+static avl_tree* _avl_alloc(const avl_callbacks* cb) {
+	if (cb && cb->alloc) {
+		avl_tree* node = cb->alloc(sizeof(avl_tree), cb->context);
+		if (node) memset(node, 0, sizeof(avl_tree));
+		return node;
+	}
+	return calloc(1, sizeof(avl_tree));
+}
+
+static void _avl_free(avl_tree* tree, const avl_callbacks* cb) {
+	if (cb && cb->free) cb->free(tree, cb->context);
+	else free(tree);
+}
+
+static void _avl_update(avl_tree* tree, const avl_callbacks* cb) {
+	if (cb && cb->update) cb->update(tree, cb->context);
+}
+
 static void _avl_set_parent(avl_tree* tree, avl_tree* parent) {
 	tree->parent = (avl_tree*)((uintptr_t)parent | ((uintptr_t)tree->parent & 7));
 }
 
-static avl_tree* _avl_insert(void* val, avl_tree* parent, bool left) {
+static avl_tree* _avl_insert(void* val, avl_tree* parent, bool left, const avl_callbacks* cb) {
 	avl_tree* new;
-	new = calloc(1, sizeof(avl_tree));
+	new = _avl_alloc(cb);
 	assert(new);
 	_avl_set_balance(new, 0);
 	new->value = val;
+	_avl_update(new, cb);
 	if (!parent) return new;
 	if (left) {
 		parent->left = new;
@@ -68,7 +87,7 @@ static avl_tree* _avl_insert(void* val, avl_tree* parent, bool left) {
 	return parent;
 }
 
-static avl_tree* _avl_remove(avl_tree* old) {
+static avl_tree* _avl_remove(avl_tree* old, const avl_callbacks* cb) {
 	avl_tree* current = old;
 	if (current->left) current = current->left;
 	while (current->right) current = current->right;
@@ -84,11 +103,11 @@ static avl_tree* _avl_remove(avl_tree* old) {
 		if (current->left) _avl_set_parent(current->left, _avl_parent(current));
 	}
 	avl_tree* ret = _avl_parent(current);
-	free(current);
+	_avl_free(current, cb);
 	return ret;
 }
 
-static avl_tree* _avl_rotate_left(avl_tree* current) {
+static avl_tree* _avl_rotate_left(avl_tree* current, const avl_callbacks* cb) {
 	avl_tree* ret = current->right;
 	avl_tree* tmp = ret->left;
 	ret->left = current;
@@ -104,10 +123,12 @@ static avl_tree* _avl_rotate_left(avl_tree* current) {
 	int8_t topbalance = _avl_balance(ret) > 0? _avl_balance(current) - 2 : _avl_balance(ret) - 1;
 	_avl_set_balance(current, leftbalance);
 	_avl_set_balance(ret, topbalance);
+	_avl_update(current, cb);
+	_avl_update(ret, cb);
 	return ret;
 }
 
-static avl_tree* _avl_rotate_right(avl_tree* current) {
+static avl_tree* _avl_rotate_right(avl_tree* current, const avl_callbacks* cb) {
 	avl_tree* ret = current->left;
 	avl_tree* tmp = ret->right;
 	ret->right = current;
@@ -123,46 +144,49 @@ static avl_tree* _avl_rotate_right(avl_tree* current) {
 	int8_t topbalance = _avl_balance(ret) < 0? _avl_balance(current) + 2 : _avl_balance(ret) + 1;
 	_avl_set_balance(current, rightbalance);
 	_avl_set_balance(ret, topbalance);
+	_avl_update(current, cb);
+	_avl_update(ret, cb);
 	return ret;
 }
 
-static avl_tree* _avl_rotate_insert(avl_tree* current) {
+static avl_tree* _avl_rotate_insert(avl_tree* current, const avl_callbacks* cb) {
 	avl_tree* prev = NULL;
 	bool propagate = true;
 	while (current != NULL) {
 		if (propagate) {
 			propagate = (_avl_balance(current) == -1 || _avl_balance(current) == 1);
 			if (_avl_balance(current) > 1) {
-				if (_avl_balance(current->right) <= 0) _avl_rotate_right(current->right);
-				current = _avl_rotate_left(current);
+				if (_avl_balance(current->right) <= 0) _avl_rotate_right(current->right, cb);
+				current = _avl_rotate_left(current, cb);
 			} else if (_avl_balance(current) < -1) {
-				if (_avl_balance(current->left) >= 0) _avl_rotate_left(current->left);
-				current = _avl_rotate_right(current);
+				if (_avl_balance(current->left) >= 0) _avl_rotate_left(current->left, cb);
+				current = _avl_rotate_right(current, cb);
 			}
 			if (propagate && _avl_parent(current)) {
 				if (_avl_parent(current)->left == current) _avl_dec_balance(_avl_parent(current));
 				else _avl_inc_balance(_avl_parent(current));
 			}
 		}
+		_avl_update(current, cb);
 		prev = current;
 		current = _avl_parent(current);
 	}
 	return prev;
 }
 
-static avl_tree* _avl_rotate_delete(avl_tree* current) {
+static avl_tree* _avl_rotate_delete(avl_tree* current, const avl_callbacks* cb) {
 	avl_tree* prev = NULL;
 	bool propagate = true;
 	while (current != NULL) {
 		if (propagate) {
 			if (_avl_balance(current) > 1) {
-				if (_avl_balance(current->right) < 0) _avl_rotate_right(current->right);
+				if (_avl_balance(current->right) < 0) _avl_rotate_right(current->right, cb);
 				else if (_avl_balance(current->right) == 0) propagate = false;
-				current = _avl_rotate_left(current);
+				current = _avl_rotate_left(current, cb);
 			} else if (_avl_balance(current) < -1) {
-				if (_avl_balance(current->left) > 0) _avl_rotate_left(current->left);
+				if (_avl_balance(current->left) > 0) _avl_rotate_left(current->left, cb);
 				else if (_avl_balance(current->left) == 0) propagate = false;
-				current = _avl_rotate_right(current);
+				current = _avl_rotate_right(current, cb);
 			} else if (_avl_balance(current) * _avl_balance(current) == 1) {
 				propagate = false;
 			}
@@ -171,13 +195,14 @@ static avl_tree* _avl_rotate_delete(avl_tree* current) {
 				else _avl_dec_balance(_avl_parent(current));
 			}
 		}
+		_avl_update(current, cb);
 		prev = current;
 		current = _avl_parent(current);
 	}
 	return prev;
 }
 
-bool avl_add_s(avl_tree** root, void* element, int (*comp)(const void*, const void*, void*), void* context) {
+bool avl_add_c(avl_tree** root, void* element, int (*comp)(const void*, const void*, void*), void* context, const avl_callbacks* callbacks) {
 	int res = 1;
 	avl_tree* prev = NULL;
 	avl_tree* current = *root;
@@ -186,19 +211,27 @@ bool avl_add_s(avl_tree** root, void* element, int (*comp)(const void*, const vo
 		current = res < 0? current->left : current->right;
 	}
 	if (!res) return false;
-	*root = _avl_rotate_insert(_avl_insert(element, prev, res < 0));
+	*root = _avl_rotate_insert(_avl_insert(element, prev, res < 0, callbacks), callbacks);
 	return true;
 }
 
-bool avl_remove_s(avl_tree** root, void* element, int (*comp)(const void*, const void*, void*), void* context) {
+bool avl_remove_c(avl_tree** root, void* element, int (*comp)(const void*, const void*, void*), void* context, const avl_callbacks* callbacks) {
 	int res = 1;
 	avl_tree* current = *root;
 	while (current && (res = comp(element, current->value, context))) current = res < 0? current->left : current->right;
 	if (res) return false;
-	*root = _avl_rotate_delete(_avl_remove(current));
+	*root = _avl_rotate_delete(_avl_remove(current, callbacks), callbacks);
 	return true;
 }
 
+bool avl_add_s(avl_tree** root, void* element, int (*comp)(const void*, const void*, void*), void* context) {
+	return avl_add_c(root, element, comp, context, NULL);
+}
+
+bool avl_remove_s(avl_tree** root, void* element, int (*comp)(const void*, const void*, void*), void* context) {
+	return avl_remove_c(root, element, comp, context, NULL);
+}
+
 bool avl_search_s(avl_tree* root, void* element, int (*comp)(const void*, const void*, void*), void* context) {
 	int res = 1;
 	while (root && (res = comp(element, root->value, context))) root = res < 0? root->left : root->right;
@@ -236,7 +269,19 @@ int avl_visit(avl_tree* root, avl_visiting_method method, void (*visiter)(const
 	return avl_visit_s(root, method, _avl_visiterh, visiter);
 }
 
-void avl_free(avl_tree* tree, void (*action)(void*)) {
+void* avl_value(const avl_tree* tree) {
+	return tree->value;
+}
+
+avl_tree* avl_left(const avl_tree* tree) {
+	return tree->left;
+}
+
+avl_tree* avl_right(const avl_tree* tree) {
+	return tree->right;
+}
+
+void avl_free_c(avl_tree* tree, void (*action)(void*), const avl_callbacks* callbacks) {
 	while (tree) {
 		if (tree->left) {
 			tree = tree->left;
@@ -250,7 +295,11 @@ void avl_free(avl_tree* tree, void (*action)(void*)) {
 			avl_tree* tmp = tree;
 			tree = _avl_parent(tree);
 			if (action) action(tmp->value);
-			free(tmp);
+			_avl_free(tmp, callbacks);
 		}
 	}
 }
+
+void avl_free(avl_tree* tree, void (*action)(void*)) {
+	avl_free_c(tree, action, NULL);
+}
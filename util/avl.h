@@ -15,6 +15,7 @@
 
 #include "stdbool.h"
 #include "stdint.h"
+#include "stddef.h"
 
 typedef enum avl_visiting_method_e {
 	avl_visiting_pre_order,
@@ -24,6 +25,19 @@ typedef enum avl_visiting_method_e {
 
 typedef struct avl_tree_s avl_tree;
 
+/*
+ * Callbacks für Bäume mit eigener Speicherverwaltung oder zusätzlichen Informationen in den Knoten.
+ * alloc und free ersetzen calloc und free für die Knoten (NULL = Standardfunktion).
+ * update wird für jeden Knoten aufgerufen, dessen Teilbaum sich verändert hat. Die Aufrufe erfolgen von unten nach oben,
+ * so dass die Kinder beim Aufruf schon aktualisiert sind.
+ */
+typedef struct avl_callbacks_s {
+	void* (*alloc)(size_t size, void* context);
+	void (*free)(void* node, void* context);
+	void (*update)(avl_tree* node, void* context);
+	void* context;
+} avl_callbacks;
+
 /*
  * Fügt Element element in *root ein. Gibt zurück ob eingefügt
  */
@@ -44,6 +58,19 @@ bool avl_search_s(avl_tree* root, void* element, int (*comp)(const void*, const
  */
 int avl_visit_s(avl_tree* root, avl_visiting_method method, void (*visiter)(const void*, void*), void* context);
 
+/*
+ * Wie avl_add_s bzw. avl_remove_s, aber mit Callbacks (siehe avl_callbacks)
+ */
+bool avl_add_c(avl_tree** root, void* element, int (*comp)(const void*, const void*, void*), void* context, const avl_callbacks* callbacks);
+bool avl_remove_c(avl_tree** root, void* element, int (*comp)(const void*, const void*, void*), void* context, const avl_callbacks* callbacks);
+
+/*
+ * Zugriff auf einen Knoten, z.B. um in einem erweiterten Baum zu suchen
+ */
+void* avl_value(const avl_tree* tree);
+avl_tree* avl_left(const avl_tree* tree);
+avl_tree* avl_right(const avl_tree* tree);
+
 /*
  * Fügt element hinzu
  */
@@ -56,5 +83,6 @@ int avl_visit(avl_tree* root, avl_visiting_method method, void (*visiter)(const
  * Löscht den gesamten Baum
  */
 void avl_free(avl_tree* tree, void (*action)(void*));
+void avl_free_c(avl_tree* tree, void (*action)(void*), const avl_callbacks* callbacks);
 
 #endif /* AVL_H_ */
@@ -12,6 +12,7 @@
 #include "stdlib.h"
 #include "disasm.h"
 #include "string.h"
+#include "gdt.h"
 
 #ifdef DEBUGMODE
 
@@ -30,7 +31,7 @@ static ihs_t *Debug_Handler(ihs_t *ihs)
 					.ss = 0x10,
 					.es = 0x10,
 					.ds = 0x10,
-					.gs = 0x10,
+					.gs = GDT_CPU_LOCAL_SELECTOR,
 					.fs = 0x10,
 
 					.rdi = ihs,						//Als Parameter die Adresse zum Zustand des Programms geben
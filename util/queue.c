@@ -8,6 +8,9 @@
 #include "queue.h"
 #include "stdlib.h"
 #include "assert.h"
+#include "slab.h"
+
+static slab_cache_t entry_cache = SLAB_CACHE_INIT("queue_entry_t", sizeof(queue_entry_t), NULL);
 
 /*
  * Erstellt eine neue Queue.
@@ -51,7 +54,7 @@ void *queue_enqueue(queue_t *queue, void *value)
 {
 	assert(queue != NULL);
 
-	queue_entry_t *entry = malloc(sizeof(queue_entry_t));
+	queue_entry_t *entry = slab_alloc(&entry_cache);
 	if(entry == NULL)
 		return NULL;
 
@@ -81,6 +84,6 @@ void *queue_dequeue(queue_t *queue)
 	void *value = entry->value;
 	queue->end = entry->next;
 	queue->size--;
-	free(entry);
+	slab_free(&entry_cache, entry);
 	return value;
 }
@@ -9,12 +9,15 @@
 #include "stdlib.h"
 #include "assert.h"
 #include "stdint.h"
+#include "slab.h"
 
 typedef struct stack_elem{
 	struct stack_elem *next;
 	void *data;
 }stack_elem_t;
 
+static slab_cache_t elem_cache = SLAB_CACHE_INIT("stack_elem_t", sizeof(stack_elem_t), NULL);
+
 struct stack{
 	union{
 		uint128_t full_stack;
@@ -41,7 +44,7 @@ void stack_push(stack_t *stack, void *data)
 {
 	assert(stack != NULL);
 	stack_t prev, new;
-	stack_elem_t *elem = malloc(sizeof(stack_elem_t));
+	stack_elem_t *elem = slab_alloc(&elem_cache);
 	elem->data = data;
 	do
 	{
@@ -70,6 +73,6 @@ bool stack_pop(stack_t *stack, void **value)
 
 	if(value != NULL)
 		*value = prev.head->data;
-	free(prev.head);
+	slab_free(&elem_cache, prev.head);
 	return true;
 }
@@ -7,13 +7,14 @@
 
 #include "system.h"
 #include "pmm.h"
+#include "vmm.h"
 #include "console.h"
 #include "stdio.h"
 #include "debug.h"
 #include "lock.h"
 #include "scheduler.h"
-
-extern uint64_t Uptime;
+#include "pit.h"
+#include "loader.h"
 
 char system_panic_buffer[25 * 80];
 static lock_t panic_buffer_lock = LOCK_INIT;
@@ -26,7 +27,10 @@ void getSystemInformation(SIS *Struktur)
 {
 	Struktur->physSpeicher = pmm_getTotalPages() * 4096;
 	Struktur->physFree = pmm_getFreePages() * 4096;
-	Struktur->Uptime = Uptime;
+	Struktur->Uptime = pit_getUptime();
+	Struktur->sharedImageMemory = loader_getSharedPages() * 4096;
+	Struktur->pageTableMemory = vmm_getPageTablePages(currentProcess->Context) * 4096;
+	Struktur->totalPageTableMemory = vmm_getTotalPageTablePages() * 4096;
 }
 
 void system_panic_enter()
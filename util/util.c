@@ -58,11 +58,15 @@ uint64_t inq(uint16_t Port)
 
 void Sleep(uint64_t msec)
 {
-	uint64_t start = Uptime;
+	uint64_t start = pit_getUptime();
 	while(1)
 	{
-		if(start + msec <= Uptime)
+		if(start + msec <= pit_getUptime())
 			break;
-		asm volatile("hlt");
+		//Ohne periodischen Interrupt würde die CPU nicht rechtzeitig aufgeweckt
+		if(pit_isTickless())
+			CPU_PAUSE();
+		else
+			CPU_HALT();
 	}
 }
@@ -10,6 +10,7 @@
 #include <string.h>
 #include <vfs/node.h>
 #include <vfs.h>
+#include <vmm.h>
 
 static uint64_t mode_hash(const void *key, __attribute__((unused)) void *context)
 {
@@ -93,12 +94,15 @@ int vfs_node_file_init(vfs_node_file_t *node, const char *name)
 	if(res)
 		return res;
 	node->base.type = VFS_NODE_FILE;
+	node->pageCache = NULL;
 
 	return 0;
 }
 
 void vfs_node_file_deinit(vfs_node_file_t *node)
 {
+	if(node->pageCache != NULL)
+		REFCOUNT_RELEASE(node->pageCache);
 	vfs_node_deinit(&node->base);
 }
 
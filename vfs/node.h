@@ -19,6 +19,7 @@ typedef enum{
 }vfs_node_type_t;
 
 struct vfs_node_dir;
+struct vmm_page_cache;
 
 typedef struct vfs_node{
 	/**
@@ -170,6 +171,12 @@ typedef struct vfs_node_file{
 	 * @return !0 if error
 	 */
 	int (*truncate)(struct vfs_node_file *node, size_t size);
+
+	/**
+	 * Pages of the file which are mapped into memory or NULL if the file was never mapped.
+	 * Reads and writes through the vfs go through the cached pages. Protected by the lock of the node.
+	 */
+	struct vmm_page_cache *pageCache;
 }vfs_node_file_t;
 
 typedef struct vfs_node_link{
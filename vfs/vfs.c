@@ -21,8 +21,12 @@
 #include "path.h"
 #include <hash_helpers.h>
 #include <refcount.h>
+#include "slab.h"
+#include "vmm.h"
+#include "memory.h"
 
 #define MIN(a, b)	((a < b) ? a : b)
+#define MAX(a, b)	((a > b) ? a : b)
 
 struct vfs_stream{
 	vfs_node_t *node;
@@ -30,6 +34,8 @@ struct vfs_stream{
 	vfs_mode_t mode;
 };
 
+static slab_cache_t stream_cache = SLAB_CACHE_INIT("vfs_stream_t", sizeof(vfs_stream_t), NULL);
+
 //Ein Stream vom Userspace hat eine ID, der auf einen Stream des Kernels gemappt ist
 typedef struct{
 	vfs_file_t id;
@@ -101,7 +107,7 @@ static void vfs_stream_closed(const void *s)
 	//Remove stream from opened stream hashmap of node
 	LOCKED_TASK(stream->node->lock, hashmap_delete(stream->node->streams, stream));
 
-	free(stream);
+	slab_free(&stream_cache, stream);
 }
 
 /*
@@ -253,9 +259,10 @@ static ERROR_TYPE_POINTER(vfs_stream_t) getOrCreateStream(vfs_node_t *node, vfs_
 		vfs_stream_t *stream;
 		if(!hashmap_search(node->streams, &mode, (void**)&stream) || REFCOUNT_RETAIN(stream) == NULL)
 		{
-			stream = calloc(1, sizeof(*stream));
+			stream = slab_alloc(&stream_cache);
 			if(stream == NULL)
 				return ERROR_RETURN_POINTER_ERROR(vfs_stream_t, E_NO_MEMORY);
+			memset(stream, 0, sizeof(*stream));
 
 			stream->mode = mode;
 			stream->node = node;
@@ -354,6 +361,11 @@ static bool visitChildsCallback(vfs_node_t *node, void *context)
 	return true;
 }
 
+static vmm_page_cache_t *getPageCache(vfs_node_file_t *node)
+{
+	return LOCKED_RESULT(node->base.lock, (node->pageCache != NULL) ? REFCOUNT_RETAIN(node->pageCache) : NULL);
+}
+
 /*
  * Eine Datei lesen
  * Parameter:	Path = Pfad zur Datei als String
@@ -386,7 +398,17 @@ size_t vfs_Read(vfs_stream_t *stream, uint64_t start, size_t length, void *buffe
 		}
 		break;
 		case VFS_NODE_FILE:
-			sizeRead = ((vfs_node_file_t*)node)->read((vfs_node_file_t*)node, start, length, buffer);
+		{
+			vfs_node_file_t *fnode = (vfs_node_file_t*)node;
+			sizeRead = fnode->read(fnode, start, length, buffer);
+			//Gemappte Pages können neuere Daten enthalten als die Datei
+			vmm_page_cache_t *cache = getPageCache(fnode);
+			if(cache != NULL)
+			{
+				vmm_copyPageCache(cache, start, sizeRead, buffer, false);
+				REFCOUNT_RELEASE(cache);
+			}
+		}
 		break;
 		case VFS_NODE_DEV:
 			sizeRead = ((vfs_node_dev_t*)node)->read((vfs_node_dev_t*)node, start, length, buffer);
@@ -412,7 +434,16 @@ size_t vfs_Write(vfs_stream_t *stream, uint64_t start, size_t length, const void
 	switch(node->type)
 	{
 		case VFS_NODE_FILE:
-			sizeWritten = ((vfs_node_file_t*)node)->write(((vfs_node_file_t*)node), start, length, buffer);
+		{
+			vfs_node_file_t *fnode = (vfs_node_file_t*)node;
+			sizeWritten = fnode->write(fnode, start, length, buffer);
+			vmm_page_cache_t *cache = getPageCache(fnode);
+			if(cache != NULL)
+			{
+				vmm_copyPageCache(cache, start, sizeWritten, (void*)buffer, true);
+				REFCOUNT_RELEASE(cache);
+			}
+		}
 		break;
 		case VFS_NODE_DEV:
 			sizeWritten = ((vfs_node_dev_t*)node)->write(((vfs_node_dev_t*)node), start, length, buffer);
@@ -525,6 +556,56 @@ void vfs_setFileinfo(vfs_stream_t *stream, vfs_fileinfo_t info, uint64_t value)
 	stream->node->setAttribute(stream->node, info, value);
 }
 
+/**
+ * Returns the page cache of a file which is used for mappings of the file
+ * \param stream Stream of the file
+ * \param pages Minimal number of pages of the cache
+ * \return Cache with an additional reference or NULL on failure
+ */
+vmm_page_cache_t *vfs_getPageCache(vfs_stream_t *stream, size_t pages)
+{
+	vfs_node_t *node = stream->node;
+	if(node->type != VFS_NODE_FILE)
+		return NULL;
+	vfs_node_file_t *fnode = (vfs_node_file_t*)node;
+
+	const uint64_t fileSize = vfs_getFileinfo(stream, VFS_INFO_FILESIZE);
+	pages = MAX(pages, (fileSize + MM_BLOCK_SIZE - 1) / MM_BLOCK_SIZE);
+	return LOCKED_RESULT(node->lock, {
+		//Bestehende Mappings behalten den alten Cache, der die gleichen Pages referenziert
+		if(fnode->pageCache == NULL || fnode->pageCache->pages < pages)
+		{
+			vmm_page_cache_t *cache = (fnode->pageCache == NULL) ? vmm_createPageCache(pages) : vmm_growPageCache(fnode->pageCache, pages);
+			if(cache != NULL)
+			{
+				if(fnode->pageCache != NULL)
+					REFCOUNT_RELEASE(fnode->pageCache);
+				fnode->pageCache = cache;
+			}
+		}
+		(fnode->pageCache != NULL && fnode->pageCache->pages >= pages) ? REFCOUNT_RETAIN(fnode->pageCache) : NULL;
+	});
+}
+
+vfs_mode_t vfs_getStreamMode(vfs_stream_t *stream)
+{
+	return stream->mode;
+}
+
+/**
+ * Returns the kernel stream of a stream of a process
+ * \param p Process which owns the stream
+ * \param streamid Id of the stream in the process
+ * \return Stream with an additional reference or NULL if the process has no such stream
+ */
+vfs_stream_t *vfs_getUserspaceStream(process_t *p, vfs_file_t streamid)
+{
+	return LOCKED_RESULT(p->lock, {
+		vfs_userspace_stream_t *stream;
+		hashmap_search(p->streams, (void*)streamid, (void**)&stream) ? REFCOUNT_RETAIN(stream->stream) : NULL;
+	});
+}
+
 int vfs_truncate(const char *path, size_t size)
 {
 	if(path == NULL || strlen(path) == 0 || !check_path(path))
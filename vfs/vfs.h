@@ -101,6 +101,9 @@ int vfs_initUserspace(process_t *parent, process_t *p, const char *stdin, const
 void vfs_deinitUserspace(process_t *p);
 
 uint64_t vfs_getFileinfo(vfs_stream_t *stream, vfs_fileinfo_t info);
+vfs_mode_t vfs_getStreamMode(vfs_stream_t *stream);
+vfs_stream_t *vfs_getUserspaceStream(process_t *p, vfs_file_t streamid);
+struct vmm_page_cache *vfs_getPageCache(vfs_stream_t *stream, size_t pages);
 
 int vfs_truncate(const char *path, size_t size);
 